@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include "matrix.h"
+
+
+/**
+ * Microbenchmarks of the access patterns of every decoration chain: iteration by
+ * rows and by columns, random access through operator(), copy construction into
+ * a basic matrix and operator<<, for square matrices of several sizes; the
+ * creation of views from many threads, shared or borrowed; and the product of
+ * two n x n matrices of doubles on 1, 2, 4, ... threads, with its parallel efficiency.
+ *
+ * Every benchmark runs a few times to warm up, then is repeated and timed; the
+ * results (minimum, mean, percentiles, time per element) are printed as a table
+ * and written as JSON.
+ *
+ * Usage: bench.exe [--sizes 8,64,...] [--warmup n] [--repetitions n]
+ *                  [--seconds s] [--filter text] [--json file]
+ *                  [--gemm n] [--threads 1,2,...]
+ * --seconds bounds the time spent repeating a single benchmark (at least 3 runs);
+ * --filter runs the benchmarks whose "operation/chain" name contains text;
+ * --gemm sets the size of the product (0 skips it), --threads the thread counts.
+ */
+
+
+namespace {
+
+struct options {
+    std::vector<unsigned int> sizes = {8, 64, 512, 4096, 16384};
+    unsigned int warmup = 2;
+    unsigned int repetitions = 20;
+    double seconds = 2;
+    std::string filter;
+    std::string json = "bench.json";
+    unsigned int gemm = 4096;
+    std::vector<unsigned int> threads = {1, 2, 4, 8, 16, 32, 64};
+};
+
+struct result {
+    std::string operation;
+    std::string chain;
+    unsigned int rows;
+    unsigned int cols;
+    std::size_t elements;       // elements visited by a run
+    std::vector<double> times;  // nanoseconds of every run, sorted
+    unsigned int threads = 0;   // threads of the pool, for the parallel benchmarks
+    double efficiency = 0;      // speedup over the first thread count, divided by the ratio of threads
+};
+
+// results are added to sink, so that the loops are not optimized away
+volatile long long sink;
+
+/**
+ * @brief stream buffer throwing away what is written, to time operator<< alone
+ */
+class null_buffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+
+    std::streamsize xsputn(const char *, std::streamsize n) override {
+        return n;
+    }
+};
+
+double percentile(const std::vector<double> &sorted, double p) {
+    std::size_t rank = static_cast<std::size_t>(p / 100 * (sorted.size() - 1) + 0.5);
+    return sorted[rank];
+}
+
+double mean(const std::vector<double> &v) {
+    double s = 0;
+    for (double x : v)
+        s += x;
+    return s / v.size();
+}
+
+/**
+ * @brief time f: warmup runs, then repetitions within the time budget; runs
+ * shorter than the resolution of the clock are timed in batches
+ * @return nanoseconds of every run, sorted
+ */
+template <typename function>
+std::vector<double> measure(const options &o, function f) {
+    typedef std::chrono::steady_clock clock;
+    auto time = [&f](unsigned int batch) {
+        clock::time_point start = clock::now();
+        for (unsigned int i = 0; i < batch; ++i)
+            f();
+        return std::chrono::duration<double, std::nano>(clock::now() - start).count() / batch;
+    };
+    for (unsigned int i = 0; i < o.warmup; ++i)
+        f();
+    unsigned int batch = 1;
+    while (batch < (1u << 20) && time(batch) * batch < 2e4)
+        batch *= 2;
+    std::vector<double> times;
+    double total = 0;
+    while (times.size() < o.repetitions && (times.size() < 3 || total < o.seconds * 1e9)) {
+        times.push_back(time(batch));
+        total += times.back() * batch;
+    }
+    std::sort(times.begin(), times.end());
+    return times;
+}
+
+/**
+ * @brief run every benchmark on a matrix
+ * @param chain name of the decoration chain of m
+ */
+template <typename M>
+void bench_chain(const options &o, std::vector<result> &results, const std::string &chain, const M &m) {
+    const unsigned int rows = m.get_rows(), cols = m.get_cols();
+    const std::size_t elements = std::size_t(rows) * cols;
+    auto run = [&](const std::string &operation, std::size_t visited, auto f) {
+        if ((operation + "/" + chain).find(o.filter) == std::string::npos)
+            return;
+        result r = {operation, chain, rows, cols, visited, measure(o, f)};
+        std::cout << operation << "/" << chain << " " << rows << "x" << cols << ": p50 "
+                  << percentile(r.times, 50) / 1e6 << " ms, "
+                  << percentile(r.times, 50) / std::max<std::size_t>(visited, 1) << " ns/element" << std::endl;
+        results.push_back(r);
+    };
+    run("rows", elements, [&] {
+        long long s = 0;
+        for (unsigned int i = 0; i < rows; ++i)
+            for (auto e = m.begin(i), ee = m.end(i); e != ee; ++e)
+                s += *e;
+        sink = sink + s;
+    });
+    run("columns", elements, [&] {
+        long long s = 0;
+        for (unsigned int j = 0; j < cols; ++j)
+            for (auto e = m.column_begin(j), ee = m.column_end(j); e != ee; ++e)
+                s += *e;
+        sink = sink + s;
+    });
+    // the same pseudo-random positions at every run
+    const std::size_t accesses = std::min<std::size_t>(elements, std::size_t(1) << 20);
+    std::vector<unsigned int> r(accesses), c(accesses);
+    std::mt19937 random(42);
+    for (std::size_t k = 0; k < accesses; ++k) {
+        r[k] = random() % rows;
+        c[k] = random() % cols;
+    }
+    run("random", accesses, [&] {
+        long long s = 0;
+        for (std::size_t k = 0; k < accesses; ++k)
+            s += m(r[k], c[k]);
+        sink = sink + s;
+    });
+    run("copy", elements, [&] {
+        // a deep copy, also of a basic matrix
+        matrix<int> copy(m, std::allocator<int>());
+        sink = sink + copy(rows - 1, cols - 1);
+    });
+    run("output", elements, [&] {
+        null_buffer buffer;
+        std::ostream out(&buffer);
+        out << m;
+    });
+}
+
+/**
+ * @brief time the creation of short-lived views of the same matrix from all the
+ * threads, through the shared elements and through a borrowed matrix
+ */
+void bench_views(const options &o, std::vector<result> &results, const matrix<int> &a) {
+    const unsigned int n = a.get_rows(), tasks = 64, views = 1000;
+    thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+    const matrix<int, borrowed_matrix> b = a.borrow();
+    auto run = [&](const std::string &chain, auto make_view) {
+        if (("views/" + chain).find(o.filter) == std::string::npos)
+            return;
+        // one sum per task, added to sink once all the tasks are done
+        std::vector<long long> sums(tasks);
+        result r = {"views", chain, n, n, std::size_t(tasks) * views, measure(o, [&] {
+            pool.parallel_for(tasks, [&](unsigned int t) {
+                long long s = 0;
+                for (unsigned int k = 0; k < views; ++k)
+                    s += make_view(t + k)(0, 0);
+                sums[t] = s;
+            });
+            for (long long s : sums)
+                sink = sink + s;
+        })};
+        std::cout << "views/" << chain << " " << n << "x" << n << " on " << pool.get_threads() << " threads: p50 "
+                  << percentile(r.times, 50) / r.elements << " ns/view" << std::endl;
+        results.push_back(r);
+    };
+    run("shared", [&](unsigned int k) { return a.get_transpose().get_submatrix(k % n, n, 0, n); });
+    run("borrowed", [&](unsigned int k) { return b.get_transpose().get_submatrix(k % n, n, 0, n); });
+}
+
+/**
+ * @brief time C = A * B on n x n doubles for every thread count; the parallel
+ * efficiency of t threads is t0 * time(t0) / (t * time(t)), where t0 is the first
+ * thread count (1 by default)
+ */
+void bench_gemm(const options &o, std::vector<result> &results) {
+    const unsigned int n = o.gemm;
+    if (n == 0 || std::string("gemm/basic").find(o.filter) == std::string::npos)
+        return;
+    matrix<double> a(n, n), b(n, n), c(n, n);
+    for (unsigned int i = 0; i < n; ++i)
+        for (unsigned int j = 0; j < n; ++j) {
+            a(i, j) = ((i * 7 + j) % 13) * 0.25;
+            b(i, j) = ((i + 3 * j) % 11) * 0.5;
+        }
+    double first = 0; // threads times p50 of the first thread count
+    for (unsigned int t : o.threads) {
+        thread_pool pool(std::max(1u, t));
+        // elements: the multiply-adds of a run
+        result r = {"gemm", "basic", n, n, std::size_t(n) * n * n, measure(o, [&] {
+            gemm(1.0, a, b, 0.0, c, pool);
+        })};
+        const double p50 = percentile(r.times, 50);
+        r.threads = pool.get_threads();
+        if (first == 0)
+            first = r.threads * p50;
+        r.efficiency = first / (r.threads * p50);
+        std::cout << "gemm/basic " << n << "x" << n << " on " << r.threads << " threads: p50 " << p50 / 1e6
+                  << " ms, " << 2 * double(r.elements) / p50 << " GFLOPS, efficiency " << r.efficiency << std::endl;
+        results.push_back(r);
+    }
+    sink = sink + static_cast<long long>(c(n - 1, n - 1));
+}
+
+void write_json(const std::string &path, const std::vector<result> &results) {
+    std::ofstream out(path);
+    out << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const result &r = results[i];
+        out << "  {\"operation\": \"" << r.operation << "\", \"chain\": \"" << r.chain << "\", \"rows\": " << r.rows
+            << ", \"cols\": " << r.cols << ", \"elements\": " << r.elements
+            << ", \"repetitions\": " << r.times.size() << ", \"min_ns\": " << r.times.front()
+            << ", \"mean_ns\": " << mean(r.times) << ", \"p50_ns\": " << percentile(r.times, 50)
+            << ", \"p90_ns\": " << percentile(r.times, 90) << ", \"p99_ns\": " << percentile(r.times, 99)
+            << ", \"max_ns\": " << r.times.back()
+            << ", \"ns_per_element\": " << percentile(r.times, 50) / std::max<std::size_t>(r.elements, 1);
+        if (r.threads)
+            out << ", \"threads\": " << r.threads << ", \"efficiency\": " << r.efficiency;
+        out << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]\n";
+}
+
+// comma-separated numbers, e.g. 8,64,512
+std::vector<unsigned int> parse_list(const std::string &value) {
+    std::vector<unsigned int> numbers;
+    std::istringstream list(value);
+    std::string number;
+    while (std::getline(list, number, ','))
+        numbers.push_back(static_cast<unsigned int>(std::stoul(number)));
+    return numbers;
+}
+
+options parse(int argc, char **argv) {
+    options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string key = argv[i], value = argv[i + 1];
+        if (key == "--sizes")
+            o.sizes = parse_list(value);
+        else if (key == "--warmup")
+            o.warmup = static_cast<unsigned int>(std::stoul(value));
+        else if (key == "--repetitions")
+            o.repetitions = std::max(1u, static_cast<unsigned int>(std::stoul(value)));
+        else if (key == "--seconds")
+            o.seconds = std::stod(value);
+        else if (key == "--filter")
+            o.filter = value;
+        else if (key == "--json")
+            o.json = value;
+        else if (key == "--gemm")
+            o.gemm = static_cast<unsigned int>(std::stoul(value));
+        else if (key == "--threads")
+            o.threads = parse_list(value);
+        else
+            std::cerr << "unknown option " << key << std::endl;
+    }
+    return o;
+}
+
+} // namespace
+
+
+int main(int argc, char **argv) {
+    const options o = parse(argc, argv);
+    std::vector<result> results;
+    for (unsigned int n : o.sizes) {
+        matrix<int> a(n, n), v(n, 1);
+        for (unsigned int i = 0; i < n; ++i) {
+            v(i, 0) = int(i);
+            for (unsigned int j = 0; j < n; ++j)
+                a(i, j) = int(i ^ j);
+        }
+        // a border of n / 8 around the submatrices
+        const unsigned int b = n / 8, e = n - n / 8;
+        bench_chain(o, results, "basic", a);
+        bench_chain(o, results, "transpose", a.get_transpose());
+        bench_chain(o, results, "submatrix", a.get_submatrix(b, e, b, e));
+        bench_chain(o, results, "diagonal", a.get_diagonal());
+        bench_chain(o, results, "diagonalmatrix", v.get_diagonalmatrix());
+        bench_chain(o, results, "submatrix<transpose>", a.get_transpose().get_submatrix(b, e, b, e));
+        bench_chain(o, results, "transpose<submatrix<transpose>>",
+                    a.get_transpose().get_submatrix(b, e, b, e).get_transpose());
+        bench_chain(o, results, "diagonalmatrix<diagonal<submatrix>>",
+                    a.get_submatrix(b, e, b, e).get_diagonal().get_diagonalmatrix());
+        bench_chain(o, results, "submatrix<transpose<submatrix<transpose>>>",
+                    a.get_transpose().get_submatrix(b, e, b, e).get_transpose().get_submatrix(1, e - b, 0, e - b - 1));
+        bench_views(o, results, a);
+    }
+    bench_gemm(o, results);
+    write_json(o.json, results);
+    std::cout << results.size() << " benchmarks written to " << o.json << std::endl;
+}
@@ -1,5 +1,19 @@
 #include <iostream>
-#include "matrix.h" 
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "matrix.h"
+#include "matrix_binary.h"
+#include "matrix_decompositions.h"
+#include "matrix_tiled.h"
 
 
 
@@ -337,6 +351,1237 @@ void test_copy_iterators() {
     std::cout << "**************************" << std::endl << std::endl << std::endl;
 }
 
+void test_nested_views() {
+    std::cout << std::endl << "TEST NESTED VIEWS" << std::endl;
+    matrix<int> b(8, 10);
+    for (unsigned int i = 0; i < b.get_rows(); i++)
+        for (unsigned int j = 0; j < b.get_cols(); j++)
+            b(i, j) = 10 * i + j;
+    // 4 levels: diagonal of a submatrix of a transpose of a submatrix
+    auto d = b.get_submatrix(1, 7, 2, 9).get_transpose().get_submatrix(1, 5, 2, 6).get_diagonal();
+    assert(d.get_rows() == 4 && d.get_cols() == 1 && "Wrong size for nested view");
+    for (unsigned int i = 0; i < d.get_rows(); i++)
+        assert(d(i) == b(1 + 2 + i, 2 + 1 + i) && "Nested view is not sharing the right element");
+    d(0) = -1;
+    assert(b(3, 3) == -1 && "You are not sharing memory at all...");
+    std::cout << "d" << std::endl << d << std::endl;
+    // views of a diagonal matrix
+    auto f = b.get_diagonal().get_diagonalmatrix();
+    const auto g = f.get_transpose().get_submatrix(2, 6, 1, 5);
+    for (unsigned int i = 0; i < g.get_rows(); i++)
+        for (unsigned int j = 0; j < g.get_cols(); j++)
+            assert(g(i, j) == (i + 2 == j + 1 ? b(i + 2, i + 2) : 0) && "Wrong view of a diagonalmatrix");
+    const auto h = g.get_diagonal();
+    for (unsigned int i = 0; i < h.get_rows(); i++)
+        assert(h(i) == 0 && "The diagonal of g lies outside the diagonal of f");
+    const auto l = f.get_submatrix(0, 8, 3, 4).get_diagonalmatrix();
+    for (unsigned int i = 0; i < l.get_rows(); i++)
+        for (unsigned int j = 0; j < l.get_cols(); j++)
+            assert(l(i, j) == (i == 3 && j == 3 ? b(3, 3) : 0) && "Wrong diagonalmatrix of a column");
+    std::cout << "g" << std::endl << g << std::endl;
+    std::cout << "l" << std::endl << l;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_product() {
+    std::cout << std::endl << "TEST PRODUCT" << std::endl;
+    matrix<long> a(37, 300), b(290, 41);
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            a(i, j) = int((i * 7 + j) % 13) - 6;
+    for (unsigned int i = 0; i < b.get_rows(); i++)
+        for (unsigned int j = 0; j < b.get_cols(); j++)
+            b(i, j) = int((i + 3 * j) % 11) - 5;
+    // (a[:, 5:295] * b)^T computed as b^T * a[:, 5:295]^T, without materializing anything
+    auto at = a.get_submatrix(0, 37, 5, 295).get_transpose();
+    matrix<long> c = b.get_transpose() * at;
+    assert(c.get_rows() == 41 && c.get_cols() == 37 && "Wrong size for the product");
+    for (unsigned int i = 0; i < c.get_rows(); i++)
+        for (unsigned int j = 0; j < c.get_cols(); j++) {
+            long expected = 0;
+            for (unsigned int k = 0; k < 290; k++)
+                expected += a(j, k + 5) * b(k, i);
+            assert(c(i, j) == expected && "Wrong product");
+        }
+    // gemm into a view: d[1:4, 1:4] = 2 * diag(v) * e + 1 * d[1:4, 1:4]
+    matrix<long> d(5, 5), e(3, 3), v(3, 1);
+    for (unsigned int i = 0; i < 3; i++) {
+        v(i, 0) = i + 1;
+        for (unsigned int j = 0; j < 3; j++)
+            e(i, j) = 3 * i + j;
+    }
+    auto inner = d.get_submatrix(1, 4, 1, 4);
+    gemm(2, v.get_diagonalmatrix(), e, 1, inner);
+    for (unsigned int i = 0; i < 3; i++)
+        for (unsigned int j = 0; j < 3; j++)
+            assert(d(i + 1, j + 1) == 2 * long(i + 1) * e(i, j) && "Wrong gemm on a submatrix");
+    std::cout << "d" << std::endl << d;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_parallel_product() {
+    std::cout << std::endl << "TEST PARALLEL PRODUCT" << std::endl;
+    matrix<double> a(300, 257), b(257, 411);
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            a(i, j) = ((i * 7 + j) % 13) * 0.25;
+    for (unsigned int i = 0; i < b.get_rows(); i++)
+        for (unsigned int j = 0; j < b.get_cols(); j++)
+            b(i, j) = ((i + 3 * j) % 11) * 0.5;
+    matrix<double> serial = a * b;
+    thread_pool pool(4);
+    matrix<double> parallel(300, 411);
+    gemm(1.0, a, b, 0.0, parallel, pool);
+    for (unsigned int i = 0; i < serial.get_rows(); i++)
+        for (unsigned int j = 0; j < serial.get_cols(); j++)
+            assert(serial(i, j) == parallel(i, j) && "Parallel and serial products differ");
+    thread_pool::set_default_threads(3);
+    matrix<double> with_default = a * b;
+    thread_pool::set_default_threads(1);
+    for (unsigned int i = 0; i < serial.get_rows(); i++)
+        for (unsigned int j = 0; j < serial.get_cols(); j++)
+            assert(serial(i, j) == with_default(i, j) && "Parallel and serial products differ");
+    std::cout << "300x257 * 257x411 on 4 threads: ok" << std::endl;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_expressions() {
+    std::cout << std::endl << "TEST EXPRESSIONS" << std::endl;
+    matrix<int> a(3, 4), b(3, 4), c(4, 3);
+    for (unsigned int i = 0; i < 3; i++)
+        for (unsigned int j = 0; j < 4; j++) {
+            a(i, j) = i + j;
+            b(i, j) = 10 * i;
+            c(j, i) = i * j;
+        }
+    auto e = a + b * 2 - c.get_transpose();
+    a(0, 0) = 100; // expressions are lazy: the new value is used
+    matrix<int> d = e;
+    for (unsigned int i = 0; i < 3; i++)
+        for (unsigned int j = 0; j < 4; j++)
+            assert(d(i, j) == a(i, j) + 2 * b(i, j) - c(j, i) && "Wrong expression");
+    std::cout << "d = a + b * 2 - c.get_transpose()" << std::endl << d << std::endl;
+    std::cout << "-(a / 2) by column 1" << std::endl;
+    auto f = -(a / 2);
+    for (auto i = f.column_begin(1), ie = f.column_end(1); i != ie; ++i)
+        std::cout << *i << " ";
+    std::cout << std::endl;
+    // expressions can be multiplied without being evaluated first
+    matrix<int> g = (a + b) * c;
+    matrix<int> h = a + b;
+    matrix<int> k = h * c;
+    for (unsigned int i = 0; i < 3; i++)
+        for (unsigned int j = 0; j < 3; j++)
+            assert(g(i, j) == k(i, j) && "Wrong product of an expression");
+    std::cout << "**************************" << std::endl;
+}
+
+
+template <typename T>
+void check_simd_level(matrix_simd::simd_level level) {
+    const unsigned int n = 77;
+    std::vector<T> a(n), b(n), c(n), out(n), expected(n);
+    for (unsigned int i = 0; i < n; i++) {
+        a[i] = T(int(i * 7 % 19) - 9);
+        b[i] = T(int(i * 5 % 13) - 6);
+        c[i] = T(int(i % 5));
+    }
+    matrix_simd::kernel_table<T> k = matrix_simd::kernels_for<T>(level);
+    matrix_simd::kernel_table<T> ref = matrix_simd::kernels_for<T>(matrix_simd::level_scalar);
+    k.add(a.data(), b.data(), out.data(), n);
+    ref.add(a.data(), b.data(), expected.data(), n);
+    assert(out == expected && "Wrong vectorized add");
+    k.subtract(a.data(), b.data(), out.data(), n);
+    ref.subtract(a.data(), b.data(), expected.data(), n);
+    assert(out == expected && "Wrong vectorized subtract");
+    k.min(a.data(), b.data(), out.data(), n);
+    ref.min(a.data(), b.data(), expected.data(), n);
+    assert(out == expected && "Wrong vectorized min");
+    k.max(a.data(), b.data(), out.data(), n);
+    ref.max(a.data(), b.data(), expected.data(), n);
+    assert(out == expected && "Wrong vectorized max");
+    k.scale(a.data(), T(3), out.data(), n);
+    ref.scale(a.data(), T(3), expected.data(), n);
+    assert(out == expected && "Wrong vectorized scale");
+    k.fma(a.data(), b.data(), c.data(), out.data(), n);
+    ref.fma(a.data(), b.data(), c.data(), expected.data(), n);
+    assert(out == expected && "Wrong vectorized fma");
+}
+
+
+template <typename T>
+void check_tile_level(matrix_simd::simd_level level) {
+    typedef gemm_blocking<T> blocking;
+    const unsigned int k = 37;
+    std::vector<T> a(k * blocking::mr), b(k * blocking::nr);
+    std::vector<T> out(blocking::mr * blocking::nr), expected(blocking::mr * blocking::nr);
+    for (unsigned int i = 0; i < a.size(); i++)
+        a[i] = T(int(i * 7 % 19) - 9);
+    for (unsigned int i = 0; i < b.size(); i++)
+        b[i] = T(int(i * 5 % 13) - 6);
+    matrix_detail::tile_kernel_for<T>(level)(k, a.data(), b.data(), out.data());
+    matrix_detail::tile_scalar<T>(k, a.data(), b.data(), expected.data());
+    assert(out == expected && "Wrong vectorized micro-kernel");
+}
+
+
+void test_simd() {
+    std::cout << std::endl << "TEST SIMD" << std::endl;
+    matrix_simd::simd_level best = matrix_simd::detect_level();
+    std::cout << "widest instruction set: " << best << std::endl;
+    for (int level = matrix_simd::level_scalar; level <= best; level++) {
+        check_simd_level<float>(matrix_simd::simd_level(level));
+        check_simd_level<double>(matrix_simd::simd_level(level));
+        check_simd_level<int>(matrix_simd::simd_level(level));
+        check_tile_level<float>(matrix_simd::simd_level(level));
+        check_tile_level<double>(matrix_simd::simd_level(level));
+    }
+    matrix<float> a(9, 13), b(13, 9);
+    for (unsigned int i = 0; i < 9; i++)
+        for (unsigned int j = 0; j < 13; j++) {
+            a(i, j) = i * 0.5f + j;
+            b(j, i) = i - j * 0.25f;
+        }
+    // contiguous rows (a submatrix) and strided ones (a transpose) in the same call
+    matrix<float> c(4, 5), d(4, 5);
+    fma(a.get_submatrix(2, 6, 3, 8), b.get_transpose().get_submatrix(1, 5, 0, 5),
+        a.get_submatrix(0, 4, 0, 5), c);
+    max(a.get_submatrix(2, 6, 3, 8), b.get_transpose().get_submatrix(1, 5, 0, 5), d);
+    for (unsigned int i = 0; i < 4; i++)
+        for (unsigned int j = 0; j < 5; j++) {
+            float x = a(i + 2, j + 3), y = b(j, i + 1);
+            assert(c(i, j) == x * y + a(i, j) && "Wrong fma");
+            assert(d(i, j) == (x < y ? y : x) && "Wrong max");
+        }
+    matrix<float> e = a.get_submatrix(1, 9, 0, 9) - b.get_transpose().get_submatrix(0, 8, 2, 11);
+    matrix<float> f = a * 2.0f;
+    for (unsigned int i = 0; i < 8; i++)
+        for (unsigned int j = 0; j < 9; j++) {
+            assert(e(i, j) == a(i + 1, j) - b(j + 2, i) && "Wrong vectorized expression");
+            assert(f(i, j) == a(i, j) * 2.0f && "Wrong vectorized expression");
+        }
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_storage() {
+    std::cout << std::endl << "TEST STORAGE" << std::endl;
+    matrix<double, aligned_matrix> a(7, 9);
+    assert(reinterpret_cast<std::uintptr_t>(&a(0, 0)) % 64 == 0 && "Elements are not aligned!");
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            a(i, j) = i + j;
+    auto t = a.get_transpose().get_submatrix(1, 8, 2, 5);
+    assert(t(0, 0) == a(2, 1) && "Decorations do not work on aligned matrices");
+    // every allocation (elements and shared_ptr control block) comes from the arena
+    char arena[4096];
+    std::pmr::monotonic_buffer_resource resource(arena, sizeof(arena), std::pmr::null_memory_resource());
+    matrix<double, pmr_matrix> p(3, 3, &resource);
+    matrix<double, pmr_matrix> q(a.get_submatrix(0, 3, 0, 3), &resource);
+    gemm(1.0, q, a.get_submatrix(0, 3, 0, 3).get_transpose(), 0.0, p);
+    for (unsigned int i = 0; i < 3; i++)
+        for (unsigned int j = 0; j < 3; j++) {
+            double expected = 0;
+            for (unsigned int k = 0; k < 3; k++)
+                expected += a(i, k) * a(j, k);
+            assert(p(i, j) == expected && "Wrong product of pmr matrices");
+        }
+    assert(p.get_allocator().resource() == &resource && "Wrong memory resource");
+    matrix<double> d = p;
+    // the default constructor stays implicit
+    matrix<double, pmr_matrix> empty = {};
+    assert(empty.get_rows() == 0 && empty.get_cols() == 0 && "Wrong empty matrix");
+    std::cout << "d = q * q^T, computed in an arena" << std::endl << d;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_fixed() {
+    std::cout << std::endl << "TEST FIXED" << std::endl;
+    // computed by the compiler
+    constexpr matrix<int, fixed<2, 3>> a{1, 2, 3, 4, 5, 6};
+    constexpr matrix<int, fixed<2, 2>> p = a * a.transposed();
+    static_assert(p(0, 0) == 14 && p(0, 1) == 32 && p(1, 1) == 77, "Wrong constexpr product");
+    static_assert(determinant(p) == 14 * 77 - 32 * 32, "Wrong constexpr determinant");
+    static_assert(sizeof(matrix<float, fixed<4, 4>>) == 16 * sizeof(float), "Fixed matrices must be stored inline");
+    matrix<double, fixed<4, 4>> m{2, 1, 0, 3,
+                                  1, 4, 1, 0,
+                                  0, 1, 5, 2,
+                                  3, 0, 2, 6};
+    matrix<double, fixed<3, 3>> s(matrix<double>(m.get_submatrix(1, 4, 0, 3)));
+    matrix<double, fixed<5, 5>> g;
+    for (unsigned int i = 0; i < 5; i++)
+        for (unsigned int j = 0; j < 5; j++)
+            g(i, j) = (i == j) ? 7 : double(i + 2 * j) / 5;
+    matrix<double, fixed<4, 4>> mi = m * inverse(m);
+    matrix<double, fixed<3, 3>> si = inverse(s) * s;
+    matrix<double, fixed<5, 5>> gi = g * inverse(g);
+    for (unsigned int i = 0; i < 5; i++)
+        for (unsigned int j = 0; j < 5; j++) {
+            double expected = (i == j) ? 1 : 0;
+            assert(std::abs(gi(i, j) - expected) < 1e-12 && "Wrong 5x5 inverse");
+            if (i < 4 && j < 4)
+                assert(std::abs(mi(i, j) - expected) < 1e-12 && "Wrong 4x4 inverse");
+            if (i < 3 && j < 3)
+                assert(std::abs(si(i, j) - expected) < 1e-12 && "Wrong 3x3 inverse");
+        }
+    assert(std::abs(determinant(m) - determinant(m.transposed())) < 1e-9 && "Wrong determinant");
+    assert(std::abs(determinant(g) * determinant(inverse(g)) - 1) < 1e-12 && "Wrong determinant");
+    // decorations refer to the inline elements
+    auto t = m.get_transpose().get_submatrix(0, 2, 1, 4);
+    t(1, 2) = 42;
+    assert(m(3, 1) == 42 && "Decorations of a fixed matrix must share its elements");
+    // a const (e.g. constexpr) fixed matrix only gives a read-only descriptor; copies of it still work
+    static_assert(std::is_same<decltype(a.get_view().base), const int *>::value, "Writable view of a const matrix");
+    matrix<int> ac(a);
+    assert(ac(1, 2) == 6 && matrix<int>(p * a)(1, 2) == 32 * 3 + 77 * 6 && "Wrong copy of a const fixed matrix");
+    std::cout << "m" << std::endl << m;
+    std::cout << "diagonal of m" << std::endl << m.get_diagonal();
+    std::cout << "submatrix [0, 2) x [1, 4) of m^T" << std::endl << t;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_layout() {
+    std::cout << std::endl << "TEST LAYOUT" << std::endl;
+    matrix<int, column_major_matrix> a(3, 4);
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            a(i, j) = 10 * i + j;
+    assert(a.data()[1] == 10 && a.data()[3] == 1 && "Elements are not stored column after column");
+    // columns are walked directly in the storage, rows through operator()
+    int expected = 0;
+    for (auto i = a.column_begin(2); i != a.column_end(2); ++i, expected += 10)
+        assert(*i == expected + 2 && "Wrong column iterator");
+    matrix<int> r = a;
+    matrix<int, column_major_matrix> c = r.get_transpose().get_transpose();
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            assert(r(i, j) == a(i, j) && c(i, j) == a(i, j) && "Wrong copy between layouts");
+    std::cout << "a (column-major)" << std::endl << a;
+    std::cout << "a^T" << std::endl << a.get_transpose();
+    std::cout << "diagonal of a[1:3, 1:4]" << std::endl << a.get_submatrix(1, 3, 1, 4).get_diagonal();
+    auto d = a.get_submatrix(0, 3, 1, 2).get_diagonalmatrix();
+    assert(d(1, 1) == 11 && d(0, 1) == 0 && "Wrong diagonalmatrix of a column-major matrix");
+    matrix<int, column_major_matrix> s = a + c;
+    matrix<int, column_major_matrix> p = a * a.get_transpose();
+    for (unsigned int i = 0; i < a.get_rows(); i++) {
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            assert(s(i, j) == 2 * a(i, j) && "Wrong sum of column-major matrices");
+        for (unsigned int j = 0; j < a.get_rows(); j++) {
+            int dot = 0;
+            for (unsigned int k = 0; k < a.get_cols(); k++)
+                dot += a(i, k) * a(j, k);
+            assert(p(i, j) == dot && "Wrong product of column-major matrices");
+        }
+    }
+    // a Fortran array with leading dimension 4, used in place
+    double fortran[4 * 2] = {1, 2, 3, -1, 4, 5, 6, -1};
+    strided_view<double, false> descriptor = {fortran, 1, 4, 3, 2};
+    matrix<double, borrowed_matrix> f(descriptor);
+    f(2, 1) = 7;
+    assert(fortran[6] == 7 && "A borrowed matrix must not copy the elements");
+    std::cout << "Fortran array, used in place" << std::endl << f;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_copy_on_write() {
+    std::cout << std::endl << "TEST COPY ON WRITE" << std::endl;
+    matrix<int> a(3, 3);
+    for (unsigned int i = 0; i < 3; i++)
+        for (unsigned int j = 0; j < 3; j++)
+            a(i, j) = 3 * i + j;
+    const matrix<int> &ca = a;
+    const matrix<int> b(a, copy_on_write);
+    matrix<int> c(a, copy_on_write);
+    const matrix<int> &cc = c;
+    assert(b.data() == ca.data() && cc.data() == ca.data() && "A copy-on-write copy must share the elements");
+    // the first write duplicates the elements of the writer only
+    c(0, 0) = 100;
+    assert(cc.data() != ca.data() && b.data() == ca.data() && "Wrong copy on write");
+    a(1, 1) = 200;
+    assert(b(0, 0) == 0 && b(1, 1) == 4 && a(0, 0) == 0 && c(1, 1) == 4 && "Copies must be independent");
+    // views still alias the matrix they come from
+    matrix<int> d(b, copy_on_write);
+    auto t = d.get_transpose();
+    t(0, 2) = 300;
+    assert(d(2, 0) == 300 && b(2, 0) == 6 && "Views must share the elements of their own matrix");
+    // a matrix already shared with a view is copied at once
+    auto s = a.get_submatrix(0, 2, 0, 2);
+    matrix<int> e(a, copy_on_write);
+    s(0, 1) = 400;
+    assert(a(0, 1) == 400 && e(0, 1) == 1 && "Wrong copy of a matrix shared with a view");
+    // const views never write the shared elements (and never change the sharing)
+    const matrix<int> f(e, copy_on_write);
+    const matrix<int> &ce = e;
+    auto cv = ce.get_transpose();
+    assert(cv(1, 0) == 1 && f.data() == ce.data() && "Wrong const view of shared elements");
+    cv(1, 0) = 9;
+    assert(f(0, 1) == 1 && e(0, 1) == 1 && "A const view wrote the shared elements");
+    e(0, 1) = 2;
+    assert(f(0, 1) == 1 && f.data() != ce.data() && "Wrong copy on write after a const view");
+    // plain copies keep aliasing, also after a copy on write of either of them
+    matrix<int> g(5, 5), h(g, copy_on_write);
+    matrix<int> alias = g;
+    alias(0, 0) = 5;
+    assert(g(0, 0) == 5 && h(0, 0) == 0 && "Plain copies must alias");
+    matrix<int> k(h, copy_on_write), other = k;
+    k(1, 1) = 6;
+    assert(other(1, 1) == 6 && h(1, 1) == 0 && "Plain copies of a copy on write must alias");
+    // copies of const matrices share only elements already shared on write
+    const matrix<int> &cg = g;
+    const matrix<int> l(cg, copy_on_write), m(h, copy_on_write);
+    assert(l.data() != cg.data() && m.data() == static_cast<const matrix<int> &>(h).data() && "Wrong copy of a const matrix");
+    std::cout << "b" << std::endl << b;
+    std::cout << "d" << std::endl << d;
+    std::cout << "**************************" << std::endl;
+}
+
+
+template <typename typeA, typename typeB>
+void check_same(const matrix<int, typeA> &a, const matrix<int, typeB> &b) {
+    assert((a.get_rows() == b.get_rows() && a.get_cols() == b.get_cols()) && "Wrong size of the copy");
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            assert(a(i, j) == b(i, j) && "Wrong copy");
+}
+
+template <typename type>
+void check_copies(const matrix<int, type> &m) {
+    check_same(matrix<int>(m), m);
+    check_same(matrix<int, column_major_matrix>(m), m);
+}
+
+void test_copy_paths() {
+    std::cout << std::endl << "TEST COPY PATHS" << std::endl;
+    matrix<int> a(70, 45);
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            a(i, j) = 100 * i + j;
+    matrix<int, column_major_matrix> c = a;
+    check_copies(a);
+    check_copies(c);
+    check_copies(a.get_transpose());
+    check_copies(c.get_transpose());
+    check_copies(a.get_submatrix(3, 67, 5, 40));
+    check_copies(c.get_submatrix(3, 67, 5, 40).get_transpose());
+    check_copies(a.get_diagonal());
+    check_copies(a.get_submatrix(0, 1, 0, 45));
+    check_copies(c.get_diagonal().get_transpose());
+    auto d = a.get_submatrix(10, 50, 7, 8).get_diagonalmatrix();
+    check_copies(d);
+    check_copies(d.get_submatrix(5, 30, 2, 38));
+    check_copies(d.get_submatrix(5, 30, 2, 38).get_transpose());
+    check_copies(d.get_diagonal());
+    check_copies(a + a.get_submatrix(0, 70, 0, 45));
+    std::cout << "diagonalmatrix [5, 10) x [2, 9) of diag(a[10:50, 7])" << std::endl
+              << matrix<int>(d.get_submatrix(5, 10, 2, 9));
+    std::cout << "**************************" << std::endl;
+}
+
+
+template <typename type>
+void check_transpose_in_place(unsigned int rows, unsigned int cols) {
+    matrix<int, type> a(rows, cols);
+    for (unsigned int i = 0; i < rows; i++)
+        for (unsigned int j = 0; j < cols; j++)
+            a(i, j) = 1000 * i + j;
+    matrix<int> expected = a.get_transpose();
+    const int *elements = a.data();
+    a.transpose();
+    assert(a.data() == elements && "The transpose must not reallocate");
+    check_same(a, expected);
+}
+
+void test_transpose_in_place() {
+    std::cout << std::endl << "TEST TRANSPOSE IN PLACE" << std::endl;
+    check_transpose_in_place<basic_matrix>(70, 70);
+    check_transpose_in_place<basic_matrix>(37, 64);
+    check_transpose_in_place<basic_matrix>(123, 457);
+    check_transpose_in_place<basic_matrix>(1, 9);
+    check_transpose_in_place<column_major_matrix>(33, 33);
+    check_transpose_in_place<column_major_matrix>(50, 3);
+    matrix<int> a(2, 3);
+    for (unsigned int i = 0; i < 2; i++)
+        for (unsigned int j = 0; j < 3; j++)
+            a(i, j) = 3 * i + j;
+    a.transpose();
+    std::cout << "a (2 x 3) transposed in place" << std::endl << a;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_random_access_iterators() {
+    std::cout << std::endl << "TEST RANDOM ACCESS ITERATORS" << std::endl;
+    typedef matrix<int>::col_iterator col_iterator;
+    typedef matrix<int, submatrix<basic_matrix>>::iterator sub_iterator;
+    static_assert(std::is_same<std::iterator_traits<col_iterator>::iterator_category,
+                               std::random_access_iterator_tag>::value, "Wrong category");
+    static_assert(std::is_same<std::iterator_traits<sub_iterator>::iterator_category,
+                               std::random_access_iterator_tag>::value, "Wrong category");
+    matrix<int> a(6, 5);
+    for (unsigned int i = 0; i < 6; i++)
+        for (unsigned int j = 0; j < 5; j++)
+            a(i, j) = (7 * i + 3 * j) % 11;
+    // sort column 2 in place
+    std::sort(a.column_begin(2), a.column_end(2));
+    assert(std::is_sorted(a.column_begin(2), a.column_end(2)) && "Wrong sort of a column");
+    // sort the elements of a submatrix, row after row
+    auto s = a.get_submatrix(1, 4, 0, 2);
+    std::sort(s.begin(), s.end(), std::greater<int>());
+    for (unsigned int k = 1; k < 6; k++)
+        assert(s(k / 2, k % 2) <= s((k - 1) / 2, (k - 1) % 2) && "Wrong sort of a submatrix");
+    // jumps, distances and binary search
+    auto first = a.column_begin(2), last = a.column_end(2);
+    assert(last - first == 6 && first[3] == a(3, 2) && *(last - 1) == a(5, 2) && "Wrong jumps");
+    auto found = std::lower_bound(first, last, a(4, 2));
+    assert(*found == a(4, 2) && "Wrong binary search");
+    auto t = a.get_transpose();
+    auto middle = t.begin() + 7;
+    assert(*middle == a(1, 1) && *--middle == a(0, 1) && middle < t.end() && "Wrong transpose iterator");
+    const auto d = a.get_diagonal();
+    assert(std::distance(d.begin(), d.end()) == 5 && "Wrong distance");
+    std::cout << "a, column 2 sorted and a[1:4, 0:2] sorted in decreasing order" << std::endl << a;
+    std::cout << "**************************" << std::endl;
+}
+
+
+// sum of the elements listed by the segments of m
+template <typename type>
+long sum_of_segments(const matrix<int, type> &m) {
+    auto s = get_segments(m);
+    long sum = 0;
+    for (std::size_t i = 0; i < s.count; i++)
+        for (std::size_t k = 0; k < s.length; k++)
+            sum += s.run(i)[k * s.step];
+    return sum;
+}
+
+template <typename type>
+long sum_of_elements(const matrix<int, type> &m) {
+    long sum = 0;
+    for (unsigned int i = 0; i < m.get_rows(); i++)
+        for (unsigned int j = 0; j < m.get_cols(); j++)
+            sum += m(i, j);
+    return sum;
+}
+
+void test_segments() {
+    std::cout << std::endl << "TEST SEGMENTS" << std::endl;
+    matrix<int> a(8, 6);
+    for (unsigned int i = 0; i < 8; i++)
+        for (unsigned int j = 0; j < 6; j++)
+            a(i, j) = 10 * i + j;
+    strided_segments<int> s = get_segments(a);
+    assert(s.count == 1 && s.length == 48 && s.base == &a(0, 0) && "A basic matrix is a single run");
+    s = get_segments(a.get_submatrix(2, 5, 1, 4));
+    assert(s.count == 3 && s.length == 3 && s.stride == 6 && !s.by_column && "One run per row");
+    s = get_segments(a.get_submatrix(2, 5, 1, 4).get_transpose());
+    assert(s.count == 3 && s.length == 3 && s.by_column && "One run per column");
+    s = get_segments(a.get_submatrix(2, 5, 0, 6));
+    assert(s.count == 1 && s.length == 18 && "Full rows are a single run");
+    s = get_segments(a.get_diagonal());
+    assert(s.count == 6 && s.length == 1 && s.stride == 7 && "A diagonal is a run per element");
+    matrix<int, column_major_matrix> c = a;
+    s = get_segments(c.get_submatrix(1, 7, 2, 4));
+    assert(s.count == 2 && s.length == 6 && s.by_column && "One run per column");
+    const auto d = a.get_submatrix(0, 8, 2, 3).get_diagonalmatrix().get_submatrix(1, 7, 3, 8);
+    s = get_segments(d);
+    assert(s.count == 4 && s.length == 1 && s.stride == 6 && "Wrong runs of a diagonal matrix");
+    assert(sum_of_segments(d) == sum_of_elements(d) && "Wrong elements of a diagonal matrix");
+    matrix<int> v = a.get_diagonal();
+    assert(get_segments(v.get_diagonalmatrix().get_submatrix(2, 6, 0, 5)).count == 1 && "A dense diagonal is one run");
+    assert(sum_of_segments(a.get_transpose().get_submatrix(1, 5, 2, 7)) ==
+           sum_of_elements(a.get_transpose().get_submatrix(1, 5, 2, 7)) && "Wrong runs");
+    matrix<int, fixed<2, 2>> f{1, 2, 3, 4};
+    assert(sum_of_segments(f) == 10 && "Wrong runs of a fixed matrix");
+    std::cout << "rows of a[2:5, 1:4], one run each" << std::endl;
+    s = get_segments(a.get_submatrix(2, 5, 1, 4));
+    for (std::size_t i = 0; i < s.count; i++) {
+        for (std::size_t k = 0; k < s.length; k++)
+            std::cout << s.run(i)[k] << " ";
+        std::cout << std::endl;
+    }
+    std::cout << "**************************" << std::endl;
+}
+
+
+template <typename type>
+void check_equal(const matrix<int> &a, const matrix<int, type> &b) {
+    assert(a.get_rows() == b.get_rows() && a.get_cols() == b.get_cols() && "Wrong sizes");
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            assert(a(i, j) == b(i, j) && "Different elements");
+}
+
+void test_sparse() {
+    std::cout << std::endl << "TEST SPARSE" << std::endl;
+    matrix<int> d(40, 30);
+    for (unsigned int i = 0; i < 40; i++)
+        for (unsigned int j = 0; j < 30; j++)
+            d(i, j) = ((i * 7 + j * 3) % 11 == 0) ? int(i + j) + 1 : 0;
+    matrix<int, csr_matrix> r = d;
+    matrix<int, csc_matrix> c = d;
+    matrix<int, coo_matrix> o = d;
+    assert(r.get_nonzeros() == c.get_nonzeros() && r.get_nonzeros() == o.get_nonzeros() && "Wrong non-zeros");
+    check_equal(matrix<int>(r), d);
+    check_equal(matrix<int>(c), d);
+    check_equal(matrix<int>(o), d);
+    check_equal(matrix<int>(matrix<int, csc_matrix>(r)), d);
+    check_equal(matrix<int>(matrix<int, csr_matrix>(c)), d);
+    check_equal(matrix<int>(r.get_transpose()), d.get_transpose());
+    check_equal(matrix<int>(c.get_transpose()), d.get_transpose());
+    check_equal(matrix<int>(o.get_transpose()), d.get_transpose());
+    assert(&r.get_transpose().get_storage() == &r.get_storage() && "The transpose shares the arrays");
+    for (unsigned int i = 0; i < 40; i++)
+        for (unsigned int j = 0; j < 30; j++)
+            assert(r(i, j) == d(i, j) && c(i, j) == d(i, j) && "Wrong element");
+    // repeated triplets add up, in any order
+    matrix<int, coo_matrix> t(3, 4);
+    t.insert(2, 1, 5);
+    t.insert(0, 3, 1);
+    t.insert(2, 1, -2);
+    t.insert(0, 0, 4);
+    matrix<int, csr_matrix> tr = t;
+    assert(tr.get_nonzeros() == 3 && tr(2, 1) == 3 && tr(0, 3) == 1 && tr(0, 0) == 4 && tr(1, 1) == 0 && "Wrong COO conversion");
+    assert((matrix<int, csc_matrix>(t)(2, 1) == 3 && t(2, 1) == 3) && "Wrong COO conversion");
+    // products, serial and parallel, by matrices and vectors
+    matrix<int> b(30, 17), x(30, 1);
+    for (unsigned int i = 0; i < 30; i++) {
+        for (unsigned int j = 0; j < 17; j++)
+            b(i, j) = int((i + 2 * j) % 5) - 2;
+        x(i, 0) = int(i % 7) - 3;
+    }
+    check_equal(r * b, d * b);
+    check_equal(c * b, d * b);
+    check_equal(r * x, d * x);
+    check_equal(c * x, d * x);
+    check_equal(r * b.get_submatrix(0, 30, 3, 9), d * b.get_submatrix(0, 30, 3, 9));
+    check_equal(c.get_transpose() * d, d.get_transpose() * d);
+    thread_pool pool(4);
+    for (unsigned int n : {1u, 17u}) {
+        matrix<int> expected = d * b.get_submatrix(0, 30, 0, n);
+        matrix<int> by_rows(40, n), by_cols(40, n);
+        for (unsigned int i = 0; i < 40; i++)
+            for (unsigned int j = 0; j < n; j++)
+                by_rows(i, j) = by_cols(i, j) = int(i) - int(j);
+        gemm(2, r, b.get_submatrix(0, 30, 0, n), 3, by_rows, pool);
+        gemm(2, c, b.get_submatrix(0, 30, 0, n), 3, by_cols, pool);
+        for (unsigned int i = 0; i < 40; i++)
+            for (unsigned int j = 0; j < n; j++)
+                assert(by_rows(i, j) == 2 * expected(i, j) + 3 * (int(i) - int(j)) &&
+                       by_cols(i, j) == by_rows(i, j) && "Parallel sparse products differ");
+    }
+    // a wide CSC matrix times a vector sums private buffers, a tall one goes through CSR
+    matrix<int> w(3, 200), y(200, 1), wide(3, 1), tall(200, 1);
+    for (unsigned int j = 0; j < 200; j++) {
+        for (unsigned int i = 0; i < 3; i++)
+            w(i, j) = int((i + j) % 4) - 1;
+        y(j, 0) = int(j % 9) - 4;
+    }
+    matrix<int, csc_matrix> sw = w, st = w.get_transpose();
+    gemm(1, sw, y, 0, wide, pool);
+    gemm(1, st, wide, 0, tall, pool);
+    check_equal(wide, w * y);
+    check_equal(tall, w.get_transpose() * (w * y));
+    std::cout << "40x30 with " << r.get_nonzeros() << " non-zeros: conversions and products ok" << std::endl;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_diagonal_arithmetic() {
+    std::cout << std::endl << "TEST DIAGONAL ARITHMETIC" << std::endl;
+    matrix<int> u(6, 1), v(6, 1), b(6, 5);
+    for (unsigned int i = 0; i < 6; i++) {
+        u(i, 0) = int(i) + 1;
+        v(i, 0) = 2 - int(i);
+        for (unsigned int j = 0; j < 5; j++)
+            b(i, j) = int(3 * i + j) % 7 - 3;
+    }
+    auto du = u.get_diagonalmatrix();
+    auto dv = v.get_diagonalmatrix();
+    matrix<int> dense_u = du, dense_v = dv;
+    // products with dense matrices scale rows or columns
+    check_equal(du * b, dense_u * b);
+    check_equal(b.get_transpose() * du, b.get_transpose() * dense_u);
+    check_equal(du.get_submatrix(1, 5, 0, 6) * b, dense_u.get_submatrix(1, 5, 0, 6) * b);
+    check_equal(du.get_submatrix(0, 6, 2, 5) * b.get_submatrix(2, 5, 0, 5), dense_u.get_submatrix(0, 6, 2, 5) * b.get_submatrix(2, 5, 0, 5));
+    check_equal(b.get_transpose() * du.get_submatrix(0, 6, 1, 4), b.get_transpose() * dense_u.get_submatrix(0, 6, 1, 4));
+    check_equal(du.get_diagonal().get_transpose() * b, dense_u.get_diagonal().get_transpose() * b);
+    check_equal(du.get_submatrix(0, 4, 1, 6) * dv.get_submatrix(1, 6, 0, 3), dense_u.get_submatrix(0, 4, 1, 6) * dense_v.get_submatrix(1, 6, 0, 3));
+    thread_pool pool(3);
+    matrix<int> c(6, 5);
+    gemm(2, du, b + b, 0, c, pool);
+    check_equal(c, dense_u * b * 4);
+    // results that stay diagonal
+    matrix<int, diagonalmatrix<basic_matrix>> s = du + dv, d = du - dv, p = du * dv, n = -du, k = 3 * du * 2;
+    check_equal(dense_u + dense_v, s);
+    check_equal(dense_u - dense_v, d);
+    check_equal(dense_u * dense_v, p);
+    check_equal(-dense_u, n);
+    check_equal(dense_u * 6, k);
+    check_equal(matrix<int>(k / 3), dense_u * 2);
+    assert(determinant(du) == 720 && determinant(dv) == 0 && "Wrong determinant");
+    matrix<double> w(4, 1);
+    for (unsigned int i = 0; i < 4; i++)
+        w(i, 0) = 1 << i;
+    auto dw = w.get_diagonalmatrix();
+    assert(determinant(inverse(dw)) * determinant(dw) == 1.0 && inverse(dw)(3, 3) == 0.125 && "Wrong inverse");
+    // a large diagonal scaling costs O(n) per column
+    matrix<double> big(100000, 1), x(100000, 2);
+    for (unsigned int i = 0; i < 100000; i++) {
+        big(i, 0) = 0.5;
+        x(i, 0) = i;
+        x(i, 1) = 1.0;
+    }
+    matrix<double> y = big.get_diagonalmatrix() * x;
+    auto twice = big.get_diagonalmatrix() * big.get_diagonalmatrix();
+    assert(y(99999, 0) == 49999.5 && y(7, 1) == 0.5 && twice(99999, 99999) == 0.25 && "Wrong scaling");
+    std::cout << "diag(1..6) * b" << std::endl << du * b;
+    std::cout << "**************************" << std::endl;
+}
+
+
+template <typename type>
+void check_close(const matrix<double> &a, const matrix<double, type> &b) {
+    assert(a.get_rows() == b.get_rows() && a.get_cols() == b.get_cols() && "Wrong sizes");
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            assert(std::abs(a(i, j) - b(i, j)) < 1e-9 && "Different elements");
+}
+
+void test_packed() {
+    std::cout << std::endl << "TEST PACKED" << std::endl;
+    const unsigned int n = 9;
+    matrix<double> d(n, n), b(n, 4);
+    for (unsigned int i = 0; i < n; i++) {
+        for (unsigned int j = 0; j < n; j++)
+            d(i, j) = (i == j) ? 10.0 + i : 1.0 / (1 + i + 2 * j);
+        for (unsigned int j = 0; j < 4; j++)
+            b(i, j) = double(int(i * 3 + j) % 5) - 2;
+    }
+    matrix<double, upper_triangular_matrix> u = d;
+    matrix<double, lower_triangular_matrix> l = d;
+    matrix<double, symmetric_matrix> s = d;
+    matrix<double, banded_matrix> k(d, 2, 1);
+    assert(u.get_stored() == n * (n + 1) / 2 && s.get_stored() == n * (n + 1) / 2 && k.get_stored() == 4 * n && "Wrong storage");
+    // read as dense matrices, also through non-const ones
+    const auto &cu = u;
+    const auto &cl = l;
+    const auto &ck = k;
+    for (unsigned int i = 0; i < n; i++)
+        for (unsigned int j = 0; j < n; j++) {
+            const double x = u(i, j), y = l(i, j), z = k(i, j);
+            assert(x == (j >= i ? d(i, j) : 0.0) && y == (j <= i ? d(i, j) : 0.0) && "Wrong triangle");
+            assert(cu(i, j) == x && cl(i, j) == y && ck(i, j) == z && "Wrong const access");
+            assert(s(i, j) == d(std::min(i, j), std::max(i, j)) && "Wrong symmetric element");
+            assert(z == ((j + 2 >= i && j <= i + 1) ? d(i, j) : 0.0) && "Wrong band");
+        }
+    // writes inside the stored part
+    matrix<double, upper_triangular_matrix> w = u;
+    w(2, 5) = 3.0;
+    w(2, 5) += w(2, 2);
+    k(4, 3) = k(4, 5);
+    assert(cu(2, 5) == 15.0 && w(5, 2) == 0.0 && ck(4, 3) == d(4, 5) && "Wrong writes of packed elements");
+    w(2, 5) = d(2, 5);
+    k(4, 3) = d(4, 3);
+    // dense copies and transposes sharing the elements
+    matrix<double> du = u, dl = l, ds = s, dk = k;
+    check_close(du, u.get_transpose().get_transpose());
+    check_close(matrix<double>(du.get_transpose()), u.get_transpose());
+    check_close(matrix<double>(dl.get_transpose()), l.get_transpose());
+    check_close(matrix<double>(dk.get_transpose()), k.get_transpose());
+    check_close(ds, s.get_transpose());
+    s(1, 4) = 7.0;
+    assert(s(4, 1) == 7.0 && "Symmetric elements are shared");
+    ds = matrix<double>(s);
+    // products
+    check_close(du * b, u * b);
+    check_close(dl * b, l * b);
+    check_close(ds * b, s * b);
+    check_close(dk * b, k * b);
+    check_close(dk.get_transpose() * b, k.get_transpose() * b);
+    thread_pool pool(3);
+    matrix<double> c(n, 4);
+    gemm(1.0, l, b.get_submatrix(0, n, 0, 4), 0.0, c, pool);
+    check_close(dl * b, c);
+    // solves: A * X == B
+    check_close(b, u * solve(u, b, pool));
+    check_close(b, l * solve(l, b, pool));
+    check_close(b, ds * solve(s, b, pool));
+    check_close(b, dk * solve(k, b));
+    check_close(b, dk.get_transpose() * solve(k.get_transpose(), b));
+    matrix<double, lower_triangular_matrix> f = cholesky(s);
+    check_close(ds, f * matrix<double>(f.get_transpose()));
+    // pivoting inside the band
+    matrix<double, banded_matrix> p(4, 1, 1);
+    p(0, 1) = 1.0;
+    p(1, 0) = 2.0;
+    p(1, 2) = 1.0;
+    p(2, 1) = 3.0;
+    p(2, 3) = 1.0;
+    p(3, 2) = 1.0;
+    check_close(matrix<double>(b.get_submatrix(0, 4, 0, 4)), matrix<double>(p) * solve(p, b.get_submatrix(0, 4, 0, 4)));
+    std::cout << "9x9: triangular, symmetric and banded products and solves ok" << std::endl;
+    std::cout << "**************************" << std::endl;
+}
+
+
+// the text of a matrix, formatted one element at a time by the stream
+template <typename T, typename type>
+std::string element_by_element(const matrix<T, type> &m, std::ios_base::fmtflags flags, int precision) {
+    std::ostringstream os;
+    os.flags(flags);
+    os.precision(precision);
+    for (unsigned int i = 0; i < m.get_rows(); i++) {
+        for (auto e = m.begin(i); e != m.end(i); ++e)
+            os << *e << " ";
+        os << std::endl;
+    }
+    return os.str();
+}
+
+template <typename T, typename type>
+std::string written(const matrix<T, type> &m, std::ios_base::fmtflags flags, int precision, thread_pool &pool) {
+    std::ostringstream os;
+    os.flags(flags);
+    os.precision(precision);
+    write_text(os, m, pool);
+    return os.str();
+}
+
+void test_text_output() {
+    std::cout << std::endl << "TEST TEXT OUTPUT" << std::endl;
+    matrix<double> a(300, 700);
+    matrix<long> b(50, 40);
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            a(i, j) = (double(i) - 150.0) * std::pow(10.0, int(j % 40) - 20) / 7.0;
+    for (unsigned int i = 0; i < b.get_rows(); i++)
+        for (unsigned int j = 0; j < b.get_cols(); j++)
+            b(i, j) = (long(i) - 25) * long(j) * 1234567;
+    a(1, 1) = std::numeric_limits<double>::infinity();
+    a(2, 2) = -0.0;
+    thread_pool serial(1), parallel(3);
+    const std::ios_base::fmtflags dec = std::ios_base::dec;
+    for (thread_pool *pool : {&serial, &parallel}) {
+        assert(written(a, dec, 6, *pool) == element_by_element(a, dec, 6) && "Wrong default notation");
+        assert(written(a, dec, 17, *pool) == element_by_element(a, dec, 17) && "Wrong precision");
+        assert(written(a, dec | std::ios_base::scientific, 3, *pool) == element_by_element(a, dec | std::ios_base::scientific, 3) && "Wrong scientific notation");
+        assert(written(a.get_submatrix(0, 300, 20, 30), dec | std::ios_base::fixed, 4, *pool) ==
+               element_by_element(a.get_submatrix(0, 300, 20, 30), dec | std::ios_base::fixed, 4) && "Wrong fixed notation");
+        assert(written(a.get_transpose(), dec | std::ios_base::uppercase, 6, *pool) ==
+               element_by_element(a.get_transpose(), dec | std::ios_base::uppercase, 6) && "Wrong fallback");
+        assert(written(b, std::ios_base::hex, 6, *pool) == element_by_element(b, std::ios_base::hex, 6) && "Wrong base");
+        assert(written(b.get_diagonal().get_diagonalmatrix() * 2, dec, 6, *pool) ==
+               element_by_element(b.get_diagonal().get_diagonalmatrix() * 2, dec, 6) && "Wrong decorated matrix");
+    }
+    matrix<char> c(2, 2);
+    c(0, 0) = 'a';
+    c(0, 1) = 'b';
+    c(1, 0) = 'c';
+    c(1, 1) = 'd';
+    assert(written(c, dec, 6, serial) == "a b \nc d \n" && "Characters are not numbers");
+    std::cout << "300x700 doubles and 50x40 longs, serial and on 3 threads: ok" << std::endl;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_text_input() {
+    std::cout << std::endl << "TEST TEXT INPUT" << std::endl;
+    const std::string path = "matrix_test_input.txt";
+    {
+        std::ofstream f(path);
+        f << "\n1, 2.5, -3e2\r\n  +4\t5 6;\n\n   \n7 8 9";
+    }
+    thread_pool pool(3);
+    for (thread_pool *p : {&thread_pool::get_default(), &pool}) {
+        matrix<double> a = read_text<double>(path, *p);
+        assert(a.get_rows() == 3 && a.get_cols() == 3 && "Wrong sizes");
+        assert(a(0, 1) == 2.5 && a(0, 2) == -300 && a(1, 0) == 4 && a(1, 2) == 6 && a(2, 2) == 9 && "Wrong elements");
+    }
+    {
+        std::ofstream f(path);
+        f << "1 2 3\n4 5\n";
+    }
+    bool thrown = false;
+    try {
+        read_text<int>(path);
+    }
+    catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown && "Rows of different lengths");
+    // a file of a few chunks, written and read back exactly
+    matrix<double> b(1000, 500);
+    for (unsigned int i = 0; i < b.get_rows(); i++)
+        for (unsigned int j = 0; j < b.get_cols(); j++)
+            b(i, j) = std::sin(i * 0.731 + j * 1.3) * std::pow(10.0, int(j % 9) - 4);
+    {
+        std::ofstream f(path);
+        f.precision(17);
+        write_text(f, b, pool);
+    }
+    matrix<double> c = read_text<double>(path, pool);
+    assert(c.get_rows() == 1000 && c.get_cols() == 500 && "Wrong sizes");
+    for (unsigned int i = 0; i < b.get_rows(); i++)
+        for (unsigned int j = 0; j < b.get_cols(); j++)
+            assert(b(i, j) == c(i, j) && "Elements changed through text");
+    std::remove(path.c_str());
+    std::cout << "1000x500 doubles written and read back on 3 threads: ok" << std::endl;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_binary() {
+    std::cout << std::endl << "TEST BINARY FILES" << std::endl;
+    const std::string path = "matrix_test_binary.bin";
+    matrix<int> a(30, 20);
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            a(i, j) = int(i * 100 + j) - 1000;
+    // contiguous: written at once
+    write_binary(path, a);
+    check_equal(a, read_binary<int>(path));
+    check_equal(a, read_binary<int, column_major>(path));
+    {
+        matrix<int, mapped_matrix> m = map_binary<int>(path);
+        check_equal(a, m);
+        check_equal(matrix<int>(a.get_submatrix(3, 17, 2, 11)), m.get_submatrix(3, 17, 2, 11));
+        check_equal(matrix<int>(a.get_transpose()), m.get_transpose());
+        check_equal(matrix<int>(a.get_diagonal()), m.get_diagonal());
+        // a private mapping changes in memory only; copy on write moves the copy to the heap
+        matrix<int, mapped_matrix> cow(m, copy_on_write);
+        m(0, 0) = 7;
+        assert(m(0, 0) == 7 && cow(0, 0) == a(0, 0) && "Not an independent copy");
+        cow(0, 1) = 8;
+        assert(m(0, 1) == a(0, 1) && cow(0, 1) == 8 && "Not an independent copy");
+    }
+    check_equal(a, read_binary<int>(path));
+    matrix<int, mapped_matrix> zeros(4, 3);
+    check_equal(matrix<int>(4, 3), zeros);
+    // a shared mapping writes the file
+    {
+        matrix<int, mapped_matrix> m = map_binary<int>(path, true);
+        m(29, 19) = 42;
+    }
+    assert(read_binary<int>(path)(29, 19) == 42 && "Not written to the file");
+    // views are written by rows, column major matrices as they are stored
+    write_binary(path, a.get_transpose().get_submatrix(1, 15, 4, 28), 4096);
+    check_equal(matrix<int>(a.get_transpose().get_submatrix(1, 15, 4, 28)), map_binary<int>(path));
+    matrix<int, column_major_matrix> by_columns(a);
+    write_binary(path, by_columns);
+    check_equal(a, map_binary<int, column_major>(path));
+    check_equal(a, read_binary<int>(path));
+    bool thrown = false;
+    try {
+        map_binary<int>(path);
+    }
+    catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown && "Wrong layout");
+    thrown = false;
+    try {
+        read_binary<long>(path);
+    }
+    catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown && "Wrong type");
+    // doubles, from an expression
+    matrix<double> b(100, 60);
+    for (unsigned int i = 0; i < b.get_rows(); i++)
+        for (unsigned int j = 0; j < b.get_cols(); j++)
+            b(i, j) = std::sin(i * 0.731 + j * 1.3);
+    write_binary(path, b + b);
+    matrix<double, mapped_matrix> d = map_binary<double>(path);
+    for (unsigned int i = 0; i < b.get_rows(); i++)
+        for (unsigned int j = 0; j < b.get_cols(); j++)
+            assert(d(i, j) == 2 * b(i, j) && "Elements changed through the file");
+    std::remove(path.c_str());
+    std::cout << "30x20 ints and 100x60 doubles written, read and mapped: ok" << std::endl;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_tiled() {
+    std::cout << std::endl << "TEST TILED MATRICES" << std::endl;
+    const std::string path_a = "matrix_test_a.tiles", path_b = "matrix_test_b.tiles", path_c = "matrix_test_c.tiles";
+    matrix<double> a(45, 38), b(38, 29);
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            a(i, j) = std::sin(i * 0.731 + j * 1.3);
+    for (unsigned int i = 0; i < b.get_rows(); i++)
+        for (unsigned int j = 0; j < b.get_cols(); j++)
+            b(i, j) = std::cos(i * 0.37 - j * 0.9);
+    // tiles of 8 x 6 elements, 4 of them in the cache: most accesses go to the file
+    const std::size_t cache = 4 * 8 * 6 * sizeof(double);
+    {
+        matrix<double, tiled_matrix> ta(path_a, a, 8, 6, cache);
+        assert(ta.get_rows() == 45 && ta.get_cols() == 38 && ta.get_tile_blocks().size() == 6 * 7 && "Wrong tiles");
+        check_close(a, ta);
+        check_close(matrix<double>(a.get_submatrix(5, 40, 3, 30)), ta.get_submatrix(5, 40, 3, 30));
+        check_close(matrix<double>(a.get_transpose()), ta.get_transpose());
+        check_close(matrix<double>(a.get_transpose().get_submatrix(1, 37, 9, 44)),
+                    ta.get_transpose().get_submatrix(1, 37, 9, 44));
+        check_close(matrix<double>(a.get_submatrix(5, 40, 3, 30).get_transpose().get_submatrix(2, 20, 7, 33)),
+                    ta.get_submatrix(5, 40, 3, 30).get_transpose().get_submatrix(2, 20, 7, 33));
+        // writes through views reach the file
+        matrix<double, tiled_matrix> view = ta.get_transpose().get_submatrix(10, 20, 4, 30);
+        view.set(3, 5, 100);
+        a(9, 13) = 100;
+        view.for_each_tile([](unsigned int, unsigned int, const strided_view<double, false> &block) {
+            for (unsigned int i = 0; i < block.rows; ++i)
+                for (unsigned int j = 0; j < block.cols; ++j)
+                    block.at(i, j) += 1;
+        });
+        matrix<double, submatrix<transpose_matrix<basic_matrix>>> expected = a.get_transpose().get_submatrix(10, 20, 4, 30);
+        for (unsigned int i = 0; i < expected.get_rows(); ++i)
+            for (unsigned int j = 0; j < expected.get_cols(); ++j)
+                expected(i, j) += 1;
+    }
+    matrix<double, tiled_matrix> ta = open_tiled<double>(path_a, cache);
+    check_close(a, ta);
+    bool thrown = false;
+    try {
+        open_tiled<float>(path_a);
+    }
+    catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    assert(thrown && "Wrong type");
+    // streaming product and element-wise operations, serial and on 3 threads
+    thread_pool pool(3);
+    for (thread_pool *p : {&thread_pool::get_default(), &pool}) {
+        matrix<double, tiled_matrix> tb(path_b, b, 5, 7, cache);
+        matrix<double, tiled_matrix> tc(path_c, 45, 29, 6, 8, cache);
+        gemm(1.0, ta, tb, 0.0, tc, *p);
+        matrix<double> c = a * b;
+        check_close(c, tc);
+        gemm(2.0, ta, tb, -1.0, tc, *p);
+        check_close(c, tc);
+        // the transposes of the product of the transposes
+        matrix<double, tiled_matrix> tct = tc.get_transpose();
+        gemm(1.0, tb.get_transpose(), ta.get_transpose(), -1.0, tct, *p);
+        check_close(matrix<double>(45, 29), tc);
+        transform_tiles(tc, ta.get_submatrix(0, 45, 0, 29), [](double x) { return 3 * x; }, *p);
+        check_close(matrix<double>(a.get_submatrix(0, 45, 0, 29) * 3), tc);
+        transform_tiles(tc, tc, ta.get_submatrix(0, 45, 9, 38), [](double x, double y) { return x - y; }, *p);
+        check_close(matrix<double>(a.get_submatrix(0, 45, 0, 29) * 3 - a.get_submatrix(0, 45, 9, 38)), tc);
+    }
+    std::remove(path_a.c_str());
+    std::remove(path_b.c_str());
+    std::remove(path_c.c_str());
+    std::cout << "45x38 by 38x29 doubles in tiles through a cache of 4 tiles: ok" << std::endl;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_instrumentation() {
+    std::cout << std::endl << "TEST INSTRUMENTATION" << std::endl;
+    matrix_stats::reset();
+    matrix<int> a(10, 20);
+    matrix<int> b = a;                                       // shares the elements
+    auto t = a.get_transpose().get_submatrix(1, 5, 2, 8);    // two views
+    matrix<int> c(t);                                        // deep copy of 4x6 elements
+    matrix<int> d(a, copy_on_write);
+    d(0, 0) = 1;                                             // copy on write of 200 elements
+    const matrix_stats::counter *counters = matrix_stats::counters;
+    if (matrix_stats::enabled) {
+        assert(counters[matrix_stats::allocations].count == 2 &&
+               counters[matrix_stats::allocations].amount == (200 + 24) * sizeof(int) && "Wrong allocations");
+        assert(counters[matrix_stats::deep_copies].count == 2 &&
+               counters[matrix_stats::deep_copies].amount == 24 + 200 && "Wrong deep copies");
+        assert(counters[matrix_stats::views].count == 2 && "Wrong views");
+        assert(counters[matrix_stats::shares].count >= 3 && "Wrong shares");
+    }
+    else {
+        for (int e = 0; e < matrix_stats::events; ++e)
+            assert(counters[e].count == 0 && "Instrumentation not compiled out");
+    }
+    std::ostringstream json, prometheus;
+    matrix_stats::write_json(json);
+    matrix_stats::write_prometheus(prometheus);
+    assert(json.str().find("\"views\": {\"count\": " + std::to_string(counters[matrix_stats::views].count)) !=
+           std::string::npos && "Wrong JSON");
+    assert(prometheus.str().find("\nmatrix_deep_copies_elements_total " +
+                                 std::to_string(counters[matrix_stats::deep_copies].amount) + "\n") !=
+           std::string::npos && "Wrong Prometheus text");
+    std::cout << (matrix_stats::enabled ? "counters: " : "compiled out: ") << json.str();
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_borrowed_views() {
+    std::cout << std::endl << "TEST BORROWED VIEWS" << std::endl;
+    matrix<int> a(12, 9);
+    for (unsigned int i = 0; i < a.get_rows(); i++)
+        for (unsigned int j = 0; j < a.get_cols(); j++)
+            a(i, j) = int(i * 10 + j);
+    const matrix<int> t(a.get_transpose().get_submatrix(1, 8, 2, 11)), d(a.get_submatrix(2, 9, 1, 8).get_diagonal());
+    matrix_stats::reset();
+    const matrix<int, borrowed_matrix> b = a.borrow();
+    check_equal(a, b);
+    check_equal(t, b.get_transpose().get_submatrix(1, 8, 2, 11));
+    check_equal(d, b.get_submatrix(2, 9, 1, 8).get_diagonal());
+    assert(matrix_stats::counters[matrix_stats::shares].count == 0 && "Borrowed views touched the reference count");
+    // concurrent views of the same elements
+    thread_pool pool(4);
+    std::vector<long long> sums(64, 0);
+    pool.parallel_for(64, [&](unsigned int t) {
+        auto v = b.get_transpose().get_submatrix(t % 8, 9, 0, 12);
+        for (unsigned int j = 0; j < v.get_cols(); j++)
+            sums[t] += v(0, j);
+    });
+    for (unsigned int t = 0; t < 64; t++)
+        assert(sums[t] == 12 * int(t % 8) + 10 * 66 && "Wrong concurrent views");
+    // writes go to the elements of a
+    matrix<int, borrowed_matrix> w = a.borrow();
+    w.get_transpose()(3, 4) = -1;
+    assert(a(4, 3) == -1 && "Not the same elements");
+    // copies on write taken after borrowing do not share the borrowed elements
+    const matrix<int> c(a, copy_on_write);
+    w(0, 0) = 42;
+    assert(c(0, 0) == 0 && a(0, 0) == 42 && "The borrowed elements are shared on write");
+    a(1, 0) = 9;
+    w(2, 0) = 7;
+    assert(w(1, 0) == 9 && a(2, 0) == 7 && c(1, 0) == 10 && c(2, 0) == 20 && "The borrowed matrix left its owner");
+    std::cout << "views of a borrowed 12x9 matrix, also on 4 threads: ok" << std::endl;
+    std::cout << "**************************" << std::endl;
+}
+
+void test_lu() {
+    std::cout << std::endl << "TEST LU" << std::endl;
+    // three panels and a partial one, pivoting on most columns
+    const unsigned int n = 150;
+    matrix<double> a(n, n), b(n, 3), identity(n, n);
+    std::mt19937 random(7);
+    for (unsigned int i = 0; i < n; i++) {
+        identity(i, i) = 1.0;
+        for (unsigned int j = 0; j < n; j++)
+            a(i, j) = double(random() % 2001) / 1000 - 1;
+        for (unsigned int j = 0; j < 3; j++)
+            b(i, j) = double(int(i * 3 + j) % 7) - 3;
+    }
+    thread_pool pool(3);
+    lu_decomposition<double> f = lu(a, pool);
+    const std::vector<unsigned int> &p = f.get_permutation();
+    assert(!f.is_singular() && "Wrong singular matrix");
+    unsigned int moved = 0;
+    for (unsigned int i = 0; i < n; i++)
+        moved += (p[i] != i);
+    assert(moved > 0 && "No pivoting");
+    // P * A = L * U, P applied without moving the rows of a
+    matrix<double, permuted_rows<basic_matrix>> pa = f.permute(a);
+    assert(&pa(5, 0) == &a(p[5], 0) && "The permuted rows are not shared");
+    check_close(matrix<double>(pa), f.get_lower() * matrix<double>(f.get_upper()));
+    check_close(matrix<double>(lu(a, thread_pool::get_default()).get_factors()), f.get_factors());
+    // solve, inverse, also of views
+    check_close(b, a * solve(a, b, pool));
+    check_close(b, a * solve(f, b));
+    check_close(b, a.get_transpose() * solve(a.get_transpose(), b, pool));
+    check_close(identity, a * inverse(a, pool));
+    check_close(identity, inverse(a) * a);
+    matrix<double> s = a.get_submatrix(10, 90, 20, 100);
+    check_close(matrix<double>(b.get_submatrix(0, 80, 0, 3)),
+                s * solve(a.get_submatrix(10, 90, 20, 100), b.get_submatrix(0, 80, 0, 3), pool));
+    // determinants: the fixed size one by cofactors, a product, a singular matrix
+    matrix<double, fixed<5, 5>> g;
+    for (unsigned int i = 0; i < 5; i++)
+        for (unsigned int j = 0; j < 5; j++)
+            g(i, j) = a(i, j);
+    assert(std::abs(determinant(matrix<double>(g)) - determinant(g)) < 1e-12 && "Wrong determinant");
+    matrix<double> a5(a.get_submatrix(0, 5, 0, 5)), a55 = a5 * a5;
+    assert(std::abs(determinant(a55) - determinant(a5) * determinant(a5)) < 1e-12 && "Wrong determinant");
+    matrix<double> z(a, std::allocator<double>());
+    for (unsigned int i = 0; i < n; i++)
+        z(i, 77) = 0.0;
+    assert(lu(z).is_singular() && determinant(z, pool) == 0.0 && "Wrong singular matrix");
+    // a reordering of the rows of any matrix
+    matrix<int> m(4, 3);
+    for (unsigned int i = 0; i < 4; i++)
+        for (unsigned int j = 0; j < 3; j++)
+            m(i, j) = int(i * 10 + j);
+    auto r = permute_rows(m.get_transpose(), {2, 0, 1});
+    r(0, 3) = -1;
+    assert(m(3, 2) == -1 && r(1, 1) == 10 && r(2, 0) == 1 && "Wrong permuted rows");
+    const std::vector<unsigned int> order = {2, 0, 1};
+    for (unsigned int i = 0; i < 3; i++)
+        for (unsigned int j = 0; j < 4; j++)
+            assert(matrix<int>(r)(i, j) == m(j, order[i]) && "Wrong copy of permuted rows");
+    // decorated further: (P * M)^T reorders the columns of M^T, and submatrices of both
+    matrix<int, permuted_rows<basic_matrix>> pm = permute_rows(m, {3, 1, 0, 2});
+    auto pt = pm.get_transpose();
+    pt(2, 0) = -2;
+    assert(pt.get_rows() == 3 && pt.get_cols() == 4 && m(3, 2) == -2 && pt(1, 2) == 1 && "Wrong transpose");
+    auto ps = pt.get_submatrix(1, 3, 1, 3);
+    assert(ps.get_rows() == 2 && ps.get_cols() == 2 && ps(0, 0) == 11 && ps(1, 1) == 2 && "Wrong submatrix");
+    check_equal(matrix<int>(ps.get_transpose()), matrix<int>(pm.get_submatrix(1, 3, 1, 3)));
+    check_equal(matrix<int>(pt.get_transpose()), matrix<int>(pm));
+    std::cout << "LU of a " << n << "x" << n << " matrix on 3 threads, solve, inverse, determinant: ok" << std::endl;
+    std::cout << "**************************" << std::endl;
+}
+
+
+void test_cholesky_qr() {
+    std::cout << std::endl << "TEST CHOLESKY AND QR" << std::endl;
+    const unsigned int n = 150, m = 170;
+    std::mt19937 random(11);
+    matrix<double> g(m, n), spd(n, n), x(n, 2);
+    for (unsigned int i = 0; i < m; i++)
+        for (unsigned int j = 0; j < n; j++)
+            g(i, j) = double(random() % 2001) / 1000 - 1;
+    for (unsigned int i = 0; i < n; i++)
+        for (unsigned int j = 0; j < 2; j++)
+            x(i, j) = double(int(i + 5 * j) % 9) - 4;
+    gemm(1.0, g.get_transpose(), g, 0.0, spd);
+    thread_pool pool(3);
+    // Cholesky: L * L^T == A, L lower triangular
+    matrix<double> l = cholesky(spd, pool);
+    check_close(spd, l * l.get_transpose());
+    for (unsigned int i = 0; i < n; i++)
+        for (unsigned int j = i + 1; j < n; j++)
+            assert(l(i, j) == 0.0 && "L is not lower triangular");
+    check_close(matrix<double>(cholesky(matrix<double, symmetric_matrix>(spd))), l);
+    // in place, on a block of a larger matrix
+    matrix<double> big(n + 30, n + 20);
+    for (unsigned int i = 0; i < big.get_rows(); i++)
+        for (unsigned int j = 0; j < big.get_cols(); j++)
+            big(i, j) = -7.0;
+    auto block = big.get_submatrix(20, n + 20, 10, n + 10);
+    copy_elements(spd, block.get_view());
+    cholesky_in_place(block, pool);
+    check_close(l, block);
+    assert(big(19, 10) == -7.0 && big(20, 9) == -7.0 && big(n + 20, n + 9) == -7.0 && "Factored outside of the block");
+    // QR: Q * R == A, Q^T * Q == I, least squares of a consistent system
+    qr_decomposition<double> f = qr(g, pool);
+    matrix<double> q = f.get_q(pool), r = matrix<double, upper_triangular_matrix>(f.get_r());
+    check_close(g, q * r);
+    matrix<double> identity(n, n);
+    for (unsigned int i = 0; i < n; i++)
+        identity(i, i) = 1.0;
+    check_close(identity, q.get_transpose() * q);
+    check_close(x, solve(f, g * x, pool));
+    // R^T * R == A^T * A, the normal equations
+    check_close(spd, r.get_transpose() * r);
+    // in place, on the transpose of a block of a larger matrix: R is a view of it
+    matrix<double> wide(n + 10, m + 5);
+    auto tall = wide.get_submatrix(10, n + 10, 5, m + 5).get_transpose();
+    copy_elements(g, tall.get_view());
+    qr_decomposition<double, transpose_matrix<submatrix<basic_matrix>>> h = qr_in_place(tall, pool);
+    assert(&h.get_r()(0, 1) == &wide(11, 5) && "R is not a view of the factored matrix");
+    check_close(matrix<double>(f.get_r()), h.get_r());
+    check_close(x, solve(h, g * x));
+    std::cout << "Cholesky of a " << n << "x" << n << " and QR of a " << m << "x" << n
+              << " matrix on 3 threads, also in place in larger matrices: ok" << std::endl;
+    std::cout << "**************************" << std::endl;
+}
+
 
 int main() {
     basic_test_basic_matrix();
@@ -349,4 +1594,28 @@ int main() {
     hard_test_2();
     hard_test_3();
     test_copy_iterators();
+    test_nested_views();
+    test_product();
+    test_parallel_product();
+    test_expressions();
+    test_simd();
+    test_storage();
+    test_fixed();
+    test_layout();
+    test_copy_on_write();
+    test_copy_paths();
+    test_transpose_in_place();
+    test_random_access_iterators();
+    test_segments();
+    test_sparse();
+    test_diagonal_arithmetic();
+    test_packed();
+    test_text_output();
+    test_text_input();
+    test_binary();
+    test_tiled();
+    test_instrumentation();
+    test_borrowed_views();
+    test_lu();
+    test_cholesky_qr();
 }
\ No newline at end of file
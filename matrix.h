@@ -3,31 +3,367 @@
 
 // include the declarations
 #include "matrix_utils.h"
+#include "matrix_storage.h"
+#include "matrix_stats.h"
+#include "strided_view.h"
 
 // from the standard library
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <cassert>
+#include <type_traits>
+#include <algorithm>
+#include <cstring>
+
+
+namespace matrix_detail {
+
+// side of the square tiles used to copy between views stored in opposite orders
+const unsigned int copy_block = 32;
+
+// true iff every row of the view is contiguous
+template <typename T>
+bool rows_contiguous(const strided_view<T, false> &v) {
+    return v.col_stride == 1 || v.cols <= 1;
+}
+
+// true iff every column of the view is contiguous
+template <typename T>
+bool columns_contiguous(const strided_view<T, false> &v) {
+    return v.row_stride == 1 || v.rows <= 1;
+}
+
+// copy n elements between non-overlapping arrays
+template <typename T>
+void copy_run(const T *source, std::size_t n, T *destination) {
+    if constexpr (std::is_trivially_copyable<T>::value)
+        std::memcpy(destination, source, n * sizeof(T));
+    else
+        std::copy_n(source, n, destination);
+}
+
+/**
+ * @brief copy a dense view into another one of the same size, choosing the
+ * fastest path from the strides: whole buffer, rows or columns at a time when
+ * both views are stored in the same order, square tiles (so that both sides
+ * stay in cache) when they are stored in opposite orders, a strided gather for vectors
+ */
+template <typename T>
+void copy_view(const strided_view<T, false> &source, const strided_view<T, false> &destination) {
+    const unsigned int rows = destination.rows, cols = destination.cols;
+    if (rows == 0 || cols == 0)
+        return;
+    if (cols == 1 || rows == 1) {
+        // a vector (e.g. a diagonal): gather with the strides of both sides
+        std::ptrdiff_t ss = (cols == 1) ? source.row_stride : source.col_stride;
+        std::ptrdiff_t ds = (cols == 1) ? destination.row_stride : destination.col_stride;
+        unsigned int n = (cols == 1) ? rows : cols;
+        if (ss == 1 && ds == 1) {
+            copy_run(source.base, n, destination.base);
+            return;
+        }
+        const T *from = source.base;
+        T *to = destination.base;
+        for (unsigned int i = 0; i < n; ++i, from += ss, to += ds)
+            *to = *from;
+        return;
+    }
+    if (rows_contiguous(source) && rows_contiguous(destination)) {
+        if (source.row_stride == std::ptrdiff_t(cols) && destination.row_stride == std::ptrdiff_t(cols))
+            copy_run(source.base, std::size_t(rows) * cols, destination.base);
+        else
+            for (unsigned int r = 0; r < rows; ++r)
+                copy_run(&source.at(r, 0), cols, &destination.at(r, 0));
+        return;
+    }
+    if (columns_contiguous(source) && columns_contiguous(destination)) {
+        copy_view(source.transposed(), destination.transposed());
+        return;
+    }
+    // tiles of copy_block x copy_block, walked in the order of the destination
+    const bool by_rows = rows_contiguous(destination);
+    for (unsigned int rb = 0; rb < rows; rb += copy_block) {
+        unsigned int re = (rows - rb < copy_block) ? rows : rb + copy_block;
+        for (unsigned int cb = 0; cb < cols; cb += copy_block) {
+            unsigned int ce = (cols - cb < copy_block) ? cols : cb + copy_block;
+            if (by_rows) {
+                for (unsigned int r = rb; r < re; ++r)
+                    for (unsigned int c = cb; c < ce; ++c)
+                        destination.at(r, c) = source.at(r, c);
+            }
+            else {
+                for (unsigned int c = cb; c < ce; ++c)
+                    for (unsigned int r = rb; r < re; ++r)
+                        destination.at(r, c) = source.at(r, c);
+            }
+        }
+    }
+}
+
+/**
+ * @brief copy a structured view (a chain containing a diagonalmatrix): fill the
+ * destination with the null element, then scatter the stored elements
+ */
+template <typename T>
+void copy_view(const strided_view<T, true> &source, const strided_view<T, false> &destination) {
+    const long rows = destination.rows, cols = destination.cols;
+    if (!source.on_diagonal) {
+        // no diagonal structure left (e.g. the diagonal of a diagonal matrix)
+        for (long r = 0; r < rows; ++r)
+            for (long c = 0; c < cols; ++c)
+                destination.at(r, c) = source.at(r, c);
+        return;
+    }
+    if (rows_contiguous(destination) && destination.row_stride == cols)
+        std::fill_n(destination.base, std::size_t(rows) * cols, source.null_element);
+    else if (rows_contiguous(destination))
+        for (long r = 0; r < rows; ++r)
+            std::fill_n(&destination.at(r, 0), cols, source.null_element);
+    else
+        for (long c = 0; c < cols; ++c)
+            for (long r = 0; r < rows; ++r)
+                destination.at(r, c) = source.null_element;
+    // the stored elements are on the line r - c == delta
+    long first = (source.delta > 0) ? source.delta : 0;
+    long last = (rows < cols + source.delta) ? rows : cols + source.delta;
+    for (long r = first; r < last; ++r) {
+        long c = r - source.delta;
+        long p = r * source.p_row + c * source.p_col + source.p_offset;
+        if (p >= 0 && p < source.length)
+            destination.at(r, c) = source.base[p * source.stride];
+    }
+}
+
+/**
+ * @brief copy any other view (e.g. an expression), element by element in the
+ * order of the destination
+ */
+template <typename T, typename view>
+void copy_view(const view &source, const strided_view<T, false> &destination) {
+    if (rows_contiguous(destination)) {
+        for (unsigned int r = 0; r < destination.rows; ++r)
+            for (unsigned int c = 0; c < destination.cols; ++c)
+                destination.at(r, c) = source.at(r, c);
+    }
+    else {
+        for (unsigned int c = 0; c < destination.cols; ++c)
+            for (unsigned int r = 0; r < destination.rows; ++r)
+                destination.at(r, c) = source.at(r, c);
+    }
+}
+
+// true iff matrix<T, type> is described by a dense strided view (see strided_view.h),
+// possibly read-only
+template <typename T, typename type, typename = void>
+struct has_dense_view : std::false_type {};
+
+template <typename T, typename type>
+struct has_dense_view<T, type, std::void_t<decltype(std::declval<const matrix<T, type> &>().get_view())>> :
+        std::integral_constant<bool,
+                std::is_same<decltype(std::declval<const matrix<T, type> &>().get_view()), strided_view<T, false>>::value ||
+                std::is_same<decltype(std::declval<const matrix<T, type> &>().get_view()), strided_view<const T, false>>::value> {};
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Copy the elements of a matrix into a (dense, writable) view of the same size.
+ * Used whenever a basic matrix is created from another matrix: the copy goes
+ * through the descriptor of the source (see matrix_detail::copy_view), and more
+ * specific overloads, found through argument dependent lookup, provide faster
+ * paths for some kinds of source (e.g. the vectorized evaluation of simple expressions).
+ * @param source matrix to copy, any decoration
+ * @param destination descriptor of the memory to fill
+ */
+template <typename T, typename type>
+void copy_elements(const matrix<T, type> &source, const strided_view<T, false> &destination) {
+    matrix_detail::copy_view(source.get_view(), destination);
+}
+
+
+/**
+ * @brief Get the elements of a matrix as a list of contiguous runs, e.g. to
+ * process them with vectorized kernels or to write them with a few large copies
+ * @param m a matrix storing its elements (i.e. not an expression), any decoration
+ * @return strided_segments of the elements, in the order of the storage (for
+ * chains containing a diagonalmatrix, the stored elements only), of const T if
+ * the matrix only gives a read-only descriptor (e.g. a const fixed-size matrix)
+ */
+template <typename T, typename type>
+auto get_segments(const matrix<T, type> &m) -> decltype(m.get_view().segments()) {
+    return m.get_view().segments();
+}
 
 
 /**
  * @brief Basic matrix. Contains all the basic operations. Will be decorated later.
- * `basic_matrix` is the default type
+ * `basic_matrix` (i.e. `basic_storage<std::allocator<void>, row_major>`) is the default type
  * @tparam T the type of data contained in the matrix
+ * @tparam allocator allocator of the elements (rebound to T), see matrix_storage.h
+ * @tparam layout row_major or column_major: the iterators along the chosen
+ * direction walk the storage directly, the other ones go through operator()
 */
-template<typename T>
-class matrix<T, basic_matrix> {
+template<typename T, typename allocator, typename layout>
+class matrix<T, basic_storage<allocator, layout>> {
+public:
+    typedef typename std::allocator_traits<allocator>::template rebind_alloc<T> allocator_type;
+
 protected:
+    typedef basic_storage<allocator, layout> storage_type;
+    typedef typename matrix_detail::elements_of<T, allocator_type>::type content_type;
+    static const bool by_column = std::is_same<layout, column_major>::value;
+
+    /**
+       @brief The elements, shared by the alias groups of a matrix and of its
+       copy-on-write copies until they write them
+    */
+    struct content_block {
+        content_type elements;
+        // true once a borrowed matrix, which holds no reference, may refer to the elements
+        std::atomic<bool> borrowed{false};
+
+        explicit content_block(content_type &&e) : elements(std::move(e)) {}
+    };
+
+    /**
+       @brief A matrix with its plain copies and its views, which alias the same
+       elements: when one of them stops sharing the elements with copy-on-write
+       copies (see unshare()), the whole group gets the duplicate
+    */
+    struct alias_group {
+        std::shared_ptr<content_block> content;
+        T *first; // content->elements.data(), for operator()
+
+        explicit alias_group(std::shared_ptr<content_block> &&c) :
+                content(std::move(c)), first(content->elements.data()) {}
+    };
+
     unsigned int n_rows; // height of the matrix
     unsigned int n_cols; // width of the matrix
-    typename std::shared_ptr<std::vector<T>> matrix_content;
+    matrix_stats::shared<alias_group> matrix_content;
+    // true iff the elements may still be shared with copy-on-write copies; set
+    // when a copy on write is taken, so other matrices never check anything
+    bool shared_on_write = false;
+
+    // position of element (r, c) in matrix_content
+    std::size_t index(unsigned int r, unsigned int c) const {
+        return by_column ? std::size_t(c) * n_rows + r : std::size_t(r) * n_cols + c;
+    }
+
+    content_type &elements() {
+        return matrix_content->content->elements;
+    }
+
+    const content_type &elements() const {
+        return matrix_content->content->elements;
+    }
+
+    /**
+       @brief Start an alias group on some elements, allocated with their allocator
+       @param content the elements
+       @return pointer to the new group
+    */
+    static std::shared_ptr<alias_group> make_group(std::shared_ptr<content_block> &&content) {
+        allocator_type alloc = content->elements.get_allocator();
+        return std::allocate_shared<alias_group>(alloc, std::move(content));
+    }
+
+    /**
+       @brief Allocate the elements (and the shared_ptr control blocks) with alloc
+       The vector is moved into place, so that allocators doing uses-allocator
+       construction (e.g. std::pmr) do not receive the allocator twice
+       @param size number of elements
+       @param alloc allocator of the elements
+       @return pointer to the group of the new content
+    */
+    static std::shared_ptr<alias_group> make_content(std::size_t size, const allocator_type &alloc) {
+        matrix_stats::scope stats(matrix_stats::allocations, size * sizeof(T));
+        return make_group(std::allocate_shared<content_block>(alloc, content_type(size, alloc)));
+    }
+
+    /**
+       @brief Copy the elements of a matrix into a new block, shared with nobody
+       @param other matrix whose elements (and allocator) are copied
+       @return pointer to the new content
+    */
+    static std::shared_ptr<content_block> copy_content(const matrix &other) {
+        const content_type &elements = other.elements();
+        matrix_stats::scope stats(matrix_stats::deep_copies, elements.size());
+        allocator_type alloc = elements.get_allocator();
+        return std::allocate_shared<content_block>(alloc, content_type(elements, alloc));
+    }
+
+    /**
+       @brief Make sure that the elements are not shared with a copy-on-write copy,
+       duplicating them for the whole alias group if needed. Called by the non-const
+       member functions only, before anything may write the elements or alias them;
+       matrices never copied on write only test shared_on_write.
+    */
+    void unshare() {
+        if (shared_on_write)
+            unshare_elements();
+    }
+
+    void unshare_elements() {
+        alias_group &group = *matrix_content;
+        if (group.content.use_count() > 1) {
+            group.content = copy_content(*this);
+            group.first = group.content->elements.data();
+        }
+        shared_on_write = false;
+    }
+
+    // true iff the elements are shared with a copy-on-write copy right now
+    bool shares_elements() const {
+        return shared_on_write && matrix_content->content.use_count() > 1;
+    }
+
+    /**
+       @brief Create a view of this matrix from a const member function: a view
+       of a private copy if the elements are shared on write, so that it cannot
+       write the copies (views of const matrices are meant for reading)
+       @param args arguments of the view after the matrix, e.g. the bounds of a submatrix
+    */
+    template <typename view, typename... Args>
+    view make_view(Args... args) const {
+        matrix_stats::record(matrix_stats::views);
+        if (shares_elements())
+            return view(matrix(*this, copy_on_write, false), args...);
+        return view(*this, args...);
+    }
+
+    /**
+       @brief Copy on write, if allowed
+       @param other matrix to be copied
+       @param may_share true iff other can share its elements on write, i.e. it
+       already does or it is not const
+    */
+    matrix(const matrix &other, copy_on_write_t, bool may_share) :
+            n_rows(other.n_rows),
+            n_cols(other.n_cols) {
+        const alias_group &group = *other.matrix_content;
+        if (may_share && other.matrix_content.use_count() == 1 &&
+                !group.content->borrowed.load(std::memory_order_acquire)) {
+            matrix_stats::record(matrix_stats::shares);
+            matrix_content = make_group(std::shared_ptr<content_block>(group.content));
+            shared_on_write = true;
+        }
+        else
+            matrix_content = make_group(copy_content(other));
+    }
 
 
 public:
-    typedef typename std::vector<T>::iterator iterator;
-    typedef typename std::vector<T>::const_iterator const_iterator;
-    typedef column_iterator<T, basic_matrix> col_iterator;
-    typedef const_column_iterator<T, basic_matrix> const_col_iterator;
+    typedef typename std::conditional<by_column, iterator_limited<T, storage_type>,
+                                      typename content_type::iterator>::type iterator;
+    typedef typename std::conditional<by_column, const_iterator_limited<T, storage_type>,
+                                      typename content_type::const_iterator>::type const_iterator;
+    typedef typename std::conditional<by_column, typename content_type::iterator,
+                                      column_iterator<T, storage_type>>::type col_iterator;
+    typedef typename std::conditional<by_column, typename content_type::const_iterator,
+                                      const_column_iterator<T, storage_type>>::type const_col_iterator;
+    typedef strided_view<T, false> view_type;
 
     /**
        @brief Begin iterator for traversing the matrix by column
@@ -35,7 +371,11 @@ public:
     */
     col_iterator column_begin(unsigned int i = 0) {
         assert((i < n_cols) && "Out of bounds!");
-        return col_iterator(*this, 0, i);
+        unshare();
+        if constexpr (by_column)
+            return elements().begin() + std::size_t(i) * n_rows;
+        else
+            return col_iterator(*this, 0, i);
     }
 
     /**
@@ -44,7 +384,11 @@ public:
     */
     col_iterator column_end(unsigned int i) {
         assert((i < n_cols) && "Out of bounds!");
-        return col_iterator(*this, 0, i + 1);
+        unshare();
+        if constexpr (by_column)
+            return elements().begin() + std::size_t(i + 1) * n_rows;
+        else
+            return col_iterator(*this, 0, i + 1);
     }
 
     /**
@@ -52,7 +396,11 @@ public:
     @return col_iterator that points to end of matrix
     */
     col_iterator column_end() {
-        return col_iterator(*this, 0, n_cols);
+        unshare();
+        if constexpr (by_column)
+            return elements().begin() + std::size_t(n_cols) * n_rows;
+        else
+            return col_iterator(*this, 0, n_cols);
     }
 
 
@@ -62,7 +410,10 @@ public:
     */
     const_col_iterator column_begin(unsigned int i = 0) const {
         assert((i < n_cols) && "Out of bounds!");
-        return const_col_iterator(*this, 0, i);
+        if constexpr (by_column)
+            return elements().cbegin() + std::size_t(i) * n_rows;
+        else
+            return const_col_iterator(*this, 0, i);
     }
 
     /**
@@ -71,7 +422,10 @@ public:
     */
     const_col_iterator column_end(unsigned int i) const {
         assert((i < n_cols) && "Out of bounds!");
-        return const_col_iterator(*this, 0, i + 1);
+        if constexpr (by_column)
+            return elements().cbegin() + std::size_t(i + 1) * n_rows;
+        else
+            return const_col_iterator(*this, 0, i + 1);
     }
 
     /**
@@ -79,7 +433,10 @@ public:
         @return const_col_iterator that points to "end of matrix"
     */
     const_col_iterator column_end() const {
-        return const_col_iterator(*this, 0, n_cols);
+        if constexpr (by_column)
+            return elements().cbegin() + std::size_t(n_cols) * n_rows;
+        else
+            return const_col_iterator(*this, 0, n_cols);
     }
 
     /**
@@ -88,7 +445,11 @@ public:
     */
     iterator begin(unsigned int i = 0) {
         assert((i == 0 || i < n_rows) && "Out of bounds!");
-        return matrix_content->begin() + i * n_cols;
+        unshare();
+        if constexpr (by_column)
+            return iterator(*this, i, 0);
+        else
+            return elements().begin() + std::size_t(i) * n_cols;
     }
 
     /**
@@ -96,7 +457,11 @@ public:
        @return iterator pointing to the "end" of last line
     */
     iterator end() {
-        return matrix_content->begin() + n_rows * n_cols;
+        unshare();
+        if constexpr (by_column)
+            return iterator(*this, n_rows, 0);
+        else
+            return elements().begin() + std::size_t(n_rows) * n_cols;
     }
 
     /**
@@ -104,7 +469,11 @@ public:
        @return iterator pointing to the "end" of line i
     */
     iterator end(unsigned int i) {
-        return matrix_content->begin() + (i + 1) * n_cols;
+        unshare();
+        if constexpr (by_column)
+            return iterator(*this, i + 1, 0);
+        else
+            return elements().begin() + std::size_t(i + 1) * n_cols;
     }
 
     /**
@@ -113,7 +482,10 @@ public:
     */
     const_iterator begin(unsigned int i = 0) const {
         assert((i == 0 || i < n_rows) && "Out of bounds!");
-        return matrix_content->begin() + i * n_cols;
+        if constexpr (by_column)
+            return const_iterator(*this, i, 0);
+        else
+            return elements().cbegin() + std::size_t(i) * n_cols;
     }
 
     /**
@@ -121,7 +493,10 @@ public:
        @return const_iterator pointing to the "end" of line i
     */
     const_iterator end() const {
-        return matrix_content->begin() + n_rows * n_cols;
+        if constexpr (by_column)
+            return const_iterator(*this, n_rows, 0);
+        else
+            return elements().cbegin() + std::size_t(n_rows) * n_cols;
     }
 
     /**
@@ -129,54 +504,97 @@ public:
        @return const_iterator pointing to the "end" of line i
     */
     const_iterator end(unsigned int i) const {
-        return matrix_content->begin() + (i + 1) * n_cols;
+        if constexpr (by_column)
+            return const_iterator(*this, i + 1, 0);
+        else
+            return elements().cbegin() + std::size_t(i + 1) * n_cols;
     }
 
     /**
        @brief Default constructor
        Initialize an empty matrix with 0 rows and 0 columns
     */
-    matrix() :
+    matrix() : matrix(allocator_type()) {}
+
+    /**
+       @brief Constructor given the allocator
+       Initialize an empty matrix with 0 rows and 0 columns
+       @param alloc allocator of the elements
+    */
+    explicit matrix(const allocator_type &alloc) :
             n_rows(0),
             n_cols(0),
-            matrix_content(std::make_shared<std::vector<T> >(0)) {}
+            matrix_content(make_content(0, alloc)) {}
 
     /**
        @brief Constructor given the numbers of rows and columns
        Initialize a matrix of `rows` rows and `cols` columns
        @param rows number of rows
        @param cols number of columns
+       @param alloc allocator of the elements (e.g. a std::pmr::memory_resource * for a pmr_matrix)
     */
-    matrix(unsigned int rows, unsigned int cols) :
+    matrix(unsigned int rows, unsigned int cols, const allocator_type &alloc = allocator_type()) :
             n_rows(rows),
             n_cols(cols),
-            matrix_content(std::make_shared<std::vector<T> >(rows * cols)) {}
+            matrix_content(make_content(std::size_t(rows) * cols, alloc)) {}
+
+    /**
+    @brief Copy-on-write copy constructor
+    Create a matrix with the same elements as another one, without copying them
+    yet: both matrices share the elements until one of them writes them or takes
+    a view of them through a non-const member function (operator(), begin(),
+    column_begin(), data(), get_view(), get_transpose(), borrow(), ...), which
+    first duplicates the elements of that matrix and of its plain copies and views.
+    Reads must go through a const matrix to keep the sharing; views taken through
+    a const matrix while it shares its elements are views of a private copy.
+    Whether to share is decided here, once: the elements are copied at once if
+    other has plain copies or views, or has ever lent them to a borrowed matrix
+    (see borrow()). Other is marked as sharing its elements; so it is not const
+    here (a const matrix can only share elements that it already shares on write).
+    Iterators, pointers and references taken from other before the copy must not
+    be used to write after it: they would write both matrices.
+    @param other matrix to be copied
+    */
+    matrix(matrix &other, copy_on_write_t) :
+            matrix(other, copy_on_write, true) {
+        other.shared_on_write = other.shared_on_write || shared_on_write;
+    }
+
+    /**
+    @brief Copy-on-write copy constructor from a const matrix: shares the
+    elements only if other already shares them on write, copies them otherwise
+    @param other matrix to be copied
+    */
+    matrix(const matrix &other, copy_on_write_t) :
+            matrix(other, copy_on_write, other.shared_on_write) {}
 
 
     /**
     @brief Copy constructor
     Create a matrix by deep copy of another one. No sharing of information!
     @param matrix_to_copy matrix to be used to create the new one
+    @param alloc allocator of the elements
     */
     template <typename type>
-    matrix(const matrix<T, type> &matrix_to_copy) {
+    matrix(const matrix<T, type> &matrix_to_copy, const allocator_type &alloc = allocator_type()) {
+        matrix_stats::scope stats(matrix_stats::deep_copies,
+                                  std::uint64_t(matrix_to_copy.get_rows()) * matrix_to_copy.get_cols());
         n_rows = matrix_to_copy.get_rows();
         n_cols = matrix_to_copy.get_cols();
-        matrix_content = std::make_shared<std::vector<T>>(this->n_cols * this->n_rows);
-        for (unsigned int i = 0; i < n_rows; ++i) {
-            auto ii = matrix_to_copy.begin(i);
-            auto ie = matrix_to_copy.end(i);
-            auto i_this = this->begin(i);
-            while (ii != ie) {
-                *i_this = *ii;
-                ++i_this;
-                ++ii;
-            }
-
-        }
+        matrix_content = make_content(std::size_t(this->n_cols) * this->n_rows, alloc);
+        copy_elements(matrix_to_copy, get_view());
     }
 
 
+    /**
+    @brief Plain copy constructor
+    Create a matrix sharing the elements of another one (as views do): writes
+    through either matrix are seen by both, also after a copy on write of either
+    @param other matrix to be copied
+    */
+    matrix(const matrix &other) = default;
+
+
     /**
         Assignment operator
         @param other matrix to copy
@@ -188,6 +606,7 @@ public:
             std::swap(tmp.n_cols, n_cols);
             std::swap(tmp.n_rows, n_rows);
             std::swap(tmp.matrix_content, matrix_content);
+            std::swap(tmp.shared_on_write, shared_on_write);
         }
         return *this;
     }
@@ -198,13 +617,15 @@ public:
        Useful for direct access to element in the matrix.
        r * n_cols --> select correct line of the matrix
        +c --> select the correct cell of the line
+       (c * n_rows + r for a column-major matrix)
        @param r number of row (0-based)
        @param c number of column (0-based)
        @return T& to requested element of the matrix
     */
     T& operator()(unsigned int r, unsigned int c) {
         assert((r < this->get_rows() && c < this->get_cols()) && "Out of bounds!");
-        return matrix_content->operator[](r * n_cols + c);
+        unshare();
+        return matrix_content->first[index(r, c)];
     }
 
     /**
@@ -216,7 +637,7 @@ public:
     */
     const T& operator()(unsigned int r, unsigned int c) const {
         assert((r < this->get_rows() && c < this->get_cols()) && "Out of bounds!");
-        return matrix_content->operator[](r * n_cols + c);
+        return matrix_content->first[index(r, c)];
     }
 
     /**
@@ -237,14 +658,120 @@ public:
         return n_cols;
     }
 
+    /**
+       @brief Get the allocator of the elements
+       @return copy of the allocator used by this matrix
+    */
+    allocator_type get_allocator() const {
+        return elements().get_allocator();
+    }
+
+    /**
+       @brief Get the address of the elements, stored contiguously in the order
+       given by the layout (e.g. to hand them to a Fortran or LAPACK routine)
+       @return pointer to element (0, 0)
+    */
+    T *data() {
+        unshare();
+        return elements().data();
+    }
+
+    /**
+       @brief Get the address of the elements (const)
+       @return const pointer to element (0, 0)
+    */
+    const T *data() const {
+        return elements().data();
+    }
+
+    /**
+       @brief Get the strided descriptor of the matrix, to write its elements
+       @return view_type of the elements, no longer shared with copy-on-write copies
+    */
+    view_type get_view() {
+        unshare();
+        return static_cast<const matrix &>(*this).get_view();
+    }
+
+    /**
+       @brief Get the strided descriptor of the matrix (contiguous, in the order of the layout)
+       @return view_type that the decorations of this matrix start from
+    */
+    view_type get_view() const {
+        if (by_column) {
+            view_type v = {matrix_content->first, 1, n_rows, n_rows, n_cols};
+            return v;
+        }
+        view_type v = {matrix_content->first, n_cols, 1, n_rows, n_cols};
+        return v;
+    }
+
+    /**
+        @brief transpose the matrix in place, without a second buffer
+        Square matrices swap tiles of matrix_detail::copy_block x copy_block elements
+        across the diagonal; rectangular ones follow the cycles of the permutation,
+        each one from its smallest position (found by walking the cycle first), so
+        that no memory is needed to remember what has been moved.
+        No other matrix (copy, view) may share the elements: it would see them
+        moved but keep its own sizes (checked in debug builds; borrowed matrices,
+        which are not counted, are not detected).
+    */
+    void transpose() {
+        unshare();
+        assert(matrix_content.use_count() == 1 && "The elements are shared with other matrices!");
+        T *e = elements().data();
+        if (n_rows == n_cols) {
+            const std::size_t n = n_rows, b = matrix_detail::copy_block;
+            for (std::size_t ib = 0; ib < n; ib += b) {
+                std::size_t ie = (n - ib < b) ? n : ib + b;
+                for (std::size_t jb = ib; jb < n; jb += b) {
+                    std::size_t je = (n - jb < b) ? n : jb + b;
+                    for (std::size_t i = ib; i < ie; ++i)
+                        for (std::size_t j = (jb == ib) ? i + 1 : jb; j < je; ++j)
+                            std::swap(e[i * n + j], e[j * n + i]);
+                }
+            }
+            return;
+        }
+        // position k = outer * inner + k % inner moves to (k % inner) * outer + k / inner
+        const std::size_t size = std::size_t(n_rows) * n_cols;
+        const std::size_t inner = by_column ? n_rows : n_cols;
+        const std::size_t outer = by_column ? n_cols : n_rows;
+        auto next = [=](std::size_t k) { return (k % inner) * outer + k / inner; };
+        // the first and the last element never move
+        for (std::size_t start = 1; start + 1 < size; ++start) {
+            std::size_t k = next(start);
+            while (k > start)
+                k = next(k);
+            if (k < start)
+                continue; // the cycle was moved from a smaller position
+            T carried = std::move(e[start]);
+            k = start;
+            do {
+                k = next(k);
+                std::swap(carried, e[k]);
+            } while (k != start);
+        }
+        std::swap(n_rows, n_cols);
+    }
+
     /**
         @brief create the transpose of the current matrix
         Needs a constructor that, given a basic matrix, creates a transpose_matrix from it
         @return trasposed matrix
     */
-    matrix<T, transpose_matrix<basic_matrix>> get_transpose() const {
-        // RVO
-        return matrix<T, transpose_matrix<basic_matrix>>(*this);
+    matrix<T, transpose_matrix<storage_type>> get_transpose() const {
+        return make_view<matrix<T, transpose_matrix<storage_type>>>();
+    }
+
+    /**
+        @brief create the transpose of the current matrix, to write its elements
+        @return trasposed matrix, whose elements are not shared with copy-on-write copies
+    */
+    matrix<T, transpose_matrix<storage_type>> get_transpose() {
+        // views alias the elements: they must not be shared with copies anymore
+        unshare();
+        return static_cast<const matrix &>(*this).get_transpose();
     }
 
     /**
@@ -255,11 +782,322 @@ public:
      * @param end_column column to end to (EXCLUDED)
      * @return required submatrix
      */
-    matrix<T, submatrix<basic_matrix>> get_submatrix (
+    matrix<T, submatrix<storage_type>> get_submatrix (
             unsigned int begin_row, unsigned int end_row,
             unsigned int begin_column, unsigned int end_column) const {
-        // RVO
-        return matrix<T, submatrix<basic_matrix>>
+        return make_view<matrix<T, submatrix<storage_type>>>(begin_row, end_row, begin_column, end_column);
+    }
+
+    /**
+     * @brief get a submatrix of the current matrix, to write its elements
+     * (not shared with copy-on-write copies)
+     */
+    matrix<T, submatrix<storage_type>> get_submatrix (
+            unsigned int begin_row, unsigned int end_row,
+            unsigned int begin_column, unsigned int end_column) {
+        unshare();
+        return static_cast<const matrix &>(*this).get_submatrix(begin_row, end_row, begin_column, end_column);
+    }
+
+    /**
+     * @brief get a vector containing the diagonal elements of this matrix
+     * @return diagonal a vector containing the diagonal elements of this matrix
+     */
+    matrix<T, diagonal<storage_type>> get_diagonal() const {
+        return make_view<matrix<T, diagonal<storage_type>>>();
+    }
+
+    /**
+     * @brief get the diagonal of this matrix, to write its elements
+     * (not shared with copy-on-write copies)
+     */
+    matrix<T, diagonal<storage_type>> get_diagonal() {
+        unshare();
+        return static_cast<const matrix &>(*this).get_diagonal();
+    }
+
+    /**
+     * @brief get a diagonal matrix from this matrix (iff it is a vector)
+     * @return diagonalmatrix whose diagonal elements are those of this vector
+     */
+    const matrix<T, diagonalmatrix<storage_type>> get_diagonalmatrix() const {
+        return make_view<matrix<T, diagonalmatrix<storage_type>>>();
+    }
+
+    /**
+     * @brief get a diagonal matrix from this matrix (iff it is a vector),
+     * whose elements are not shared with copy-on-write copies
+     */
+    const matrix<T, diagonalmatrix<storage_type>> get_diagonalmatrix() {
+        unshare();
+        return static_cast<const matrix &>(*this).get_diagonalmatrix();
+    }
+
+    /**
+     * @brief get a matrix referring to the elements of this one without owning
+     * them: it and its views (get_transpose(), ...) never touch the reference count
+     * of the elements, so they are cheap to create from many threads at once.
+     * Since nothing counts them, the elements are marked as borrowed for good:
+     * copy-on-write copies taken afterwards duplicate them at once. Elements
+     * shared on write can only be borrowed from a non-const matrix (checked in
+     * debug builds), which duplicates them first.
+     * @return borrowed matrix, valid as long as this matrix keeps its elements
+     * (checked in debug builds)
+     */
+    matrix<T, borrowed_matrix> borrow() const {
+        assert(!shares_elements() && "Elements shared on write are borrowed from a non-const matrix!");
+        matrix_stats::record(matrix_stats::views);
+        std::atomic<bool> &borrowed = matrix_content->content->borrowed;
+        if (!borrowed.load(std::memory_order_relaxed))
+            borrowed.store(true, std::memory_order_release);
+        return matrix<T, borrowed_matrix>(get_view(), matrix_content->content);
+    }
+
+    /**
+     * @brief get a borrowed matrix referring to the elements of this one, to
+     * write them (not shared with copy-on-write copies)
+     */
+    matrix<T, borrowed_matrix> borrow() {
+        unshare();
+        return static_cast<const matrix &>(*this).borrow();
+    }
+};
+
+
+/**
+ * @brief Matrix referring to elements owned by another matrix (e.g. the inline
+ * elements of a fixed-size matrix) through a dense strided descriptor.
+ * Copying it copies the reference, never the elements: it must not outlive them.
+ * Unlike the views of a basic matrix, neither it nor its views touch the reference
+ * count of the elements, so threads can create them concurrently without contention.
+ * In debug builds (NDEBUG not defined), a matrix borrowed from a basic matrix keeps
+ * a weak reference to the elements and asserts that they are alive when it is
+ * accessed or decorated.
+ * @tparam T the type of data contained in the matrix
+*/
+template<typename T>
+class matrix<T, borrowed_matrix> {
+public:
+    typedef iterator_limited<T, borrowed_matrix> iterator;
+    typedef const_iterator_limited<T, borrowed_matrix> const_iterator;
+    typedef column_iterator<T, borrowed_matrix> col_iterator;
+    typedef const_column_iterator<T, borrowed_matrix> const_col_iterator;
+    typedef strided_view<T, false> view_type;
+
+protected:
+    typedef borrowed_matrix storage_type;
+
+    view_type descriptor; // where the borrowed elements are
+#ifndef NDEBUG
+    std::weak_ptr<const void> owner; // the borrowed elements, if owned through a shared_ptr
+    bool owned = false;
+#endif
+
+    // debug builds: the borrowed elements must still exist
+    void check_owner() const {
+#ifndef NDEBUG
+        assert((!owned || !owner.expired()) && "The borrowed elements have been destroyed!");
+#endif
+    }
+
+public:
+    /**
+       @brief Constructor given the elements to refer to
+       @param v descriptor of the borrowed elements
+    */
+    explicit matrix(const view_type &v) :
+            descriptor(v) {}
+
+    /**
+       @brief Constructor given the elements to refer to and their owner,
+       checked in debug builds only (see borrow() of basic matrices)
+       @param v descriptor of the borrowed elements
+       @param o pointer owning the elements
+    */
+    template <typename content>
+    matrix(const view_type &v, const std::shared_ptr<content> &o) :
+            descriptor(v) {
+#ifndef NDEBUG
+        owner = o;
+        owned = true;
+#else
+        (void)o;
+#endif
+    }
+
+    /**
+       @brief Operator()
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return T& to requested element of the matrix
+    */
+    T& operator()(unsigned int r, unsigned int c) {
+        assert((r < this->get_rows() && c < this->get_cols()) && "Out of bounds!");
+        check_owner();
+        return descriptor.at(r, c);
+    }
+
+    /**
+       @brief Operator() const
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return const T& to requested element of the matrix
+    */
+    const T& operator()(unsigned int r, unsigned int c) const {
+        assert((r < this->get_rows() && c < this->get_cols()) && "Out of bounds!");
+        check_owner();
+        return descriptor.at(r, c);
+    }
+
+    /**
+       @brief Get number of rows
+       @return unsigned int corresponding to number of rows
+    */
+    unsigned int get_rows() const {
+        return descriptor.rows;
+    }
+
+    /**
+       @brief Get number of columns
+       @return unsigned int corresponding to number of columns
+    */
+    unsigned int get_cols() const {
+        return descriptor.cols;
+    }
+
+    /**
+       @brief Get the strided descriptor of the matrix
+       @return view_type mapping (r, c) to the borrowed elements
+    */
+    view_type get_view() const {
+        check_owner();
+        return descriptor;
+    }
+
+    /**
+       @brief Begin iterator for traversing the matrix by row
+       @return iterator starting from the first element of row i
+    */
+    iterator begin(unsigned int i = 0) {
+        check_owner();
+        return iterator(*this, i, 0);
+    }
+
+    /**
+       @brief End iterator for traversing the matrix by row
+       @return iterator pointing to the end of the matrix
+    */
+    iterator end() {
+        return iterator(*this, this->get_rows(), 0);
+    }
+
+    /**
+       @brief End iterator for traversing the matrix by row
+       @return iterator pointing to the end of row i
+    */
+    iterator end(unsigned int i) {
+        return iterator(*this, i + 1, 0);
+    }
+
+    /**
+       @brief Begin const_iterator for traversing the matrix by row
+       @return const_iterator starting from the first element of row i
+    */
+    const_iterator begin(unsigned int i = 0) const {
+        check_owner();
+        return const_iterator(*this, i, 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of the matrix
+    */
+    const_iterator end() const {
+        return const_iterator(*this, this->get_rows(), 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of row i
+    */
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    /**
+       @brief Begin col_iterator for traversing the matrix by column
+       @return col_iterator starting from (0, i)
+    */
+    col_iterator column_begin(unsigned int i = 0) {
+        check_owner();
+        return col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End col_iterator for traversing the matrix by column
+       @return col_iterator that points to (0, i + 1) "end of column"
+    */
+    col_iterator column_end(unsigned int i) {
+        return col_iterator(*this, 0, i + 1);
+    }
+
+    /**
+       @brief End col_iterator for traversing the matrix by column
+       @return col_iterator that points to "end of matrix"
+    */
+    col_iterator column_end() {
+        return col_iterator(*this, 0, this->get_cols());
+    }
+
+    /**
+       @brief Begin const_col_iterator for traversing the matrix by column
+       @return const_col_iterator starting from (0, i)
+    */
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        check_owner();
+        return const_col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to (0, i + 1) "end of column"
+    */
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to "end of matrix"
+    */
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, this->get_cols());
+    }
+
+    /**
+        @brief create the transpose of the current matrix
+        @return trasposed matrix
+    */
+    matrix<T, transpose_matrix<storage_type>> get_transpose() const {
+        matrix_stats::record(matrix_stats::views);
+        check_owner();
+        return matrix<T, transpose_matrix<storage_type>>(*this);
+    }
+
+    /**
+     * @brief get a submatrix of the current matrix
+     * @param begin_row row to begin from
+     * @param end_row row to end to (EXCLUDED)
+     * @param begin_column column to begin from
+     * @param end_column column to end to (EXCLUDED)
+     * @return required submatrix
+     */
+    matrix<T, submatrix<storage_type>> get_submatrix (
+            unsigned int begin_row, unsigned int end_row,
+            unsigned int begin_column, unsigned int end_column) const {
+        matrix_stats::record(matrix_stats::views);
+        check_owner();
+        return matrix<T, submatrix<storage_type>>
                 (*this, begin_row, end_row, begin_column, end_column);
     }
 
@@ -267,18 +1105,20 @@ public:
      * @brief get a vector containing the diagonal elements of this matrix
      * @return diagonal a vector containing the diagonal elements of this matrix
      */
-    matrix<T, diagonal<basic_matrix>> get_diagonal() const {
-        // RVO
-        return matrix<T, diagonal<basic_matrix>>(*this);
+    matrix<T, diagonal<storage_type>> get_diagonal() const {
+        matrix_stats::record(matrix_stats::views);
+        check_owner();
+        return matrix<T, diagonal<storage_type>>(*this);
     }
 
     /**
      * @brief get a diagonal matrix from this matrix (iff it is a vector)
      * @return diagonalmatrix whose diagonal elements are those of this vector
      */
-    const matrix<T, diagonalmatrix<basic_matrix>> get_diagonalmatrix() const {
-        // RVO
-        return matrix<T, diagonalmatrix<basic_matrix>>(*this);
+    const matrix<T, diagonalmatrix<storage_type>> get_diagonalmatrix() const {
+        matrix_stats::record(matrix_stats::views);
+        check_owner();
+        return matrix<T, diagonalmatrix<storage_type>>(*this);
     }
 };
 
@@ -290,6 +1130,11 @@ public:
  */
 template<typename T, typename decorator_matrix>
 class matrix<T, transpose_matrix<decorator_matrix>> : protected matrix<T, decorator_matrix> {
+public:
+    typedef strided_view<T, is_structured<transpose_matrix<decorator_matrix>>::value> view_type;
+
+protected:
+    view_type descriptor; // flattened access map, computed once from the decorated matrix
 
 public:
     friend class matrix<T, decorator_matrix>;
@@ -304,7 +1149,8 @@ public:
        @param other matrix to be used to create the new one
    */
     matrix(const matrix<T, decorator_matrix> &other) :
-            matrix<T, decorator_matrix>(other) {}
+            matrix<T, decorator_matrix>(other),
+            descriptor(other.get_view().transposed()) {}
 
     /**
      * @brief operator()
@@ -314,7 +1160,7 @@ public:
      */
     T& operator()(unsigned int r, unsigned int c) {
         assert((r < this->get_rows() && c < this->get_cols()) && "Out of bounds!");
-        return matrix<T, decorator_matrix>::operator()(c, r);
+        return descriptor.at(r, c);
     }
 
     /**
@@ -325,7 +1171,7 @@ public:
      */
     const T& operator()(unsigned int r, unsigned int c) const {
         assert((r < this->get_rows() && c < this->get_cols()) && "Out of bounds!");
-        return matrix<T, decorator_matrix>::operator()(c, r);
+        return descriptor.at(r, c);
     }
 
     /**
@@ -441,7 +1287,7 @@ public:
        @return unsigned int corresponding to number of rows
     */
     unsigned int get_rows() const {
-        return matrix<T, decorator_matrix>::get_cols();
+        return descriptor.rows;
     }
 
     /**
@@ -450,7 +1296,15 @@ public:
        @return unsigned int corresponding to number of columns
     */
     unsigned int get_cols() const {
-        return matrix<T, decorator_matrix>::get_rows();
+        return descriptor.cols;
+    }
+
+    /**
+       @brief Get the strided descriptor of the matrix
+       @return view_type mapping (r, c) directly to the shared storage
+    */
+    view_type get_view() const {
+        return descriptor;
     }
 
     /**
@@ -458,7 +1312,10 @@ public:
      * @return transpose of the transpose (i.e. the original matrix)
      */
     matrix<T, decorator_matrix> get_transpose() const {
-        return *this;
+        matrix_stats::record(matrix_stats::views);
+        // not `return *this`: for a basic matrix, that would pick the converting
+        // (deep copy) constructor, copying this transpose instead of sharing the original
+        return static_cast<const matrix<T, decorator_matrix> &>(*this);
     }
 
     /**
@@ -472,6 +1329,7 @@ public:
     matrix<T, submatrix<transpose_matrix<decorator_matrix>>> get_submatrix
         (unsigned int begin_row, unsigned int end_row,
          unsigned int begin_column, unsigned int end_column) const {
+            matrix_stats::record(matrix_stats::views);
             // RVO
             return matrix<T, submatrix<transpose_matrix<decorator_matrix>>>
                          (*this, begin_row, end_row, begin_column, end_column);
@@ -482,6 +1340,7 @@ public:
      * @return diagonal a vector containing the diagonal elements of this matrix
      */
     matrix<T, diagonal<transpose_matrix<decorator_matrix>>> get_diagonal() const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
          return matrix<T, diagonal<transpose_matrix<decorator_matrix>>>(*this);
     }
@@ -491,6 +1350,7 @@ public:
      * @return diagonalmatrix whose diagonal elements are those of this vector
      */
     const matrix<T, diagonalmatrix<transpose_matrix<decorator_matrix>>> get_diagonalmatrix() const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
          return matrix<T, diagonalmatrix<transpose_matrix<decorator_matrix>>>(*this);
     }
@@ -506,8 +1366,13 @@ public:
  */
 template<typename T, typename decorator_matrix>
 class matrix<T, submatrix<decorator_matrix>> : protected matrix<T, decorator_matrix> {
+public:
+    typedef strided_view<T, is_structured<submatrix<decorator_matrix>>::value> view_type;
+
 protected:
     unsigned int first_row, last_row, first_col, last_col;
+    view_type descriptor; // flattened access map, computed once from the decorated matrix
+
 public:
     friend class matrix<T, decorator_matrix>;
     typedef iterator_limited<T, submatrix<decorator_matrix>> iterator;
@@ -529,7 +1394,8 @@ public:
            unsigned int fr, unsigned int lr,
            unsigned int fc, unsigned int lc) :
             matrix<T, decorator_matrix>(other), first_row(fr),
-            last_row(lr), first_col(fc), last_col(lc) {
+            last_row(lr), first_col(fc), last_col(lc),
+            descriptor(other.get_view().sub(fr, lr, fc, lc)) {
         assert((lr <= other.get_rows() && lc <= other.get_cols()) && "Out of bound!");
     }
 
@@ -544,6 +1410,7 @@ public:
     matrix<T, submatrix<decorator_matrix>> get_submatrix (
             unsigned int begin_row, unsigned int end_row,
             unsigned int begin_column, unsigned int end_column) const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
         return matrix<T, submatrix<decorator_matrix>>
                 (*this, begin_row + first_row,
@@ -557,6 +1424,7 @@ public:
      * @return required transpose
      */
     matrix<T, transpose_matrix<submatrix<decorator_matrix>>> get_transpose() const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
         return matrix<T, transpose_matrix<submatrix<decorator_matrix>>>(*this);
     }
@@ -566,6 +1434,7 @@ public:
      * @return diagonal a vector containing the diagonal elements of this matrix
      */
     matrix<T, diagonal<submatrix<decorator_matrix>>> get_diagonal() const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
         return matrix<T, diagonal<submatrix<decorator_matrix>>>(*this);
     }
@@ -576,6 +1445,7 @@ public:
      * @return diagonalmatrix whose diagonal elements are those of this vector
      */
     const matrix<T, diagonalmatrix<submatrix<decorator_matrix>>> get_diagonalmatrix() const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
         return matrix<T, diagonalmatrix<submatrix<decorator_matrix>>>(*this);
     }
@@ -589,7 +1459,7 @@ public:
     T& operator()(unsigned int r, unsigned int c) {
         assert((r <= this->get_rows() && r < last_row &&
                 c <= this->get_cols() && c < last_col) && "Out of bounds!");
-        return matrix<T, decorator_matrix>::operator()(r + first_row, c + first_col);
+        return descriptor.at(r, c);
     }
 
     /**
@@ -601,7 +1471,7 @@ public:
     const T& operator()(unsigned int r, unsigned int c) const {
         assert((r <= this->get_rows() && r < last_row &&
                 c <= this->get_cols() && c < last_col) && "Out of bounds!");
-        return matrix<T, decorator_matrix>::operator()(r + first_row, c + first_col);
+        return descriptor.at(r, c);
     }
 
     /**
@@ -715,7 +1585,7 @@ public:
        @return unsigned int corresponding to number of rows
     */
     unsigned int get_rows() const {
-        return last_row - first_row;
+        return descriptor.rows;
     }
 
     /**
@@ -724,7 +1594,15 @@ public:
        @return unsigned int corresponding to number of columns
     */
     unsigned int get_cols() const {
-        return last_col - first_col;
+        return descriptor.cols;
+    }
+
+    /**
+       @brief Get the strided descriptor of the matrix
+       @return view_type mapping (r, c) directly to the shared storage
+    */
+    view_type get_view() const {
+        return descriptor;
     }
 
 };
@@ -732,8 +1610,11 @@ public:
 
 template<typename T, typename decorator_matrix>
 class matrix<T, diagonalmatrix<decorator_matrix>> : protected matrix<T, decorator_matrix> {
+public:
+    typedef strided_view<T, true> view_type;
+
 private:
-    const T null_element;
+    view_type descriptor; // flattened access map, also holds the null element
 
 public:
     friend class matrix<T, decorator_matrix>;
@@ -746,7 +1627,7 @@ public:
         @param other matrix to be used to create the new one
     */
     matrix(const matrix<T, decorator_matrix> &other) :
-            matrix<T, decorator_matrix>(other), null_element(0) {
+            matrix<T, decorator_matrix>(other), descriptor(other.get_view().diagmatrix()) {
         assert((other.get_cols() == 1) && "Invalid matrix!");
     }
 
@@ -756,7 +1637,7 @@ public:
        @return unsigned int corresponding to number of rows
     */
     unsigned int get_rows() const {
-        return matrix<T, decorator_matrix>::get_rows();
+        return descriptor.rows;
     }
 
     /**
@@ -765,7 +1646,15 @@ public:
        @return unsigned int corresponding to number of columns
     */
     unsigned int get_cols() const {
-        return matrix<T, decorator_matrix>::get_rows();
+        return descriptor.cols;
+    }
+
+    /**
+       @brief Get the strided descriptor of the matrix
+       @return view_type describing where the diagonal elements are stored
+    */
+    view_type get_view() const {
+        return descriptor;
     }
 
     /**
@@ -776,9 +1665,8 @@ public:
        @return const T& to requested element of the matrix
     */
     const T &operator()(unsigned int r, unsigned int c) const {
-        if (r != c)
-            return null_element;
-        return matrix<T, decorator_matrix>::operator()(r, 0);
+        assert((r < this->get_rows() && c < this->get_cols()) && "Out of bounds!");
+        return descriptor.at(r, c);
     }
 
 
@@ -795,7 +1683,7 @@ public:
        @return const_iterator pointing to the end of the matrix
     */
     const_iterator end() const {
-        return const_iterator(*this, this->get_rows(), this->get_cols());
+        return const_iterator(*this, this->get_rows(), 0);
     }
 
     /**
@@ -842,6 +1730,7 @@ public:
     matrix<T, submatrix<diagonalmatrix<decorator_matrix>>> get_submatrix
             (unsigned int begin_row, unsigned int end_row,
              unsigned int begin_column, unsigned int end_column) const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
         return matrix<T, submatrix<diagonalmatrix<decorator_matrix>>>
                 (*this, begin_row, end_row, begin_column, end_column);
@@ -852,6 +1741,7 @@ public:
      * @return diagonal a vector containing the diagonal elements of this matrix
      */
     matrix<T, diagonal<diagonalmatrix<decorator_matrix>>> get_diagonal() const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
         return matrix<T, diagonal<diagonalmatrix<decorator_matrix>>>(*this);
     }
@@ -862,6 +1752,7 @@ public:
         @return trasposed matrix
     */
     matrix<T, transpose_matrix<diagonalmatrix<decorator_matrix>>> get_transpose() const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
         return matrix<T, transpose_matrix<diagonalmatrix<decorator_matrix>>>(*this);
     }
@@ -870,6 +1761,11 @@ public:
 
 template<typename T, typename decorator_matrix>
 class matrix<T, diagonal<decorator_matrix>> : protected matrix<T, decorator_matrix> {
+public:
+    typedef strided_view<T, is_structured<diagonal<decorator_matrix>>::value> view_type;
+
+protected:
+    view_type descriptor; // flattened access map, computed once from the decorated matrix
 
 public:
     friend class matrix<T, decorator_matrix>;
@@ -884,7 +1780,7 @@ public:
         @param other matrix to be used to create the new one
     */
     matrix(const matrix<T, decorator_matrix> &other) :
-            matrix<T, decorator_matrix>(other) {
+            matrix<T, decorator_matrix>(other), descriptor(other.get_view().diag()) {
     }
 
     /**
@@ -893,9 +1789,7 @@ public:
        @return unsigned int corresponding to number of rows
     */
     unsigned int get_rows() const {
-        return (matrix<T, decorator_matrix>::get_rows() < matrix<T, decorator_matrix>::get_cols()
-                ? matrix<T, decorator_matrix>::get_rows()
-                : matrix<T, decorator_matrix>::get_cols());
+        return descriptor.rows;
     }
 
     /**
@@ -907,6 +1801,14 @@ public:
         return 1;
     }
 
+    /**
+       @brief Get the strided descriptor of the matrix
+       @return view_type mapping (r, 0) directly to the shared storage
+    */
+    view_type get_view() const {
+        return descriptor;
+    }
+
     /**
        @brief Operator()
        Useful for direct access to element in the matrix
@@ -916,7 +1818,9 @@ public:
     */
     T& operator()(unsigned int r, unsigned int c = 0) {
         assert((c == 0) && "A vector is a 1xn matrix and you are accessing a non-existing column!");
-        return matrix<T, decorator_matrix>::operator()(r, r);
+        assert((r < this->get_rows()) && "Out of bounds!");
+        (void)c; // checked in debug builds only
+        return descriptor.at(r, 0);
     }
 
     /**
@@ -928,7 +1832,9 @@ public:
     */
     const T& operator()(unsigned int r, unsigned int c = 0) const {
         assert((c == 0) && "A vector is a 1xn matrix and you are accessing a non-existing column!");
-        return matrix<T, decorator_matrix>::operator()(r, r);
+        assert((r < this->get_rows()) && "Out of bounds!");
+        (void)c; // checked in debug builds only
+        return descriptor.at(r, 0);
     }
 
     /**
@@ -1034,6 +1940,7 @@ public:
         @return trasposed matrix
     */
     matrix<T, transpose_matrix<diagonal<decorator_matrix>>> get_transpose() const {
+        matrix_stats::record(matrix_stats::views);
         return matrix<T, transpose_matrix<diagonal<decorator_matrix>>>(*this);
     }
 
@@ -1048,6 +1955,7 @@ public:
     matrix<T, submatrix<diagonal<decorator_matrix>>> get_submatrix
             (unsigned int begin_row, unsigned int end_row,
              unsigned int begin_column, unsigned int end_column) const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
         return matrix<T, submatrix<diagonal<decorator_matrix>>>
                 (*this, begin_row, end_row, begin_column, end_column);
@@ -1058,6 +1966,7 @@ public:
      * @return diagonal a vector containing the diagonal elements of this matrix
      */
     matrix<T, diagonal<diagonal<decorator_matrix>>> get_diagonal() const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
         return matrix<T, diagonal<diagonal<decorator_matrix>>>(*this);
     }
@@ -1067,6 +1976,7 @@ public:
      * @return diagonalmatrix whose diagonal elements are those of this vector
      */
     const matrix<T, diagonalmatrix<diagonal<decorator_matrix>>> get_diagonalmatrix() const {
+        matrix_stats::record(matrix_stats::views);
         // RVO
         return matrix<T, diagonalmatrix<diagonal<decorator_matrix>>>(*this);
     }
@@ -1074,4 +1984,15 @@ public:
 };
 
 
-#endif
\ No newline at end of file
+// operations built on top of the matrix types
+#include "matrix_fixed.h"
+#include "matrix_gemm.h"
+#include "matrix_sparse.h"
+#include "matrix_packed.h"
+#include "matrix_expression.h"
+#include "matrix_diagonal.h"
+#include "matrix_simd.h"
+#include "matrix_io.h"
+
+
+#endif
@@ -0,0 +1,392 @@
+#ifndef MATRIX_BINARY_H
+#define MATRIX_BINARY_H
+
+#include "matrix.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MATRIX_HAS_MMAP 1
+#else
+#define MATRIX_HAS_MMAP 0
+#endif
+
+
+/**
+ * Binary files of matrices: a header of 64 bytes followed by the raw elements.
+ *
+ *     offset  size  field
+ *          0     8  magic "MATRIXB\0"
+ *          8     4  version (1)
+ *         12     4  byte order mark (0x01020304 as written by the machine)
+ *         16     4  type of the elements: kind << 8 | size, kind being
+ *                   1 (signed integer), 2 (unsigned integer) or 3 (floating point)
+ *         20     4  layout: 0 (row major), 1 (column major) or 2 (tiled, see matrix_tiled.h)
+ *         24     8  rows
+ *         32     8  columns
+ *         40     8  offset of the first element (a multiple of the alignment)
+ *         48     8  alignment of the elements in the file
+ *         56     4  rows of a tile (tiled files only, 0 otherwise)
+ *         60     4  columns of a tile (tiled files only, 0 otherwise)
+ *
+ * write_binary() saves any matrix; read_binary() loads a file into a new basic
+ * matrix; map_binary() maps the file in memory instead (see mmap(2)), in O(1):
+ * the elements are read from disk when they are first accessed. A mapped
+ * matrix is a basic matrix whose allocator hands out the mapping (see
+ * mapped_allocator), so every view and algorithm works on it unchanged.
+ * Errors (missing file, wrong type or layout, truncated file) throw std::runtime_error.
+ */
+
+
+namespace matrix_detail {
+
+const char binary_magic[8] = {'M', 'A', 'T', 'R', 'I', 'X', 'B', '\0'};
+const std::uint32_t binary_version = 1;
+const std::uint32_t binary_byte_order = 0x01020304;
+const std::size_t binary_header_size = 64;
+
+/**
+ * @brief code of the type of the elements in the header
+ */
+template <typename T>
+constexpr std::uint32_t binary_dtype() {
+    static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                  "Binary files hold numbers only!");
+    return (std::is_floating_point<T>::value ? 3u : std::is_signed<T>::value ? 1u : 2u) << 8 |
+           std::uint32_t(sizeof(T));
+}
+
+/**
+ * @brief Fields of the header of a binary file
+ */
+struct binary_header {
+    std::uint32_t dtype;
+    std::uint32_t layout;   // 0: row major, 1: column major, 2: tiled
+    std::uint64_t rows;
+    std::uint64_t cols;
+    std::uint64_t offset;   // position of the first element
+    std::uint64_t alignment;
+    std::uint32_t tile_rows = 0;
+    std::uint32_t tile_cols = 0;
+
+    void write(std::ostream &out) const {
+        char bytes[binary_header_size] = {};
+        std::memcpy(bytes, binary_magic, 8);
+        std::memcpy(bytes + 8, &binary_version, 4);
+        std::memcpy(bytes + 12, &binary_byte_order, 4);
+        std::memcpy(bytes + 16, &dtype, 4);
+        std::memcpy(bytes + 20, &layout, 4);
+        std::memcpy(bytes + 24, &rows, 8);
+        std::memcpy(bytes + 32, &cols, 8);
+        std::memcpy(bytes + 40, &offset, 8);
+        std::memcpy(bytes + 48, &alignment, 8);
+        std::memcpy(bytes + 56, &tile_rows, 4);
+        std::memcpy(bytes + 60, &tile_cols, 4);
+        out.write(bytes, binary_header_size);
+    }
+
+    static binary_header read(std::istream &in, const std::string &path) {
+        char bytes[binary_header_size];
+        if (!in.read(bytes, binary_header_size) || std::memcmp(bytes, binary_magic, 8) != 0)
+            throw std::runtime_error("binary matrix: " + path + " is not a matrix file");
+        std::uint32_t version, order;
+        std::memcpy(&version, bytes + 8, 4);
+        std::memcpy(&order, bytes + 12, 4);
+        if (version != binary_version || order != binary_byte_order)
+            throw std::runtime_error("binary matrix: unsupported version or byte order in " + path);
+        binary_header h;
+        std::memcpy(&h.dtype, bytes + 16, 4);
+        std::memcpy(&h.layout, bytes + 20, 4);
+        std::memcpy(&h.rows, bytes + 24, 8);
+        std::memcpy(&h.cols, bytes + 32, 8);
+        std::memcpy(&h.offset, bytes + 40, 8);
+        std::memcpy(&h.alignment, bytes + 48, 8);
+        std::memcpy(&h.tile_rows, bytes + 56, 4);
+        std::memcpy(&h.tile_cols, bytes + 60, 4);
+        return h;
+    }
+
+    /**
+     * @brief check that the file holds a matrix of T in the given layout
+     * @param expected layout expected by the caller (0, 1 or 2, see above)
+     * @param file_size size of the file in bytes
+     */
+    template <typename T>
+    void check(std::uint32_t expected, std::uint64_t file_size, const std::string &path) const {
+        if (dtype != binary_dtype<T>())
+            throw std::runtime_error("binary matrix: wrong type of elements in " + path);
+        if (layout != expected)
+            throw std::runtime_error("binary matrix: wrong layout in " + path);
+        if (rows > 0xffffffffu || cols > 0xffffffffu || offset < binary_header_size || file_size < offset ||
+            (layout == 2 && (tile_rows == 0 || tile_cols == 0)))
+            throw std::runtime_error("binary matrix: truncated or invalid file " + path);
+        // tiled files store whole tiles, also on the edges
+        const std::uint64_t elements = (layout != 2) ? rows * cols :
+                (rows + tile_rows - 1) / tile_rows * tile_rows * ((cols + tile_cols - 1) / tile_cols * tile_cols);
+        if ((file_size - offset) / sizeof(T) < elements)
+            throw std::runtime_error("binary matrix: truncated or invalid file " + path);
+    }
+};
+
+/**
+ * @brief A file mapped in memory (or, without mmap, read into memory),
+ * unmapped when the last allocator referring to it goes away
+ */
+struct file_mapping {
+    char *address;
+    std::size_t length;
+    char *data;         // first element
+    std::size_t bytes;  // size of the elements
+    bool claimed;       // already handed out by an allocator
+    bool mapped;
+
+    file_mapping(const std::string &path, std::size_t offset, std::size_t size, bool writable) :
+            address(nullptr), length(0), data(nullptr), bytes(size), claimed(false), mapped(false) {
+#if MATRIX_HAS_MMAP
+        int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("binary matrix: cannot open " + path);
+        length = offset + size;
+        // private mappings are writable too: changes stay in memory
+        void *p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            throw std::runtime_error("binary matrix: cannot map " + path);
+        address = static_cast<char *>(p);
+        mapped = true;
+#else
+        (void)writable;
+        std::ifstream in(path, std::ios::binary);
+        length = offset + size;
+        address = static_cast<char *>(::operator new(length));
+        if (!in.read(address, std::streamsize(length))) {
+            ::operator delete(address);
+            throw std::runtime_error("binary matrix: cannot read " + path);
+        }
+#endif
+        data = address + offset;
+    }
+
+    ~file_mapping() {
+#if MATRIX_HAS_MMAP
+        if (mapped)
+            ::munmap(address, length);
+#else
+        ::operator delete(address);
+#endif
+    }
+
+    file_mapping(const file_mapping &) = delete;
+    file_mapping &operator=(const file_mapping &) = delete;
+};
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Allocator handing out the elements of a mapped file: the first allocation
+ * of exactly those elements returns the mapping, every other one (e.g. the copy
+ * made by copy on write) uses the heap.
+ *
+ * The allocator adopts the elements (see matrix_storage.h): the matrix takes the
+ * mapping as it is, without constructing the elements one by one, so creating
+ * it does not touch the file whatever the optimization level. The elements
+ * allocated on the heap are value initialized (i.e. zeroed) by allocate() instead.
+ * @tparam T type of the allocated elements
+ */
+template <typename T>
+class mapped_allocator {
+public:
+    typedef T value_type;
+    typedef std::true_type adopts_elements;
+
+    template <typename U>
+    struct rebind {
+        typedef mapped_allocator<U> other;
+    };
+
+    std::shared_ptr<matrix_detail::file_mapping> mapping;
+
+    mapped_allocator() noexcept {}
+
+    explicit mapped_allocator(const std::shared_ptr<matrix_detail::file_mapping> &m) noexcept : mapping(m) {}
+
+    template <typename U>
+    mapped_allocator(const mapped_allocator<U> &other) noexcept : mapping(other.mapping) {}
+
+    T *allocate(std::size_t n) {
+        if (mapping && !mapping->claimed && n * sizeof(T) == mapping->bytes) {
+            mapping->claimed = true;
+            return reinterpret_cast<T *>(mapping->data);
+        }
+        T *p = std::allocator<T>().allocate(n);
+        if constexpr (std::is_trivially_default_constructible<T>::value)
+            std::uninitialized_value_construct_n(p, n);
+        return p;
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        if (mapping && reinterpret_cast<char *>(p) == mapping->data && mapping->claimed)
+            return; // unmapped with the mapping
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const mapped_allocator<U> &other) const noexcept {
+        return mapping == other.mapping;
+    }
+
+    template <typename U>
+    bool operator!=(const mapped_allocator<U> &other) const noexcept {
+        return mapping != other.mapping;
+    }
+};
+
+
+// basic matrix whose elements are a file mapped in memory (see map_binary)
+typedef basic_storage<mapped_allocator<void>> mapped_matrix;
+typedef basic_storage<mapped_allocator<void>, column_major> mapped_column_major_matrix;
+
+
+namespace matrix_detail {
+
+inline std::uint64_t file_size(const std::string &path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error("binary matrix: cannot open " + path);
+    return static_cast<std::uint64_t>(in.tellg());
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Save a matrix in a binary file
+ * Elements stored contiguously (e.g. a basic matrix, row or column major) are
+ * written at once, in their order; any other matrix is written by rows.
+ * @param path file name
+ * @param m matrix to be saved, any decoration
+ * @param alignment alignment of the first element in the file (a power of 2,
+ * e.g. 4096 to align it to a page)
+ */
+template <typename T, typename type>
+void write_binary(const std::string &path, const matrix<T, type> &m, std::size_t alignment = 64) {
+    assert((alignment != 0 && (alignment & (alignment - 1)) == 0) && "The alignment must be a power of 2!");
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("binary matrix: cannot create " + path);
+    matrix_detail::binary_header h;
+    h.dtype = matrix_detail::binary_dtype<T>();
+    h.layout = 0;
+    h.rows = m.get_rows();
+    h.cols = m.get_cols();
+    h.alignment = std::max<std::size_t>(alignment, alignof(T));
+    h.offset = (matrix_detail::binary_header_size + h.alignment - 1) / h.alignment * h.alignment;
+    const std::size_t n = std::size_t(h.rows) * h.cols;
+    const T *contiguous = nullptr;
+    if constexpr (matrix_detail::has_dense_view<T, type>::value) {
+        auto s = get_segments(m);
+        if (s.count == 1 && s.step == 1 && s.length == n) {
+            contiguous = s.base;
+            h.layout = s.by_column ? 1 : 0;
+        }
+    }
+    h.write(out);
+    const std::vector<char> padding(h.offset - matrix_detail::binary_header_size, 0);
+    out.write(padding.data(), std::streamsize(padding.size()));
+    if (contiguous) {
+        out.write(reinterpret_cast<const char *>(contiguous), std::streamsize(n * sizeof(T)));
+    }
+    else {
+        std::vector<T> row(m.get_cols());
+        for (unsigned int i = 0; i < m.get_rows(); ++i) {
+            std::copy(m.begin(i), m.end(i), row.begin());
+            out.write(reinterpret_cast<const char *>(row.data()), std::streamsize(row.size() * sizeof(T)));
+        }
+    }
+    if (!out)
+        throw std::runtime_error("binary matrix: cannot write " + path);
+}
+
+/**
+ * @brief Load a binary file into a new basic matrix
+ * A file in the other layout is converted.
+ * @tparam T type of the elements, which must be the one of the file
+ * @tparam layout row_major or column_major
+ * @param path file name
+ * @return a new basic matrix
+ */
+template <typename T, typename layout = row_major>
+matrix<T, basic_storage<std::allocator<void>, layout>> read_binary(const std::string &path) {
+    typedef matrix<T, basic_storage<std::allocator<void>, layout>> result_type;
+    typedef matrix<T, basic_storage<std::allocator<void>, column_major>> by_columns;
+    typedef matrix<T, basic_storage<std::allocator<void>, row_major>> by_rows;
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("binary matrix: cannot open " + path);
+    const matrix_detail::binary_header h = matrix_detail::binary_header::read(in, path);
+    const bool by_column = h.layout == 1;
+    h.check<T>(by_column ? 1 : 0, matrix_detail::file_size(path), path);
+    auto load = [&](auto &&m) {
+        in.seekg(std::streamoff(h.offset));
+        in.read(reinterpret_cast<char *>(m.data()), std::streamsize(h.rows * h.cols * sizeof(T)));
+        if (!in)
+            throw std::runtime_error("binary matrix: cannot read " + path);
+    };
+    if (by_column == std::is_same<layout, column_major>::value) {
+        result_type m(static_cast<unsigned int>(h.rows), static_cast<unsigned int>(h.cols));
+        load(m);
+        return m;
+    }
+    if (by_column) {
+        by_columns m(static_cast<unsigned int>(h.rows), static_cast<unsigned int>(h.cols));
+        load(m);
+        return result_type(m);
+    }
+    by_rows m(static_cast<unsigned int>(h.rows), static_cast<unsigned int>(h.cols));
+    load(m);
+    return result_type(m);
+}
+
+/**
+ * @brief Map a binary file in memory, in O(1): the elements are read from the
+ * file when they are first accessed
+ * @tparam T type of the elements, which must be the one of the file
+ * @tparam layout row_major or column_major, which must be the one of the file
+ * @param path file name
+ * @param writable true to write the changes to the elements back to the file;
+ * otherwise they only change the matrix in memory
+ * @return a basic matrix whose elements are the mapping
+ */
+template <typename T, typename layout = row_major>
+matrix<T, basic_storage<mapped_allocator<void>, layout>> map_binary(const std::string &path, bool writable = false) {
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable elements can be mapped!");
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("binary matrix: cannot open " + path);
+    const matrix_detail::binary_header h = matrix_detail::binary_header::read(in, path);
+    in.close();
+    h.check<T>(std::is_same<layout, column_major>::value ? 1 : 0, matrix_detail::file_size(path), path);
+    const std::size_t bytes = std::size_t(h.rows) * h.cols * sizeof(T);
+    mapped_allocator<T> alloc(std::make_shared<matrix_detail::file_mapping>(path, std::size_t(h.offset), bytes, writable));
+    return matrix<T, basic_storage<mapped_allocator<void>, layout>>(static_cast<unsigned int>(h.rows),
+                                                                    static_cast<unsigned int>(h.cols), alloc);
+}
+
+
+#endif
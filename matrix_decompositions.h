@@ -0,0 +1,1000 @@
+#ifndef MATRIX_DECOMPOSITIONS_H
+#define MATRIX_DECOMPOSITIONS_H
+
+#include "matrix.h"
+#include "matrix_gemm.h"
+#include "matrix_packed.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Factorizations of dense matrices, computed in place on their strided
+ * descriptors by right-looking blocked algorithms: a panel of a few columns is
+ * factored, then the rest of the matrix (the trailing submatrix) is updated by a
+ * product with gemm, which runs on a thread_pool and does most of the work.
+ *
+ * lu(A) returns P * A = L * U with partial pivoting: L (unit diagonal, not stored)
+ * and U in a single basic matrix, and the permutation as a vector of rows. P is
+ * never built: permute(B) returns a matrix<T, permuted_rows<type>>, a decoration
+ * reading row i of P * B from row p[i] of B. solve(), inverse() and determinant()
+ * of any dense matrix use it; the triangular substitutions are blocked too.
+ *
+ * cholesky_in_place(A) and qr_in_place(A) factor a basic matrix or a writable
+ * view of one (e.g. a block of a larger matrix) without copying it; cholesky(A)
+ * and qr(A) factor a copy. A Cholesky factorization leaves L in A; a Householder
+ * QR leaves R above the diagonal and the reflectors below it, and the result
+ * returns R as a submatrix of A. The reflectors of a panel are applied to the
+ * trailing columns at once, in the compact WY form I - V * T * V^T, by two gemm.
+ */
+
+
+/**
+ * @brief Decoration reordering the rows of a matrix: row i is row p[i] of the
+ * decorated one. The matrix is copied, i.e. the decoration shares its elements,
+ * and so is the permutation: no row is ever moved.
+ * get_transpose() and get_submatrix() decorate it further (the transpose reorders
+ * the columns of the transposed matrix, with the same type); there is no
+ * get_diagonal() nor get_diagonalmatrix(), since its elements have no strided
+ * descriptor: copy it into a basic matrix first.
+ * @tparam T the type of data contained in the matrix
+ * @tparam decorator_matrix type of the decorated matrix
+ */
+template <typename T, typename decorator_matrix>
+class matrix<T, permuted_rows<decorator_matrix>> {
+    typedef permuted_rows<decorator_matrix> decoration;
+    typedef std::shared_ptr<const std::vector<unsigned int>> order;
+
+public:
+    typedef iterator_limited<T, decoration> iterator;
+    typedef const_iterator_limited<T, decoration> const_iterator;
+    typedef column_iterator<T, decoration> col_iterator;
+    typedef const_column_iterator<T, decoration> const_col_iterator;
+    typedef typename const_reference_of<T, decoration>::type const_reference;
+
+protected:
+    matrix<T, decorator_matrix> source;
+    order rows;    // row i is row (*rows)[i] of source
+    order columns; // column j is column (*columns)[j] of source, or column j if null
+
+    // column of source read as column c
+    unsigned int column(unsigned int c) const {
+        return columns ? (*columns)[c] : c;
+    }
+
+    // elements [first, last) of p, or first, ..., last - 1 if p is null
+    static order slice(const order &p, unsigned int first, unsigned int last) {
+        std::vector<unsigned int> q(last - first);
+        if (p)
+            std::copy(p->begin() + first, p->begin() + last, q.begin());
+        else
+            std::iota(q.begin(), q.end(), first);
+        return std::make_shared<const std::vector<unsigned int>>(std::move(q));
+    }
+
+    // the transpose of the decorated matrix, and its decoration
+    typedef typename std::decay<decltype(std::declval<const matrix<T, decorator_matrix> &>().get_transpose())>::type
+            transposed_source;
+    typedef typename matrix_detail::decoration_of<transposed_source>::type transposed_decoration;
+
+public:
+    /**
+       @brief Constructor given the matrix and the order of its rows
+       @param m decorated matrix
+       @param p p[i] is the row of m read as row i, for every row of m
+       @param q q[j] is the column of m read as column j (null: all the columns, in order)
+    */
+    matrix(const matrix<T, decorator_matrix> &m, order p, order q = nullptr) :
+            source(m), rows(std::move(p)), columns(std::move(q)) {
+        assert((rows->size() <= source.get_rows() && (!columns || columns->size() <= source.get_cols())) &&
+               "Incompatible sizes!");
+    }
+
+    /**
+       @brief Operator()
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return T& to element (p[r], q[c]) of the decorated matrix
+    */
+    T& operator()(unsigned int r, unsigned int c) {
+        assert((r < this->get_rows() && c < this->get_cols()) && "Out of bounds!");
+        return source((*rows)[r], column(c));
+    }
+
+    /**
+       @brief Operator() const
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return element (p[r], q[c]) of the decorated matrix
+    */
+    const_reference operator()(unsigned int r, unsigned int c) const {
+        assert((r < this->get_rows() && c < this->get_cols()) && "Out of bounds!");
+        return source((*rows)[r], column(c));
+    }
+
+    /**
+       @brief Get the order of the rows
+       @return const reference to p: row i is row p[i] of the decorated matrix
+    */
+    const std::vector<unsigned int> &get_permutation() const {
+        return *rows;
+    }
+
+    /**
+       @brief Get the order of the columns
+       @return pointer to q, column j being column q[j] of the decorated matrix,
+       or null if the columns are those of the decorated matrix
+    */
+    const std::vector<unsigned int> *get_column_order() const {
+        return columns.get();
+    }
+
+    /**
+       @brief Get the decorated matrix
+       @return const reference to the matrix whose rows are reordered
+    */
+    const matrix<T, decorator_matrix> &get_source() const {
+        return source;
+    }
+
+    /**
+     * @brief get the transpose, sharing the elements and the orders: its columns
+     * are the reordered rows of the transpose of the decorated matrix
+     * @return matrix<T, permuted_rows<...>> over the transpose of the decorated matrix
+     */
+    matrix<T, permuted_rows<transposed_decoration>> get_transpose() const {
+        matrix_stats::record(matrix_stats::views);
+        return matrix<T, permuted_rows<transposed_decoration>>(
+                source.get_transpose(), columns ? columns : slice(nullptr, 0, source.get_cols()), rows);
+    }
+
+    /**
+     * @brief get a submatrix of the current matrix, sharing its elements
+     * @param begin_row row to begin from
+     * @param end_row row to end to (EXCLUDED)
+     * @param begin_column column to begin from
+     * @param end_column column to end to (EXCLUDED)
+     * @return required submatrix, reordering the rows of the same decorated matrix
+     */
+    matrix get_submatrix(unsigned int begin_row, unsigned int end_row,
+                         unsigned int begin_column, unsigned int end_column) const {
+        assert((begin_row <= end_row && end_row <= this->get_rows() && begin_column <= end_column &&
+                end_column <= this->get_cols()) && "Out of bounds!");
+        matrix_stats::record(matrix_stats::views);
+        const bool all_columns = !columns && begin_column == 0 && end_column == source.get_cols();
+        return matrix(source, slice(rows, begin_row, end_row),
+                      all_columns ? nullptr : slice(columns, begin_column, end_column));
+    }
+
+    /**
+       @brief Get number of rows
+       @return unsigned int corresponding to number of rows
+    */
+    unsigned int get_rows() const {
+        return static_cast<unsigned int>(rows->size());
+    }
+
+    /**
+       @brief Get number of columns
+       @return unsigned int corresponding to number of columns
+    */
+    unsigned int get_cols() const {
+        return columns ? static_cast<unsigned int>(columns->size()) : source.get_cols();
+    }
+
+    /**
+       @brief Begin iterator for traversing the matrix by row
+       @return iterator starting from the first element of row i
+    */
+    iterator begin(unsigned int i = 0) {
+        return iterator(*this, i, 0);
+    }
+
+    /**
+       @brief End iterator for traversing the matrix by row
+       @return iterator pointing to the end of the matrix
+    */
+    iterator end() {
+        return iterator(*this, this->get_rows(), 0);
+    }
+
+    /**
+       @brief End iterator for traversing the matrix by row
+       @return iterator pointing to the end of row i
+    */
+    iterator end(unsigned int i) {
+        return iterator(*this, i + 1, 0);
+    }
+
+    /**
+       @brief Begin const_iterator for traversing the matrix by row
+       @return const_iterator starting from the first element of row i
+    */
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of the matrix
+    */
+    const_iterator end() const {
+        return const_iterator(*this, this->get_rows(), 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of row i
+    */
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    /**
+       @brief Begin col_iterator for traversing the matrix by column
+       @return col_iterator starting from (0, i)
+    */
+    col_iterator column_begin(unsigned int i = 0) {
+        return col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End col_iterator for traversing the matrix by column
+       @return col_iterator that points to "end of matrix"
+    */
+    col_iterator column_end() {
+        return col_iterator(*this, 0, this->get_cols());
+    }
+
+    /**
+       @brief End col_iterator for traversing the matrix by column
+       @return col_iterator that points to (0, i + 1) "end of column"
+    */
+    col_iterator column_end(unsigned int i) {
+        return col_iterator(*this, 0, i + 1);
+    }
+
+    /**
+       @brief Begin const_col_iterator for traversing the matrix by column
+       @return const_col_iterator starting from (0, i)
+    */
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to "end of matrix"
+    */
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, this->get_cols());
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to (0, i + 1) "end of column"
+    */
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+};
+
+
+/**
+ * @brief Reorder the rows of a matrix without moving them
+ * @param m matrix, any decoration
+ * @param p p[i] is the row of m read as row i
+ * @return matrix<T, permuted_rows<type>> sharing the elements of m
+ */
+template <typename T, typename type>
+matrix<T, permuted_rows<type>> permute_rows(const matrix<T, type> &m, std::vector<unsigned int> p) {
+    return matrix<T, permuted_rows<type>>(m, std::make_shared<const std::vector<unsigned int>>(std::move(p)));
+}
+
+/**
+ * @brief Copy reordered rows: each row of the destination is copied from its row
+ * of the decorated matrix, through their descriptors if it has a dense one and
+ * the columns are not reordered
+ */
+template <typename T, typename type>
+void copy_elements(const matrix<T, permuted_rows<type>> &source, const strided_view<T, false> &destination) {
+    const std::vector<unsigned int> &p = source.get_permutation();
+    if constexpr (matrix_detail::has_dense_view<T, type>::value) {
+        if (!source.get_column_order()) {
+            const strided_view<T, false> from = source.get_source().get_view();
+            for (unsigned int r = 0; r < destination.rows; ++r)
+                matrix_detail::copy_view(from.sub(p[r], p[r] + 1, 0, from.cols),
+                                         destination.sub(r, r + 1, 0, destination.cols));
+            return;
+        }
+    }
+    for (unsigned int r = 0; r < destination.rows; ++r)
+        for (unsigned int c = 0; c < destination.cols; ++c)
+            destination.at(r, c) = source(r, c);
+}
+
+
+namespace matrix_detail {
+
+// columns of the panels of the blocked factorizations, rows of the blocks of the substitutions
+const unsigned int factor_block = 64;
+
+/**
+ * @brief call f(first, last) on the threads of pool for ranges covering [0, n):
+ * a few per thread, but not shorter than grain
+ */
+template <typename function>
+void parallel_ranges(unsigned int n, unsigned int grain, thread_pool &pool, function f) {
+    unsigned int tasks = (n + grain - 1) / grain;
+    if (tasks > 4 * pool.get_threads())
+        tasks = 4 * pool.get_threads();
+    const unsigned int block = (tasks == 0) ? 0 : (n + tasks - 1) / tasks;
+    if (tasks <= 1) {
+        f(0u, n);
+        return;
+    }
+    pool.parallel_for(tasks, [&](unsigned int t) {
+        unsigned int first = std::min(t * block, n);
+        unsigned int last = std::min(first + block, n);
+        if (first < last)
+            f(first, last);
+    });
+}
+
+/**
+ * @brief X = A^-1 * X for the upper or lower triangle of a square view A (the
+ * other elements are not read), by blocks of factor_block rows: substitution
+ * with the diagonal block, the columns of X split among the threads, then the
+ * rows not solved yet are updated by gemm
+ * @param unit take the diagonal of A as ones (e.g. the L of an LU factorization)
+ */
+template <typename T>
+void blocked_triangular_solve(const strided_view<T, false> &a, const strided_view<T, false> &x,
+                              bool upper, bool unit, thread_pool &pool) {
+    assert((a.rows == a.cols && a.rows == x.rows) && "Incompatible sizes!");
+    const unsigned int n = a.rows, blocks = (n + factor_block - 1) / factor_block;
+    for (unsigned int b = 0; b < blocks; ++b) {
+        // forward from the top for a lower A, backward from the bottom for an upper one
+        const unsigned int k = (upper ? blocks - 1 - b : b) * factor_block;
+        const unsigned int e = std::min(n, k + factor_block);
+        parallel_ranges(x.cols, 64, pool, [&](unsigned int first, unsigned int last) {
+            for (unsigned int s = 0; s < e - k; ++s) {
+                const unsigned int i = upper ? e - 1 - s : k + s;
+                const unsigned int l0 = upper ? i + 1 : k, l1 = upper ? e : i;
+                for (unsigned int l = l0; l < l1; ++l) {
+                    const T f = a.at(i, l);
+                    for (unsigned int j = first; j < last; ++j)
+                        x.at(i, j) -= f * x.at(l, j);
+                }
+                if (unit)
+                    continue;
+                assert((a.at(i, i) != T(0)) && "Singular matrix!");
+                for (unsigned int j = first; j < last; ++j)
+                    x.at(i, j) /= a.at(i, i);
+            }
+        });
+        const unsigned int r0 = upper ? 0 : e, r1 = upper ? k : n;
+        if (r0 == r1)
+            continue;
+        matrix<T, borrowed_matrix> ab(a.sub(r0, r1, k, e)), xb(x.sub(k, e, 0, x.cols)), rest(x.sub(r0, r1, 0, x.cols));
+        gemm(T(-1), ab, xb, T(1), rest, pool);
+    }
+}
+
+/**
+ * @brief P * A = L * U in place, right-looking by panels of factor_block columns:
+ * partial pivoting inside the panel (swapping whole rows), U12 = L11^-1 * A12 by
+ * substitution, then A22 -= L21 * U12 by gemm
+ * @param a square view, overwritten by L (below the diagonal) and U (on and above it)
+ * @param rows filled with the permutation: row i of P * A is row rows[i] of A
+ * @return sign of the permutation (1 or -1), or 0 if A is singular
+ */
+template <typename T>
+int lu_factor(const strided_view<T, false> &a, std::vector<unsigned int> &rows, thread_pool &pool) {
+    assert((a.rows == a.cols) && "The matrix must be square!");
+    const unsigned int n = a.rows;
+    rows.resize(n);
+    std::iota(rows.begin(), rows.end(), 0u);
+    int sign = 1;
+    bool singular = false;
+    for (unsigned int k = 0; k < n; k += factor_block) {
+        const unsigned int e = std::min(n, k + factor_block);
+        for (unsigned int j = k; j < e; ++j) {
+            unsigned int p = j;
+            for (unsigned int i = j + 1; i < n; ++i)
+                if (std::abs(a.at(i, j)) > std::abs(a.at(p, j)))
+                    p = i;
+            if (a.at(p, j) == T(0)) {
+                // nothing to eliminate in this column
+                singular = true;
+                continue;
+            }
+            if (p != j) {
+                for (unsigned int c = 0; c < n; ++c)
+                    std::swap(a.at(j, c), a.at(p, c));
+                std::swap(rows[j], rows[p]);
+                sign = -sign;
+            }
+            const T d = a.at(j, j);
+            parallel_ranges(n - j - 1, 256, pool, [&](unsigned int first, unsigned int last) {
+                for (unsigned int i = j + 1 + first; i < j + 1 + last; ++i) {
+                    const T f = (a.at(i, j) /= d);
+                    for (unsigned int c = j + 1; c < e; ++c)
+                        a.at(i, c) -= f * a.at(j, c);
+                }
+            });
+        }
+        if (e == n)
+            break;
+        blocked_triangular_solve(a.sub(k, e, k, e), a.sub(k, e, e, n), false, true, pool);
+        matrix<T, borrowed_matrix> l21(a.sub(e, n, k, e)), u12(a.sub(k, e, e, n)), a22(a.sub(e, n, e, n));
+        gemm(T(-1), l21, u12, T(1), a22, pool);
+    }
+    return singular ? 0 : sign;
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief LU factorization with partial pivoting, P * A = L * U, see lu()
+ * @tparam T the type of data contained in the matrix (floating point)
+ */
+template <typename T>
+class lu_decomposition {
+    static_assert(std::is_floating_point<T>::value, "Factorizations need floating point elements!");
+
+    matrix<T> factors;                                     // L below the diagonal, U on and above it
+    std::shared_ptr<const std::vector<unsigned int>> rows; // row i of P * A is row (*rows)[i] of A
+    int sign;                                              // of the permutation, 0 if A is singular
+
+public:
+    lu_decomposition(const matrix<T> &f, std::shared_ptr<const std::vector<unsigned int>> r, int s) :
+            factors(f), rows(std::move(r)), sign(s) {}
+
+    /**
+       @brief Get L and U in a single matrix
+       @return const reference to a matrix holding L below the diagonal (whose
+       elements, all ones, are not stored) and U on and above it
+    */
+    const matrix<T> &get_factors() const {
+        return factors;
+    }
+
+    /**
+       @brief Get L
+       @return matrix<T, lower_triangular_matrix> holding a copy of L
+    */
+    matrix<T, lower_triangular_matrix> get_lower() const {
+        matrix<T, lower_triangular_matrix> L(factors);
+        for (unsigned int i = 0; i < L.get_rows(); ++i)
+            L(i, i) = T(1);
+        return L;
+    }
+
+    /**
+       @brief Get U
+       @return matrix<T, upper_triangular_matrix> holding a copy of U
+    */
+    matrix<T, upper_triangular_matrix> get_upper() const {
+        return matrix<T, upper_triangular_matrix>(factors);
+    }
+
+    /**
+       @brief Get the permutation P
+       @return const reference to p: row i of P * A is row p[i] of A
+    */
+    const std::vector<unsigned int> &get_permutation() const {
+        return *rows;
+    }
+
+    /**
+       @brief Apply P to a matrix without moving its rows
+       @param B matrix with as many rows as A, any decoration
+       @return matrix<T, permuted_rows<type>> P * B, sharing the elements of B
+    */
+    template <typename type>
+    matrix<T, permuted_rows<type>> permute(const matrix<T, type> &B) const {
+        return matrix<T, permuted_rows<type>>(B, rows);
+    }
+
+    /**
+       @brief Check whether A is singular, i.e. U has zeros on the diagonal
+       @return true if A is singular
+    */
+    bool is_singular() const {
+        return sign == 0;
+    }
+
+    /**
+       @brief Get the determinant of A: the product of the diagonal of U, with
+       the sign of the permutation
+       @return T determinant of A
+    */
+    T determinant() const {
+        T det = T(sign);
+        for (unsigned int i = 0; i < factors.get_rows() && sign != 0; ++i)
+            det *= factors(i, i);
+        return det;
+    }
+};
+
+
+/**
+ * @brief LU factorization with partial pivoting of a copy of A
+ * @param A square matrix, any decoration
+ * @param pool threads updating the trailing submatrices
+ * @return lu_decomposition<T> with P * A = L * U
+ */
+template <typename T, typename type>
+lu_decomposition<T> lu(const matrix<T, type> &A, thread_pool &pool) {
+    assert((A.get_rows() == A.get_cols()) && "The matrix must be square!");
+    matrix<T> factors(A.get_rows(), A.get_cols());
+    copy_elements(A, factors.get_view());
+    std::vector<unsigned int> rows;
+    int sign = matrix_detail::lu_factor(factors.get_view(), rows, pool);
+    return lu_decomposition<T>(factors, std::make_shared<const std::vector<unsigned int>>(std::move(rows)), sign);
+}
+
+/**
+ * @brief LU factorization on the default thread pool
+ */
+template <typename T, typename type>
+lu_decomposition<T> lu(const matrix<T, type> &A) {
+    return lu(A, thread_pool::get_default());
+}
+
+/**
+ * @brief Solve A * X = B given P * A = L * U: X = U^-1 * L^-1 * P * B, by blocked substitutions
+ */
+template <typename T, typename typeB>
+matrix<T> solve(const lu_decomposition<T> &f, const matrix<T, typeB> &B, thread_pool &pool) {
+    assert(!f.is_singular() && "Singular matrix!");
+    matrix<T> X = matrix_detail::right_hand_side(f.permute(B), f.get_factors().get_rows());
+    const strided_view<T, false> a = f.get_factors().get_view();
+    matrix_detail::blocked_triangular_solve(a, X.get_view(), false, true, pool);
+    matrix_detail::blocked_triangular_solve(a, X.get_view(), true, false, pool);
+    return X;
+}
+
+/**
+ * @brief Solve A * X = B given P * A = L * U, on the default thread pool
+ */
+template <typename T, typename typeB>
+matrix<T> solve(const lu_decomposition<T> &f, const matrix<T, typeB> &B) {
+    return solve(f, B, thread_pool::get_default());
+}
+
+/**
+ * @brief Solve A * X = B for a square A without a known structure (the packed
+ * matrices have their own overloads): LU factorization, then substitutions
+ */
+template <typename T, typename typeA, typename typeB>
+matrix<T> solve(const matrix<T, typeA> &A, const matrix<T, typeB> &B, thread_pool &pool) {
+    return solve(lu(A, pool), B, pool);
+}
+
+/**
+ * @brief Inverse of a square matrix: A^-1 solves A * X = I
+ * @return a new basic matrix
+ */
+template <typename T, typename type>
+matrix<T> inverse(const matrix<T, type> &A, thread_pool &pool) {
+    const unsigned int n = A.get_rows();
+    matrix<T> I(n, n);
+    for (unsigned int i = 0; i < n; ++i)
+        I(i, i) = T(1);
+    return solve(lu(A, pool), I, pool);
+}
+
+/**
+ * @brief Inverse of a square matrix on the default thread pool
+ */
+template <typename T, typename type>
+matrix<T> inverse(const matrix<T, type> &A) {
+    return inverse(A, thread_pool::get_default());
+}
+
+/**
+ * @brief Determinant of a square matrix, from its LU factorization
+ * @return T determinant of A, 0 if A is singular
+ */
+template <typename T, typename type>
+T determinant(const matrix<T, type> &A, thread_pool &pool) {
+    return lu(A, pool).determinant();
+}
+
+/**
+ * @brief Determinant of a square matrix on the default thread pool
+ */
+template <typename T, typename type>
+T determinant(const matrix<T, type> &A) {
+    return determinant(A, thread_pool::get_default());
+}
+
+
+namespace matrix_detail {
+
+/**
+ * @brief A = L * L^T in place, right-looking by panels of factor_block columns:
+ * unblocked Cholesky of the diagonal block, L21 = A21 * L11^-T by substitution
+ * (the rows split among the threads), then A22 -= L21 * L21^T by gemm, one block
+ * column at a time so that only the lower triangle is updated
+ * @param a square view: its lower triangle is read and overwritten by L, its
+ * strict upper triangle is set to zero
+ */
+template <typename T>
+void cholesky_factor(const strided_view<T, false> &a, thread_pool &pool) {
+    static_assert(std::is_floating_point<T>::value, "Factorizations need floating point elements!");
+    assert((a.rows == a.cols) && "The matrix must be square!");
+    const unsigned int n = a.rows;
+    for (unsigned int k = 0; k < n; k += factor_block) {
+        const unsigned int e = std::min(n, k + factor_block);
+        for (unsigned int j = k; j < e; ++j) {
+            assert((a.at(j, j) > T(0)) && "The matrix is not positive definite!");
+            const T d = std::sqrt(a.at(j, j));
+            a.at(j, j) = d;
+            for (unsigned int i = j + 1; i < e; ++i)
+                a.at(i, j) /= d;
+            for (unsigned int c = j + 1; c < e; ++c)
+                for (unsigned int i = c; i < e; ++i)
+                    a.at(i, c) -= a.at(i, j) * a.at(c, j);
+        }
+        if (e == n)
+            break;
+        parallel_ranges(n - e, 64, pool, [&](unsigned int first, unsigned int last) {
+            for (unsigned int i = e + first; i < e + last; ++i)
+                for (unsigned int j = k; j < e; ++j) {
+                    T x = a.at(i, j);
+                    for (unsigned int l = k; l < j; ++l)
+                        x -= a.at(i, l) * a.at(j, l);
+                    a.at(i, j) = x / a.at(j, j);
+                }
+        });
+        for (unsigned int c = e; c < n; c += factor_block) {
+            const unsigned int ce = std::min(n, c + factor_block);
+            matrix<T, borrowed_matrix> l21(a.sub(c, n, k, e)), l21t(a.sub(c, ce, k, e).transposed()),
+                    a22(a.sub(c, n, c, ce));
+            gemm(T(-1), l21, l21t, T(1), a22, pool);
+        }
+    }
+    for (unsigned int i = 0; i < n; ++i)
+        for (unsigned int j = i + 1; j < n; ++j)
+            a.at(i, j) = T(0);
+}
+
+/**
+ * @brief Householder QR of the columns [k, e) of a, rows [k, a.rows), unblocked:
+ * column j becomes beta_j on the diagonal and, below it, the vector v_j of the
+ * reflector H_j = I - tau_j * v_j * v_j^T (whose first element, 1, is not stored),
+ * such that H_j zeroes the column below the diagonal; H_j is then applied to the
+ * next columns of the panel
+ */
+template <typename T>
+void householder_panel(const strided_view<T, false> &a, unsigned int k, unsigned int e, T *tau) {
+    const unsigned int m = a.rows;
+    std::vector<T> w(e - k);
+    for (unsigned int j = k; j < e; ++j) {
+        const T alpha = a.at(j, j);
+        T sigma = T(0);
+        for (unsigned int i = j + 1; i < m; ++i)
+            sigma += a.at(i, j) * a.at(i, j);
+        if (sigma == T(0)) {
+            // already zero below the diagonal: H_j = I
+            tau[j - k] = T(0);
+            continue;
+        }
+        const T norm = std::sqrt(alpha * alpha + sigma);
+        const T beta = (alpha > T(0)) ? -norm : norm;
+        tau[j - k] = (beta - alpha) / beta;
+        const T scale = T(1) / (alpha - beta);
+        for (unsigned int i = j + 1; i < m; ++i)
+            a.at(i, j) *= scale;
+        a.at(j, j) = beta;
+        // the next columns c: w_c = v_j^T * a_c, a_c -= tau_j * w_c * v_j, row after row
+        for (unsigned int c = j + 1; c < e; ++c)
+            w[c - k] = a.at(j, c);
+        for (unsigned int i = j + 1; i < m; ++i) {
+            const T v = a.at(i, j);
+            for (unsigned int c = j + 1; c < e; ++c)
+                w[c - k] += v * a.at(i, c);
+        }
+        for (unsigned int c = j + 1; c < e; ++c) {
+            w[c - k] *= tau[j - k];
+            a.at(j, c) -= w[c - k];
+        }
+        for (unsigned int i = j + 1; i < m; ++i) {
+            const T v = a.at(i, j);
+            for (unsigned int c = j + 1; c < e; ++c)
+                a.at(i, c) -= v * w[c - k];
+        }
+    }
+}
+
+/**
+ * @brief The reflectors of the panel [k, e) of a factored matrix in compact WY
+ * form, H_k * ... * H_(e-1) = I - V * T * V^T
+ * @param v filled with V: rows [k, a.rows), unit lower trapezoidal
+ * @param t filled with T: upper triangular, T(j, j) = tau_j and
+ * T(0 : j, j) = -tau_j * T(0 : j, 0 : j) * V(:, 0 : j)^T * v_j
+ */
+template <typename T>
+void reflector_block(const strided_view<T, false> &a, unsigned int k, unsigned int e, const T *tau,
+                     matrix<T> &v, matrix<T> &t, thread_pool &pool) {
+    const unsigned int rows = a.rows - k, nb = e - k;
+    v = matrix<T>(rows, nb);
+    for (unsigned int i = 0; i < rows; ++i)
+        for (unsigned int j = 0; j < nb && j <= i; ++j)
+            v(i, j) = (i == j) ? T(1) : a.at(k + i, k + j);
+    matrix<T> g(nb, nb);
+    gemm(T(1), v.get_transpose(), v, T(0), g, pool);
+    t = matrix<T>(nb, nb);
+    for (unsigned int j = 0; j < nb; ++j) {
+        t(j, j) = tau[j];
+        for (unsigned int l = 0; l < j; ++l) {
+            T x = T(0);
+            for (unsigned int p = l; p < j; ++p)
+                x += t(l, p) * g(p, j);
+            t(l, j) = -tau[j] * x;
+        }
+    }
+}
+
+/**
+ * @brief C = (I - V * T * V^T) * C, or its transpose times C: W = V^T * C and
+ * C -= V * W by gemm, W = T * W (or T^T * W) in place, split by columns
+ */
+template <typename T>
+void apply_reflector_block(const matrix<T> &v, const matrix<T> &t, const strided_view<T, false> &c,
+                           bool transpose, thread_pool &pool) {
+    const unsigned int nb = t.get_rows();
+    matrix<T, borrowed_matrix> cb(c);
+    matrix<T> w(nb, c.cols);
+    gemm(T(1), v.get_transpose(), cb, T(0), w, pool);
+    parallel_ranges(c.cols, 64, pool, [&](unsigned int first, unsigned int last) {
+        // row i of the product needs rows not overwritten yet: downward for T^T, upward for T
+        for (unsigned int s = 0; s < nb; ++s) {
+            const unsigned int i = transpose ? nb - 1 - s : s;
+            const unsigned int l0 = transpose ? 0 : i + 1, l1 = transpose ? i : nb;
+            for (unsigned int j = first; j < last; ++j)
+                w(i, j) *= t(i, i);
+            for (unsigned int l = l0; l < l1; ++l) {
+                const T f = transpose ? t(l, i) : t(i, l);
+                for (unsigned int j = first; j < last; ++j)
+                    w(i, j) += f * w(l, j);
+            }
+        }
+    });
+    gemm(T(-1), v, w, T(1), cb, pool);
+}
+
+/**
+ * @brief Householder QR in place, by panels of factor_block columns: unblocked
+ * factorization of the panel, then the trailing columns are multiplied by the
+ * transpose of its block reflector (see apply_reflector_block)
+ * @param a view with at least as many rows as columns, overwritten by R (on and
+ * above the diagonal) and by the vectors of the reflectors (below it)
+ * @param tau filled with the factors of the reflectors
+ */
+template <typename T>
+void qr_factor(const strided_view<T, false> &a, std::vector<T> &tau, thread_pool &pool) {
+    assert((a.rows >= a.cols) && "The matrix must have at least as many rows as columns!");
+    const unsigned int n = a.cols;
+    tau.assign(n, T(0));
+    matrix<T> v, t;
+    for (unsigned int k = 0; k < n; k += factor_block) {
+        const unsigned int e = std::min(n, k + factor_block);
+        householder_panel(a, k, e, tau.data() + k);
+        if (e == n)
+            break;
+        reflector_block(a, k, e, tau.data() + k, v, t, pool);
+        apply_reflector_block(v, t, a.sub(k, a.rows, e, n), true, pool);
+    }
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Cholesky factorization in place: A = L * L^T
+ * @param A symmetric positive definite matrix, a basic matrix or a writable view
+ * of one (e.g. a submatrix of a larger matrix): its lower triangle is read, and
+ * A is overwritten by L (zero above the diagonal)
+ * @param pool threads updating the trailing submatrices
+ */
+template <typename T, typename type>
+void cholesky_in_place(matrix<T, type> &A, thread_pool &pool) {
+    matrix_detail::cholesky_factor(A.get_view(), pool);
+}
+
+/**
+ * @brief Cholesky factorization in place on the default thread pool
+ */
+template <typename T, typename type>
+void cholesky_in_place(matrix<T, type> &A) {
+    cholesky_in_place(A, thread_pool::get_default());
+}
+
+/**
+ * @brief Cholesky factorization of a copy of A: A = L * L^T
+ * @param A symmetric positive definite matrix, any decoration (only its lower
+ * triangle is read)
+ * @return a new basic matrix holding L
+ */
+template <typename T, typename type>
+matrix<T> cholesky(const matrix<T, type> &A, thread_pool &pool) {
+    matrix<T> L(A.get_rows(), A.get_cols());
+    copy_elements(A, L.get_view());
+    cholesky_in_place(L, pool);
+    return L;
+}
+
+/**
+ * @brief Cholesky factorization of a copy of A on the default thread pool
+ */
+template <typename T, typename type>
+matrix<T> cholesky(const matrix<T, type> &A) {
+    return cholesky(A, thread_pool::get_default());
+}
+
+
+/**
+ * @brief Householder QR factorization, A = Q * R, see qr() and qr_in_place()
+ * @tparam T the type of data contained in the matrix (floating point)
+ * @tparam type decoration of the factored matrix, which holds R and the reflectors
+ */
+template <typename T, typename type = basic_matrix>
+class qr_decomposition {
+    static_assert(std::is_floating_point<T>::value, "Factorizations need floating point elements!");
+
+    matrix<T, type> factors; // R on and above the diagonal, the reflectors below it
+    std::vector<T> tau;
+
+public:
+    qr_decomposition(const matrix<T, type> &f, std::vector<T> t) :
+            factors(f), tau(std::move(t)) {}
+
+    /**
+       @brief Get R and the reflectors
+       @return const reference to the factored matrix, sharing its elements with A
+       if it was factored in place
+    */
+    const matrix<T, type> &get_factors() const {
+        return factors;
+    }
+
+    /**
+       @brief Get R, without copying it
+       @return the square submatrix of the factored matrix whose upper triangle is
+       R (below the diagonal are the reflectors, to be ignored: matrix<T,
+       upper_triangular_matrix>(get_r()) copies R alone)
+    */
+    auto get_r() const {
+        return factors.get_submatrix(0, factors.get_cols(), 0, factors.get_cols());
+    }
+
+    /**
+       @brief Get the factors of the reflectors
+       @return const reference to tau: H_j = I - tau_j * v_j * v_j^T
+    */
+    const std::vector<T> &get_tau() const {
+        return tau;
+    }
+
+    /**
+       @brief Apply Q^T (Q^T * C) or Q (Q * C) to C in place, one block reflector at a time
+       @param c view with as many rows as A
+    */
+    void apply(const strided_view<T, false> &c, bool transpose, thread_pool &pool) const {
+        const strided_view<T, false> a = factors.get_view();
+        assert((c.rows == a.rows) && "Incompatible sizes!");
+        const unsigned int n = a.cols, blocks = (n + matrix_detail::factor_block - 1) / matrix_detail::factor_block;
+        matrix<T> v, t;
+        for (unsigned int b = 0; b < blocks; ++b) {
+            // Q^T = H_(n-1) * ... * H_0 applies H_0 first, Q the last one
+            const unsigned int k = (transpose ? b : blocks - 1 - b) * matrix_detail::factor_block;
+            const unsigned int e = std::min(n, k + matrix_detail::factor_block);
+            matrix_detail::reflector_block(a, k, e, tau.data() + k, v, t, pool);
+            matrix_detail::apply_reflector_block(v, t, c.sub(k, c.rows, 0, c.cols), transpose, pool);
+        }
+    }
+
+    /**
+       @brief Get the first n columns of Q (the "thin" Q, with A = Q * R)
+       @return a new basic matrix with the size of A
+    */
+    matrix<T> get_q(thread_pool &pool) const {
+        matrix<T> q(factors.get_rows(), factors.get_cols());
+        for (unsigned int i = 0; i < q.get_cols(); ++i)
+            q(i, i) = T(1);
+        apply(q.get_view(), false, pool);
+        return q;
+    }
+
+    /**
+       @brief Get the thin Q on the default thread pool
+    */
+    matrix<T> get_q() const {
+        return get_q(thread_pool::get_default());
+    }
+};
+
+
+/**
+ * @brief Householder QR factorization in place
+ * @param A matrix with at least as many rows as columns, a basic matrix or a
+ * writable view of one (e.g. a submatrix of a larger matrix), overwritten by R
+ * and the reflectors
+ * @param pool threads updating the trailing submatrices
+ * @return qr_decomposition sharing the elements of A
+ */
+template <typename T, typename type>
+qr_decomposition<T, type> qr_in_place(matrix<T, type> &A, thread_pool &pool) {
+    std::vector<T> tau;
+    matrix_detail::qr_factor(A.get_view(), tau, pool);
+    return qr_decomposition<T, type>(A, std::move(tau));
+}
+
+/**
+ * @brief Householder QR factorization in place on the default thread pool
+ */
+template <typename T, typename type>
+qr_decomposition<T, type> qr_in_place(matrix<T, type> &A) {
+    return qr_in_place(A, thread_pool::get_default());
+}
+
+/**
+ * @brief Householder QR factorization of a copy of A
+ * @param A matrix with at least as many rows as columns, any decoration
+ * @return qr_decomposition of a new basic matrix
+ */
+template <typename T, typename type>
+qr_decomposition<T> qr(const matrix<T, type> &A, thread_pool &pool) {
+    matrix<T> factors(A.get_rows(), A.get_cols());
+    copy_elements(A, factors.get_view());
+    return qr_in_place(factors, pool);
+}
+
+/**
+ * @brief Householder QR factorization of a copy of A on the default thread pool
+ */
+template <typename T, typename type>
+qr_decomposition<T> qr(const matrix<T, type> &A) {
+    return qr(A, thread_pool::get_default());
+}
+
+/**
+ * @brief Least squares solution of A * X = B given A = Q * R: X = R^-1 * (Q^T * B)
+ * restricted to its first n rows
+ * @return a new basic matrix with as many rows as the columns of A
+ */
+template <typename T, typename type, typename typeB>
+matrix<T> solve(const qr_decomposition<T, type> &f, const matrix<T, typeB> &B, thread_pool &pool) {
+    matrix<T> X = matrix_detail::right_hand_side(B, f.get_factors().get_rows());
+    f.apply(X.get_view(), true, pool);
+    const unsigned int n = f.get_factors().get_cols();
+    const strided_view<T, false> top = X.get_view().sub(0, n, 0, X.get_cols());
+    matrix_detail::blocked_triangular_solve(f.get_factors().get_view().sub(0, n, 0, n), top, true, false, pool);
+    matrix<T> result(n, X.get_cols());
+    matrix_detail::copy_view(top, result.get_view());
+    return result;
+}
+
+/**
+ * @brief Least squares solution given A = Q * R, on the default thread pool
+ */
+template <typename T, typename type, typename typeB>
+matrix<T> solve(const qr_decomposition<T, type> &f, const matrix<T, typeB> &B) {
+    return solve(f, B, thread_pool::get_default());
+}
+
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef MATRIX_DIAGONAL_H
+#define MATRIX_DIAGONAL_H
+
+#include "matrix.h"
+
+#include <cassert>
+
+
+/**
+ * Arithmetic between diagonal matrices, which keeps the result diagonal:
+ * the sum, the difference and the product of two diagonal matrices, their
+ * products and quotients by a scalar, their opposite, inverse and determinant
+ * are all computed on the diagonals only, in O(n), and return a new
+ * matrix<T, diagonalmatrix<basic_matrix>> (which owns its diagonal).
+ *
+ * These overloads are chosen over the lazy expressions of matrix_expression.h
+ * as they are more specialized. Products involving a diagonal matrix and a
+ * dense one are handled by gemm (see matrix_gemm.h), which only visits the
+ * stored elements: a diagonal matrix times a dense one scales its rows.
+ */
+
+
+namespace matrix_detail {
+
+/**
+ * @brief a new diagonal matrix whose i-th element is f(a(i, i))
+ */
+template <typename T, typename decorator_matrix, typename function>
+matrix<T, diagonalmatrix<basic_matrix>> map_diagonal(const matrix<T, diagonalmatrix<decorator_matrix>> &a,
+                                                     function f) {
+    matrix<T> u(a.get_rows(), 1);
+    for (unsigned int i = 0; i < a.get_rows(); ++i)
+        u(i, 0) = f(a(i, i));
+    return u.get_diagonalmatrix();
+}
+
+/**
+ * @brief a new diagonal matrix whose i-th element is f(a(i, i), b(i, i))
+ */
+template <typename T, typename typeL, typename typeR, typename function>
+matrix<T, diagonalmatrix<basic_matrix>> zip_diagonals(const matrix<T, diagonalmatrix<typeL>> &a,
+                                                      const matrix<T, diagonalmatrix<typeR>> &b,
+                                                      function f) {
+    assert((a.get_rows() == b.get_rows()) && "Incompatible sizes!");
+    matrix<T> u(a.get_rows(), 1);
+    for (unsigned int i = 0; i < a.get_rows(); ++i)
+        u(i, 0) = f(a(i, i), b(i, i));
+    return u.get_diagonalmatrix();
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Sum of diagonal matrices
+ * @return a new diagonal matrix containing a + b
+ */
+template <typename T, typename typeL, typename typeR>
+matrix<T, diagonalmatrix<basic_matrix>>
+operator+(const matrix<T, diagonalmatrix<typeL>> &a, const matrix<T, diagonalmatrix<typeR>> &b) {
+    return matrix_detail::zip_diagonals(a, b, [](const T &x, const T &y) { return x + y; });
+}
+
+/**
+ * @brief Difference of diagonal matrices
+ * @return a new diagonal matrix containing a - b
+ */
+template <typename T, typename typeL, typename typeR>
+matrix<T, diagonalmatrix<basic_matrix>>
+operator-(const matrix<T, diagonalmatrix<typeL>> &a, const matrix<T, diagonalmatrix<typeR>> &b) {
+    return matrix_detail::zip_diagonals(a, b, [](const T &x, const T &y) { return x - y; });
+}
+
+/**
+ * @brief Product of diagonal matrices
+ * @return a new diagonal matrix containing a * b
+ */
+template <typename T, typename typeL, typename typeR>
+matrix<T, diagonalmatrix<basic_matrix>>
+operator*(const matrix<T, diagonalmatrix<typeL>> &a, const matrix<T, diagonalmatrix<typeR>> &b) {
+    return matrix_detail::zip_diagonals(a, b, [](const T &x, const T &y) { return x * y; });
+}
+
+/**
+ * @brief Opposite of a diagonal matrix
+ * @return a new diagonal matrix containing -a
+ */
+template <typename T, typename type>
+matrix<T, diagonalmatrix<basic_matrix>> operator-(const matrix<T, diagonalmatrix<type>> &a) {
+    return matrix_detail::map_diagonal(a, [](const T &x) { return -x; });
+}
+
+/**
+ * @brief Product of a diagonal matrix by a scalar
+ * @return a new diagonal matrix containing a * s
+ */
+template <typename T, typename type>
+matrix<T, diagonalmatrix<basic_matrix>>
+operator*(const matrix<T, diagonalmatrix<type>> &a, typename matrix_detail::non_deduced<T>::type s) {
+    return matrix_detail::map_diagonal(a, [&s](const T &x) { return x * s; });
+}
+
+/**
+ * @brief Product of a scalar by a diagonal matrix
+ * @return a new diagonal matrix containing s * a
+ */
+template <typename T, typename type>
+matrix<T, diagonalmatrix<basic_matrix>>
+operator*(typename matrix_detail::non_deduced<T>::type s, const matrix<T, diagonalmatrix<type>> &a) {
+    return matrix_detail::map_diagonal(a, [&s](const T &x) { return s * x; });
+}
+
+/**
+ * @brief Quotient of a diagonal matrix by a scalar
+ * @return a new diagonal matrix containing a / s
+ */
+template <typename T, typename type>
+matrix<T, diagonalmatrix<basic_matrix>>
+operator/(const matrix<T, diagonalmatrix<type>> &a, typename matrix_detail::non_deduced<T>::type s) {
+    return matrix_detail::map_diagonal(a, [&s](const T &x) { return x / s; });
+}
+
+/**
+ * @brief Determinant of a diagonal matrix: the product of its diagonal, in O(n)
+ * @param A diagonal matrix
+ * @return T determinant of A
+ */
+template <typename T, typename type>
+T determinant(const matrix<T, diagonalmatrix<type>> &A) {
+    T det = T(1);
+    for (unsigned int i = 0; i < A.get_rows(); ++i)
+        det *= A(i, i);
+    return det;
+}
+
+/**
+ * @brief Inverse of a diagonal matrix: the reciprocals of its diagonal, in O(n)
+ * @param A diagonal matrix, without zeros on the diagonal
+ * @return a new diagonal matrix containing the inverse of A
+ */
+template <typename T, typename type>
+matrix<T, diagonalmatrix<basic_matrix>> inverse(const matrix<T, diagonalmatrix<type>> &A) {
+    return matrix_detail::map_diagonal(A, [](const T &x) {
+        assert((x != T(0)) && "Singular matrix!");
+        return T(1) / x;
+    });
+}
+
+
+#endif
@@ -0,0 +1,408 @@
+#ifndef MATRIX_EXPRESSION_H
+#define MATRIX_EXPRESSION_H
+
+#include "matrix.h"
+
+#include <cassert>
+
+
+/**
+ * Element-wise arithmetic is lazy, exactly like the decorations: `A + B * 2 - C`
+ * does not compute anything, it builds a tree of expressions whose leaves are
+ * (copies of) the operands, sharing their memory.
+ * Each expression is itself a read-only matrix<T, ...>: its operator() computes the
+ * required element on the fly, walking the tree. Copying the expression into a
+ * basic matrix therefore evaluates the whole tree in a single pass, without
+ * allocating any intermediate result.
+ *
+ * Leaves are read when the expression is evaluated, not when it is built.
+ */
+
+
+/**
+ * Operations that can appear in an expression
+ */
+struct add_op {
+    template <typename T>
+    T operator()(const T &a, const T &b) const {
+        return a + b;
+    }
+};
+
+struct subtract_op {
+    template <typename T>
+    T operator()(const T &a, const T &b) const {
+        return a - b;
+    }
+};
+
+struct negate_op {
+    template <typename T>
+    T operator()(const T &a) const {
+        return -a;
+    }
+};
+
+template <typename T>
+struct scale_op {
+    T factor;
+
+    T operator()(const T &a) const {
+        return a * factor;
+    }
+};
+
+template <typename T>
+struct divide_op {
+    T divisor;
+
+    T operator()(const T &a) const {
+        return a / divisor;
+    }
+};
+
+
+/**
+ * @brief Lets an expression be read where a strided descriptor is expected
+ * (e.g. by the packing routines of gemm), computing each element on the fly
+ * @tparam T the type of data contained in the matrix
+ * @tparam type the expression
+ */
+template <typename T, typename type>
+struct expression_view {
+    matrix<T, type> expression;
+    unsigned int rows;
+    unsigned int cols;
+
+    T at(unsigned int r, unsigned int c) const {
+        return expression(r, c);
+    }
+};
+
+
+/**
+ * @brief Lazy element-wise operation between two matrices of the same size
+ * @tparam T the type of data contained in the matrix
+ * @tparam operation binary functor applied to each pair of elements
+ * @tparam left_matrix type of the left operand
+ * @tparam right_matrix type of the right operand
+ */
+template <typename T, typename operation, typename left_matrix, typename right_matrix>
+class matrix<T, binary_expression<operation, left_matrix, right_matrix>> {
+    typedef binary_expression<operation, left_matrix, right_matrix> expression_type;
+
+    matrix<T, left_matrix> left;
+    matrix<T, right_matrix> right;
+    operation op;
+
+public:
+    typedef const_iterator_limited<T, expression_type> const_iterator;
+    typedef const_column_iterator<T, expression_type> const_col_iterator;
+    typedef expression_view<T, expression_type> view_type;
+
+    /**
+       @brief Constructor given the operands
+       The operands are copied, i.e. the expression shares their memory
+       @param l left operand
+       @param r right operand
+       @param o operation to be applied
+    */
+    matrix(const matrix<T, left_matrix> &l, const matrix<T, right_matrix> &r, operation o) :
+            left(l), right(r), op(o) {
+        assert((l.get_rows() == r.get_rows() && l.get_cols() == r.get_cols()) && "Incompatible sizes!");
+    }
+
+    /**
+       @brief Operator() const
+       Compute the element in position (r, c)
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return T value of the element
+    */
+    T operator()(unsigned int r, unsigned int c) const {
+        return op(left(r, c), right(r, c));
+    }
+
+    /**
+       @brief Get the left operand
+       @return const reference to the left operand
+    */
+    const matrix<T, left_matrix> &get_left() const {
+        return left;
+    }
+
+    /**
+       @brief Get the right operand
+       @return const reference to the right operand
+    */
+    const matrix<T, right_matrix> &get_right() const {
+        return right;
+    }
+
+    /**
+       @brief Get number of rows
+       @return unsigned int corresponding to number of rows
+    */
+    unsigned int get_rows() const {
+        return left.get_rows();
+    }
+
+    /**
+       @brief Get number of columns
+       @return unsigned int corresponding to number of columns
+    */
+    unsigned int get_cols() const {
+        return left.get_cols();
+    }
+
+    /**
+       @brief Get a descriptor computing the elements on the fly
+       @return view_type wrapping a copy of this expression
+    */
+    view_type get_view() const {
+        view_type v = {*this, get_rows(), get_cols()};
+        return v;
+    }
+
+    /**
+       @brief Begin const_iterator for traversing the expression by row
+       @return const_iterator starting from the first element of row i
+    */
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the expression by row
+       @return const_iterator pointing to the end of the expression
+    */
+    const_iterator end() const {
+        return const_iterator(*this, this->get_rows(), 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the expression by row
+       @return const_iterator pointing to the end of row i
+    */
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    /**
+       @brief Begin const_col_iterator for traversing the expression by column
+       @return const_col_iterator starting from (0, i)
+    */
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the expression by column
+       @return const_col_iterator that points to (0, i + 1) "end of column"
+    */
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the expression by column
+       @return const_col_iterator that points to "end of expression"
+    */
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, this->get_cols());
+    }
+};
+
+
+/**
+ * @brief Lazy element-wise operation on a single matrix
+ * @tparam T the type of data contained in the matrix
+ * @tparam operation unary functor applied to each element
+ * @tparam decorator_matrix type of the operand
+ */
+template <typename T, typename operation, typename decorator_matrix>
+class matrix<T, unary_expression<operation, decorator_matrix>> {
+    typedef unary_expression<operation, decorator_matrix> expression_type;
+
+    matrix<T, decorator_matrix> operand;
+    operation op;
+
+public:
+    typedef const_iterator_limited<T, expression_type> const_iterator;
+    typedef const_column_iterator<T, expression_type> const_col_iterator;
+    typedef expression_view<T, expression_type> view_type;
+
+    /**
+       @brief Constructor given the operand
+       The operand is copied, i.e. the expression shares its memory
+       @param m operand
+       @param o operation to be applied
+    */
+    matrix(const matrix<T, decorator_matrix> &m, operation o) :
+            operand(m), op(o) {}
+
+    /**
+       @brief Operator() const
+       Compute the element in position (r, c)
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return T value of the element
+    */
+    T operator()(unsigned int r, unsigned int c) const {
+        return op(operand(r, c));
+    }
+
+    /**
+       @brief Get the operand
+       @return const reference to the operand
+    */
+    const matrix<T, decorator_matrix> &get_operand() const {
+        return operand;
+    }
+
+    /**
+       @brief Get the operation
+       @return const reference to the operation applied to each element
+    */
+    const operation &get_operation() const {
+        return op;
+    }
+
+    /**
+       @brief Get number of rows
+       @return unsigned int corresponding to number of rows
+    */
+    unsigned int get_rows() const {
+        return operand.get_rows();
+    }
+
+    /**
+       @brief Get number of columns
+       @return unsigned int corresponding to number of columns
+    */
+    unsigned int get_cols() const {
+        return operand.get_cols();
+    }
+
+    /**
+       @brief Get a descriptor computing the elements on the fly
+       @return view_type wrapping a copy of this expression
+    */
+    view_type get_view() const {
+        view_type v = {*this, get_rows(), get_cols()};
+        return v;
+    }
+
+    /**
+       @brief Begin const_iterator for traversing the expression by row
+       @return const_iterator starting from the first element of row i
+    */
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the expression by row
+       @return const_iterator pointing to the end of the expression
+    */
+    const_iterator end() const {
+        return const_iterator(*this, this->get_rows(), 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the expression by row
+       @return const_iterator pointing to the end of row i
+    */
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    /**
+       @brief Begin const_col_iterator for traversing the expression by column
+       @return const_col_iterator starting from (0, i)
+    */
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the expression by column
+       @return const_col_iterator that points to (0, i + 1) "end of column"
+    */
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the expression by column
+       @return const_col_iterator that points to "end of expression"
+    */
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, this->get_cols());
+    }
+};
+
+
+/**
+ * @brief Element-wise sum
+ * @return lazy expression computing a + b
+ */
+template <typename T, typename typeL, typename typeR>
+matrix<T, binary_expression<add_op, typeL, typeR>>
+operator+(const matrix<T, typeL> &a, const matrix<T, typeR> &b) {
+    return matrix<T, binary_expression<add_op, typeL, typeR>>(a, b, add_op());
+}
+
+/**
+ * @brief Element-wise difference
+ * @return lazy expression computing a - b
+ */
+template <typename T, typename typeL, typename typeR>
+matrix<T, binary_expression<subtract_op, typeL, typeR>>
+operator-(const matrix<T, typeL> &a, const matrix<T, typeR> &b) {
+    return matrix<T, binary_expression<subtract_op, typeL, typeR>>(a, b, subtract_op());
+}
+
+/**
+ * @brief Element-wise negation
+ * @return lazy expression computing -a
+ */
+template <typename T, typename type>
+matrix<T, unary_expression<negate_op, type>> operator-(const matrix<T, type> &a) {
+    return matrix<T, unary_expression<negate_op, type>>(a, negate_op());
+}
+
+/**
+ * @brief Product by a scalar
+ * @return lazy expression computing a * s
+ */
+template <typename T, typename type>
+matrix<T, unary_expression<scale_op<T>, type>>
+operator*(const matrix<T, type> &a, typename matrix_detail::non_deduced<T>::type s) {
+    scale_op<T> op = {s};
+    return matrix<T, unary_expression<scale_op<T>, type>>(a, op);
+}
+
+/**
+ * @brief Product by a scalar
+ * @return lazy expression computing a * s
+ */
+template <typename T, typename type>
+matrix<T, unary_expression<scale_op<T>, type>>
+operator*(typename matrix_detail::non_deduced<T>::type s, const matrix<T, type> &a) {
+    return a * s;
+}
+
+/**
+ * @brief Division by a scalar
+ * @return lazy expression computing a / s
+ */
+template <typename T, typename type>
+matrix<T, unary_expression<divide_op<T>, type>>
+operator/(const matrix<T, type> &a, typename matrix_detail::non_deduced<T>::type s) {
+    divide_op<T> op = {s};
+    return matrix<T, unary_expression<divide_op<T>, type>>(a, op);
+}
+
+
+#endif
@@ -0,0 +1,510 @@
+#ifndef MATRIX_FIXED_H
+#define MATRIX_FIXED_H
+
+#include "matrix.h"
+
+#include <cassert>
+#include <cstddef>
+#include <initializer_list>
+#include <utility>
+
+
+/**
+ * Matrices whose size is known at compile time (e.g. the 3x3 and 4x4 transforms
+ * of geometry) store their elements inline, as an array member: creating one
+ * costs no allocation and no shared_ptr, and it can be built, multiplied,
+ * transposed and inverted in constant expressions. Products, transposes and
+ * inverses are expanded at compile time, one expression per element.
+ *
+ * A fixed matrix is a value: copying it copies the elements. Its decorations
+ * (get_transpose(), get_submatrix(), ...) are built on a `borrowed_matrix`, i.e.
+ * they refer to the elements of the fixed matrix they come from, which must
+ * outlive them. Since they can write those elements, they are only taken from
+ * non-const fixed matrices (a const or constexpr one may live in read-only memory):
+ * a const fixed matrix is read through operator(), its iterators and a read-only
+ * descriptor, or copied.
+ */
+
+
+/**
+ * @brief Matrix of R x C elements stored inline, row after row
+ * @tparam T the type of data contained in the matrix
+ * @tparam R number of rows
+ * @tparam C number of columns
+ */
+template <typename T, unsigned int R, unsigned int C>
+class matrix<T, fixed<R, C>> {
+    static_assert(R > 0 && C > 0, "A fixed matrix cannot be empty!");
+
+protected:
+    T elements[R * C];
+
+public:
+    typedef T *iterator;
+    typedef const T *const_iterator;
+    typedef column_iterator<T, fixed<R, C>> col_iterator;
+    typedef const_column_iterator<T, fixed<R, C>> const_col_iterator;
+    typedef strided_view<const T, false> view_type;           // read-only, for const matrices
+    typedef strided_view<T, false> writable_view_type;
+
+    /**
+       @brief Default constructor
+       Initialize a matrix filled with zeros
+    */
+    constexpr matrix() :
+            elements{} {}
+
+    /**
+       @brief Constructor given the elements, row after row
+       Missing elements are zeros, e.g. matrix<int, fixed<2, 2>> m{1, 2, 3, 4};
+       @param values at most R * C elements
+    */
+    constexpr matrix(std::initializer_list<T> values) :
+            elements{} {
+        assert((values.size() <= R * C) && "Too many elements!");
+        std::size_t i = 0;
+        for (const T &v : values)
+            elements[i++] = v;
+    }
+
+    /**
+    @brief Copy constructor
+    Create a fixed matrix by deep copy of a matrix of the same size
+    @param matrix_to_copy matrix to be used to create the new one, any decoration
+    */
+    template <typename type>
+    matrix(const matrix<T, type> &matrix_to_copy) :
+            elements{} {
+        assert((matrix_to_copy.get_rows() == R && matrix_to_copy.get_cols() == C) && "Incompatible sizes!");
+        copy_elements(matrix_to_copy, get_view());
+    }
+
+    /**
+       @brief Operator()
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return T& to requested element of the matrix
+    */
+    constexpr T& operator()(unsigned int r, unsigned int c) {
+        assert((r < R && c < C) && "Out of bounds!");
+        return elements[r * C + c];
+    }
+
+    /**
+       @brief Operator() const
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return const T& to requested element of the matrix
+    */
+    constexpr const T& operator()(unsigned int r, unsigned int c) const {
+        assert((r < R && c < C) && "Out of bounds!");
+        return elements[r * C + c];
+    }
+
+    /**
+       @brief Get number of rows
+       @return unsigned int corresponding to number of rows
+    */
+    constexpr unsigned int get_rows() const {
+        return R;
+    }
+
+    /**
+       @brief Get number of columns
+       @return unsigned int corresponding to number of columns
+    */
+    constexpr unsigned int get_cols() const {
+        return C;
+    }
+
+    /**
+       @brief Get the strided descriptor of the matrix (row-major, contiguous), to write its elements
+       @return writable_view_type pointing to the inline elements
+    */
+    writable_view_type get_view() {
+        writable_view_type v = {elements, C, 1, R, C};
+        return v;
+    }
+
+    /**
+       @brief Get the strided descriptor of the matrix (row-major, contiguous), to read its elements
+       @return view_type pointing to the inline elements
+    */
+    view_type get_view() const {
+        view_type v = {elements, C, 1, R, C};
+        return v;
+    }
+
+    /**
+       @brief Get a matrix referring to the elements of this one
+       @return borrowed matrix, valid as long as this matrix is alive
+    */
+    matrix<T, borrowed_matrix> borrow() {
+        return matrix<T, borrowed_matrix>(get_view());
+    }
+
+    /**
+       @brief Begin iterator for traversing the matrix by row
+       @return iterator starting from the first element of row i
+    */
+    iterator begin(unsigned int i = 0) {
+        return elements + i * C;
+    }
+
+    /**
+       @brief End iterator for traversing the matrix by row
+       @return iterator pointing to the end of the matrix
+    */
+    iterator end() {
+        return elements + R * C;
+    }
+
+    /**
+       @brief End iterator for traversing the matrix by row
+       @return iterator pointing to the end of row i
+    */
+    iterator end(unsigned int i) {
+        return elements + (i + 1) * C;
+    }
+
+    /**
+       @brief Const begin iterator for traversing the matrix by row
+       @return const_iterator starting from the first element of row i
+    */
+    const_iterator begin(unsigned int i = 0) const {
+        return elements + i * C;
+    }
+
+    /**
+       @brief Const end iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of the matrix
+    */
+    const_iterator end() const {
+        return elements + R * C;
+    }
+
+    /**
+       @brief Const end iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of row i
+    */
+    const_iterator end(unsigned int i) const {
+        return elements + (i + 1) * C;
+    }
+
+    /**
+       @brief Begin col_iterator for traversing the matrix by column
+       @return col_iterator starting from (0, i)
+    */
+    col_iterator column_begin(unsigned int i = 0) {
+        return col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End col_iterator for traversing the matrix by column
+       @return col_iterator that points to (0, i + 1) "end of column"
+    */
+    col_iterator column_end(unsigned int i) {
+        return col_iterator(*this, 0, i + 1);
+    }
+
+    /**
+       @brief End col_iterator for traversing the matrix by column
+       @return col_iterator that points to "end of matrix"
+    */
+    col_iterator column_end() {
+        return col_iterator(*this, 0, C);
+    }
+
+    /**
+       @brief Begin const_col_iterator for traversing the matrix by column
+       @return const_col_iterator starting from (0, i)
+    */
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to (0, i + 1) "end of column"
+    */
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to "end of matrix"
+    */
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, C);
+    }
+
+    /**
+        @brief compute the transpose of the current matrix (a new fixed matrix)
+        @return C x R matrix containing the transpose
+    */
+    constexpr matrix<T, fixed<C, R>> transposed() const;
+
+    /**
+        @brief create the transpose of the current matrix, sharing its elements
+        @return trasposed matrix
+    */
+    matrix<T, transpose_matrix<borrowed_matrix>> get_transpose() {
+        return borrow().get_transpose();
+    }
+
+    /**
+     * @brief get a submatrix of the current matrix, sharing its elements
+     * @param begin_row row to begin from
+     * @param end_row row to end to (EXCLUDED)
+     * @param begin_column column to begin from
+     * @param end_column column to end to (EXCLUDED)
+     * @return required submatrix
+     */
+    matrix<T, submatrix<borrowed_matrix>> get_submatrix (
+            unsigned int begin_row, unsigned int end_row,
+            unsigned int begin_column, unsigned int end_column) {
+        return borrow().get_submatrix(begin_row, end_row, begin_column, end_column);
+    }
+
+    /**
+     * @brief get a vector containing the diagonal elements of this matrix
+     * @return diagonal a vector containing the diagonal elements of this matrix
+     */
+    matrix<T, diagonal<borrowed_matrix>> get_diagonal() {
+        return borrow().get_diagonal();
+    }
+
+    /**
+     * @brief get a diagonal matrix from this matrix (iff it is a vector)
+     * @return diagonalmatrix whose diagonal elements are those of this vector
+     */
+    const matrix<T, diagonalmatrix<borrowed_matrix>> get_diagonalmatrix() {
+        return borrow().get_diagonalmatrix();
+    }
+};
+
+
+namespace matrix_detail {
+
+/**
+ * @brief sum over k of a(i, k) * b(k, j), expanded at compile time
+ */
+template <typename T, unsigned int R, unsigned int K, unsigned int C, std::size_t... k>
+constexpr T fixed_dot(const matrix<T, fixed<R, K>> &a, const matrix<T, fixed<K, C>> &b,
+                      unsigned int i, unsigned int j, std::index_sequence<k...>) {
+    return ((a(i, k) * b(k, j)) + ...);
+}
+
+/**
+ * @brief a * b, one dot product per element e = i * C + j
+ */
+template <typename T, unsigned int R, unsigned int K, unsigned int C, std::size_t... e>
+constexpr matrix<T, fixed<R, C>> fixed_product(const matrix<T, fixed<R, K>> &a, const matrix<T, fixed<K, C>> &b,
+                                               std::index_sequence<e...>) {
+    return matrix<T, fixed<R, C>>{fixed_dot(a, b, e / C, e % C, std::make_index_sequence<K>())...};
+}
+
+/**
+ * @brief transpose of a, element e = i * R + j of the result being a(j, i)
+ */
+template <typename T, unsigned int R, unsigned int C, std::size_t... e>
+constexpr matrix<T, fixed<C, R>> fixed_transpose(const matrix<T, fixed<R, C>> &a, std::index_sequence<e...>) {
+    return matrix<T, fixed<C, R>>{a(e % R, e / R)...};
+}
+
+template <typename T>
+constexpr T fixed_abs(const T &x) {
+    return x < T(0) ? -x : x;
+}
+
+} // namespace matrix_detail
+
+
+template <typename T, unsigned int R, unsigned int C>
+constexpr matrix<T, fixed<C, R>> matrix<T, fixed<R, C>>::transposed() const {
+    return matrix_detail::fixed_transpose(*this, std::make_index_sequence<R * C>());
+}
+
+
+/**
+ * @brief Product of fixed-size matrices, computed inline
+ * @param A left operand (R x K)
+ * @param B right operand (K x C)
+ * @return a new R x C fixed matrix containing A * B
+ */
+template <typename T, unsigned int R, unsigned int K, unsigned int C>
+constexpr matrix<T, fixed<R, C>> operator*(const matrix<T, fixed<R, K>> &A, const matrix<T, fixed<K, C>> &B) {
+    return matrix_detail::fixed_product(A, B, std::make_index_sequence<R * C>());
+}
+
+
+/**
+ * @brief Determinant of a square fixed-size matrix
+ * Closed formulas up to 4 x 4, Gaussian elimination with partial pivoting above
+ * @param A matrix (N x N)
+ * @return T determinant of A
+ */
+template <typename T, unsigned int N>
+constexpr T determinant(const matrix<T, fixed<N, N>> &A) {
+    if constexpr (N == 1) {
+        return A(0, 0);
+    }
+    else if constexpr (N == 2) {
+        return A(0, 0) * A(1, 1) - A(0, 1) * A(1, 0);
+    }
+    else if constexpr (N == 3) {
+        return A(0, 0) * (A(1, 1) * A(2, 2) - A(1, 2) * A(2, 1))
+             - A(0, 1) * (A(1, 0) * A(2, 2) - A(1, 2) * A(2, 0))
+             + A(0, 2) * (A(1, 0) * A(2, 1) - A(1, 1) * A(2, 0));
+    }
+    else if constexpr (N == 4) {
+        T s0 = A(0, 0) * A(1, 1) - A(1, 0) * A(0, 1);
+        T s1 = A(0, 0) * A(1, 2) - A(1, 0) * A(0, 2);
+        T s2 = A(0, 0) * A(1, 3) - A(1, 0) * A(0, 3);
+        T s3 = A(0, 1) * A(1, 2) - A(1, 1) * A(0, 2);
+        T s4 = A(0, 1) * A(1, 3) - A(1, 1) * A(0, 3);
+        T s5 = A(0, 2) * A(1, 3) - A(1, 2) * A(0, 3);
+        T c5 = A(2, 2) * A(3, 3) - A(3, 2) * A(2, 3);
+        T c4 = A(2, 1) * A(3, 3) - A(3, 1) * A(2, 3);
+        T c3 = A(2, 1) * A(3, 2) - A(3, 1) * A(2, 2);
+        T c2 = A(2, 0) * A(3, 3) - A(3, 0) * A(2, 3);
+        T c1 = A(2, 0) * A(3, 2) - A(3, 0) * A(2, 2);
+        T c0 = A(2, 0) * A(3, 1) - A(3, 0) * A(2, 1);
+        return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    }
+    else {
+        matrix<T, fixed<N, N>> U = A;
+        T det = T(1);
+        for (unsigned int k = 0; k < N; ++k) {
+            unsigned int p = k;
+            for (unsigned int i = k + 1; i < N; ++i)
+                if (matrix_detail::fixed_abs(U(i, k)) > matrix_detail::fixed_abs(U(p, k)))
+                    p = i;
+            if (U(p, k) == T(0))
+                return T(0);
+            if (p != k) {
+                for (unsigned int j = 0; j < N; ++j) {
+                    T t = U(k, j);
+                    U(k, j) = U(p, j);
+                    U(p, j) = t;
+                }
+                det = -det;
+            }
+            det *= U(k, k);
+            for (unsigned int i = k + 1; i < N; ++i) {
+                T l = U(i, k) / U(k, k);
+                for (unsigned int j = k + 1; j < N; ++j)
+                    U(i, j) -= l * U(k, j);
+            }
+        }
+        return det;
+    }
+}
+
+
+/**
+ * @brief Inverse of a square fixed-size matrix (which must not be singular)
+ * Adjugate formulas up to 4 x 4, Gauss-Jordan elimination with partial pivoting above
+ * @param A matrix (N x N)
+ * @return a new N x N fixed matrix containing the inverse of A
+ */
+template <typename T, unsigned int N>
+constexpr matrix<T, fixed<N, N>> inverse(const matrix<T, fixed<N, N>> &A) {
+    if constexpr (N == 1) {
+        assert((A(0, 0) != T(0)) && "Singular matrix!");
+        return matrix<T, fixed<N, N>>{T(1) / A(0, 0)};
+    }
+    else if constexpr (N == 2) {
+        T det = determinant(A);
+        assert((det != T(0)) && "Singular matrix!");
+        return matrix<T, fixed<N, N>>{A(1, 1) / det, -A(0, 1) / det,
+                                      -A(1, 0) / det, A(0, 0) / det};
+    }
+    else if constexpr (N == 3) {
+        T det = determinant(A);
+        assert((det != T(0)) && "Singular matrix!");
+        return matrix<T, fixed<N, N>>{
+            (A(1, 1) * A(2, 2) - A(1, 2) * A(2, 1)) / det,
+            (A(0, 2) * A(2, 1) - A(0, 1) * A(2, 2)) / det,
+            (A(0, 1) * A(1, 2) - A(0, 2) * A(1, 1)) / det,
+            (A(1, 2) * A(2, 0) - A(1, 0) * A(2, 2)) / det,
+            (A(0, 0) * A(2, 2) - A(0, 2) * A(2, 0)) / det,
+            (A(0, 2) * A(1, 0) - A(0, 0) * A(1, 2)) / det,
+            (A(1, 0) * A(2, 1) - A(1, 1) * A(2, 0)) / det,
+            (A(0, 1) * A(2, 0) - A(0, 0) * A(2, 1)) / det,
+            (A(0, 0) * A(1, 1) - A(0, 1) * A(1, 0)) / det};
+    }
+    else if constexpr (N == 4) {
+        T s0 = A(0, 0) * A(1, 1) - A(1, 0) * A(0, 1);
+        T s1 = A(0, 0) * A(1, 2) - A(1, 0) * A(0, 2);
+        T s2 = A(0, 0) * A(1, 3) - A(1, 0) * A(0, 3);
+        T s3 = A(0, 1) * A(1, 2) - A(1, 1) * A(0, 2);
+        T s4 = A(0, 1) * A(1, 3) - A(1, 1) * A(0, 3);
+        T s5 = A(0, 2) * A(1, 3) - A(1, 2) * A(0, 3);
+        T c5 = A(2, 2) * A(3, 3) - A(3, 2) * A(2, 3);
+        T c4 = A(2, 1) * A(3, 3) - A(3, 1) * A(2, 3);
+        T c3 = A(2, 1) * A(3, 2) - A(3, 1) * A(2, 2);
+        T c2 = A(2, 0) * A(3, 3) - A(3, 0) * A(2, 3);
+        T c1 = A(2, 0) * A(3, 2) - A(3, 0) * A(2, 2);
+        T c0 = A(2, 0) * A(3, 1) - A(3, 0) * A(2, 1);
+        T det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+        assert((det != T(0)) && "Singular matrix!");
+        return matrix<T, fixed<N, N>>{
+            ( A(1, 1) * c5 - A(1, 2) * c4 + A(1, 3) * c3) / det,
+            (-A(0, 1) * c5 + A(0, 2) * c4 - A(0, 3) * c3) / det,
+            ( A(3, 1) * s5 - A(3, 2) * s4 + A(3, 3) * s3) / det,
+            (-A(2, 1) * s5 + A(2, 2) * s4 - A(2, 3) * s3) / det,
+            (-A(1, 0) * c5 + A(1, 2) * c2 - A(1, 3) * c1) / det,
+            ( A(0, 0) * c5 - A(0, 2) * c2 + A(0, 3) * c1) / det,
+            (-A(3, 0) * s5 + A(3, 2) * s2 - A(3, 3) * s1) / det,
+            ( A(2, 0) * s5 - A(2, 2) * s2 + A(2, 3) * s1) / det,
+            ( A(1, 0) * c4 - A(1, 1) * c2 + A(1, 3) * c0) / det,
+            (-A(0, 0) * c4 + A(0, 1) * c2 - A(0, 3) * c0) / det,
+            ( A(3, 0) * s4 - A(3, 1) * s2 + A(3, 3) * s0) / det,
+            (-A(2, 0) * s4 + A(2, 1) * s2 - A(2, 3) * s0) / det,
+            (-A(1, 0) * c3 + A(1, 1) * c1 - A(1, 2) * c0) / det,
+            ( A(0, 0) * c3 - A(0, 1) * c1 + A(0, 2) * c0) / det,
+            (-A(3, 0) * s3 + A(3, 1) * s1 - A(3, 2) * s0) / det,
+            ( A(2, 0) * s3 - A(2, 1) * s1 + A(2, 2) * s0) / det};
+    }
+    else {
+        matrix<T, fixed<N, N>> U = A;
+        matrix<T, fixed<N, N>> X;
+        for (unsigned int i = 0; i < N; ++i)
+            X(i, i) = T(1);
+        for (unsigned int k = 0; k < N; ++k) {
+            unsigned int p = k;
+            for (unsigned int i = k + 1; i < N; ++i)
+                if (matrix_detail::fixed_abs(U(i, k)) > matrix_detail::fixed_abs(U(p, k)))
+                    p = i;
+            assert((U(p, k) != T(0)) && "Singular matrix!");
+            for (unsigned int j = 0; j < N; ++j) {
+                T t = U(k, j);
+                U(k, j) = U(p, j);
+                U(p, j) = t;
+                t = X(k, j);
+                X(k, j) = X(p, j);
+                X(p, j) = t;
+            }
+            T pivot = U(k, k);
+            for (unsigned int j = 0; j < N; ++j) {
+                U(k, j) /= pivot;
+                X(k, j) /= pivot;
+            }
+            for (unsigned int i = 0; i < N; ++i) {
+                if (i == k)
+                    continue;
+                T l = U(i, k);
+                for (unsigned int j = 0; j < N; ++j) {
+                    U(i, j) -= l * U(k, j);
+                    X(i, j) -= l * X(k, j);
+                }
+            }
+        }
+        return X;
+    }
+}
+
+
+#endif
@@ -0,0 +1,470 @@
+#ifndef MATRIX_GEMM_H
+#define MATRIX_GEMM_H
+
+#include "matrix.h"
+#include "matrix_simd.h"
+#include "thread_pool.h"
+
+#include <vector>
+#include <cassert>
+#include <cstring>
+#include <type_traits>
+
+
+/**
+ * Matrix multiplication, organized as in the GotoBLAS/BLIS papers:
+ *
+ *  - B is cut in panels of kc x nc elements, packed so that they stay in the L3 cache;
+ *  - A is cut in blocks of mc x kc elements, packed so that they stay in the L2 cache;
+ *  - a micro-kernel computes a mr x nr block of C, keeping it in registers, while
+ *    streaming one sliver of packed A and one of packed B (both in L1).
+ *
+ * For float and double the micro-kernel is vectorized: it is compiled for SSE2,
+ * AVX2 + FMA and AVX-512 like the kernels of matrix_simd.h, and the widest version
+ * supported by the CPU is chosen the first time it is needed. The micro-tile of
+ * 6 x 8 doubles (6 x 16 floats) fills 12 of the 16 AVX2 registers with accumulators.
+ * The other types use a scalar micro-kernel.
+ *
+ * The operands are read through their strided descriptors (see strided_view.h),
+ * so transposes, submatrices and diagonals are multiplied without being
+ * materialized: the decoration only changes the way the panels are packed.
+ *
+ * With more than one thread, C is cut in tiles that are computed independently
+ * (each one packing its own panels) on a work-stealing thread_pool.
+ */
+
+
+/**
+ * @brief Block sizes used by gemm
+ * @tparam T the type of data contained in the matrices
+ */
+template <typename T>
+struct gemm_blocking {
+    static const unsigned int mr = 4;    // rows of the micro-tile of C
+    static const unsigned int nr = 8;    // columns of the micro-tile of C
+    static const unsigned int kc = 256;  // depth of the packed panels
+    static const unsigned int mc = 128;  // rows of a packed block of A
+    static const unsigned int nc = 4096; // columns of a packed panel of B
+};
+
+template <>
+struct gemm_blocking<double> {
+    static const unsigned int mr = 6;
+    static const unsigned int nr = 8;
+    static const unsigned int kc = 256;
+    static const unsigned int mc = 96;
+    static const unsigned int nc = 4096;
+};
+
+template <>
+struct gemm_blocking<float> {
+    static const unsigned int mr = 6;
+    static const unsigned int nr = 16;
+    static const unsigned int kc = 256;
+    static const unsigned int mc = 96;
+    static const unsigned int nc = 4096;
+};
+
+
+namespace matrix_detail {
+
+/**
+ * @brief pack rows [ic, ic + m) x columns [pc, pc + k) of A in slivers of mr rows,
+ * each stored column after column; the last sliver is padded with zeros
+ */
+template <typename T, typename view>
+void pack_a(const view &a, unsigned int ic, unsigned int m, unsigned int pc, unsigned int k, T *buffer) {
+    const unsigned int mr = gemm_blocking<T>::mr;
+    for (unsigned int is = 0; is < m; is += mr) {
+        unsigned int rows = (m - is < mr) ? m - is : mr;
+        for (unsigned int p = 0; p < k; ++p) {
+            unsigned int i = 0;
+            for (; i < rows; ++i)
+                *buffer++ = a.at(ic + is + i, pc + p);
+            for (; i < mr; ++i)
+                *buffer++ = T(0);
+        }
+    }
+}
+
+/**
+ * @brief pack rows [pc, pc + k) x columns [jc, jc + n) of B in slivers of nr columns,
+ * each stored row after row; the last sliver is padded with zeros
+ */
+template <typename T, typename view>
+void pack_b(const view &b, unsigned int pc, unsigned int k, unsigned int jc, unsigned int n, T *buffer) {
+    const unsigned int nr = gemm_blocking<T>::nr;
+    for (unsigned int js = 0; js < n; js += nr) {
+        unsigned int cols = (n - js < nr) ? n - js : nr;
+        for (unsigned int p = 0; p < k; ++p) {
+            unsigned int j = 0;
+            for (; j < cols; ++j)
+                *buffer++ = b.at(pc + p, jc + js + j);
+            for (; j < nr; ++j)
+                *buffer++ = T(0);
+        }
+    }
+}
+
+// the product of a sliver of A (k columns of mr elements) by a sliver of B (k rows
+// of nr elements), written row after row in the mr x nr array ab
+template <typename T>
+using tile_kernel = void (*)(unsigned int k, const T *a, const T *b, T *ab);
+
+template <typename T>
+void tile_scalar(unsigned int k, const T *a, const T *b, T *ab) {
+    const unsigned int mr = gemm_blocking<T>::mr;
+    const unsigned int nr = gemm_blocking<T>::nr;
+    for (unsigned int i = 0; i < mr * nr; ++i)
+        ab[i] = T(0);
+    for (unsigned int p = 0; p < k; ++p, a += mr, b += nr)
+        for (unsigned int i = 0; i < mr; ++i)
+            for (unsigned int j = 0; j < nr; ++j)
+                ab[i * nr + j] += a[i] * b[j];
+}
+
+#if MATRIX_SIMD_X86
+
+// GCC does not fuse a * b + c under -std=c++17: allow it in the kernels using FMA
+#if defined(__clang__)
+#define MATRIX_GEMM_CONTRACT
+#else
+#define MATRIX_GEMM_CONTRACT __attribute__((optimize("fp-contract=fast")))
+#endif
+
+// the accumulators of each row of the micro-tile are nr / (bytes / sizeof(T)) vectors,
+// updated by broadcasting a[i] and multiplying it by the vectors of the row of B
+template <unsigned int bytes, typename T>
+inline __attribute__((always_inline))
+void tile_loop(unsigned int k, const T *a, const T *b, T *ab) {
+    typedef typename matrix_simd::pack<T, bytes>::type V;
+    const unsigned int mr = gemm_blocking<T>::mr;
+    const unsigned int nr = gemm_blocking<T>::nr;
+    const unsigned int width = bytes / sizeof(T), vectors = nr / width;
+    static_assert(nr % width == 0, "A row of the micro-tile must be made of whole vectors!");
+    V c[mr][vectors];
+#pragma GCC unroll 16
+    for (unsigned int i = 0; i < mr; ++i)
+#pragma GCC unroll 16
+        for (unsigned int v = 0; v < vectors; ++v)
+            c[i][v] = V();
+    for (unsigned int p = 0; p < k; ++p, a += mr, b += nr) {
+        V y[vectors];
+#pragma GCC unroll 16
+        for (unsigned int v = 0; v < vectors; ++v)
+            std::memcpy(&y[v], b + v * width, bytes);
+#pragma GCC unroll 16
+        for (unsigned int i = 0; i < mr; ++i) {
+            V x = V() + a[i];
+#pragma GCC unroll 16
+            for (unsigned int v = 0; v < vectors; ++v)
+                c[i][v] += x * y[v];
+        }
+    }
+#pragma GCC unroll 16
+    for (unsigned int i = 0; i < mr; ++i)
+#pragma GCC unroll 16
+        for (unsigned int v = 0; v < vectors; ++v)
+            std::memcpy(ab + i * nr + v * width, &c[i][v], bytes);
+}
+
+template <typename T>
+void tile_sse2(unsigned int k, const T *a, const T *b, T *ab) {
+    tile_loop<16>(k, a, b, ab);
+}
+
+template <typename T>
+__attribute__((target("avx2,fma"))) MATRIX_GEMM_CONTRACT
+void tile_avx2(unsigned int k, const T *a, const T *b, T *ab) {
+    tile_loop<32>(k, a, b, ab);
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) MATRIX_GEMM_CONTRACT
+void tile_avx512(unsigned int k, const T *a, const T *b, T *ab) {
+    tile_loop<64>(k, a, b, ab);
+}
+
+#undef MATRIX_GEMM_CONTRACT
+
+#endif
+
+/**
+ * @brief Micro-kernel for a given instruction set, which must be supported by the CPU
+ * @param level instruction set (see matrix_simd::detect_level)
+ */
+template <typename T>
+tile_kernel<T> tile_kernel_for(matrix_simd::simd_level level) {
+    assert((level <= matrix_simd::detect_level()) && "Instruction set not supported by this CPU!");
+#if MATRIX_SIMD_X86
+    if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value) {
+        if (level == matrix_simd::level_avx512)
+            return &tile_avx512<T>;
+        if (level == matrix_simd::level_avx2)
+            return &tile_avx2<T>;
+        if (level == matrix_simd::level_sse2)
+            return &tile_sse2<T>;
+    }
+#endif
+    (void)level;
+    return &tile_scalar<T>;
+}
+
+/**
+ * @brief Micro-kernel for the widest instruction set of the CPU, selected once
+ */
+template <typename T>
+tile_kernel<T> tile_kernels() {
+    static const tile_kernel<T> kernel = tile_kernel_for<T>(matrix_simd::detect_level());
+    return kernel;
+}
+
+/**
+ * @brief C[0:m, 0:n] += alpha * (sliver of A) * (sliver of B), with m <= mr and n <= nr
+ * @param kernel computes the product of the slivers (see tile_kernels)
+ * @param k depth of the slivers
+ * @param a packed sliver of A (k columns of mr elements)
+ * @param b packed sliver of B (k rows of nr elements)
+ * @param c address of the top-left element of the micro-tile of C
+ */
+template <typename T>
+void micro_kernel(tile_kernel<T> kernel, unsigned int k, const T *a, const T *b, T alpha,
+                  T *c, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c,
+                  unsigned int m, unsigned int n) {
+    const unsigned int mr = gemm_blocking<T>::mr;
+    const unsigned int nr = gemm_blocking<T>::nr;
+    T ab[mr * nr];
+    kernel(k, a, b, ab);
+    if (m == mr && n == nr && cs_c == 1) {
+        for (unsigned int i = 0; i < mr; ++i)
+            for (unsigned int j = 0; j < nr; ++j)
+                c[i * rs_c + j] += alpha * ab[i * nr + j];
+    }
+    else {
+        for (unsigned int i = 0; i < m; ++i)
+            for (unsigned int j = 0; j < n; ++j)
+                c[i * rs_c + j * cs_c] += alpha * ab[i * nr + j];
+    }
+}
+
+/**
+ * @brief multiply a packed block of A (m x k) by a packed panel of B (k x n)
+ * and accumulate into the block of C starting at c
+ */
+template <typename T>
+void macro_kernel(unsigned int m, unsigned int n, unsigned int k,
+                  const T *packed_a, const T *packed_b, T alpha,
+                  T *c, std::ptrdiff_t rs_c, std::ptrdiff_t cs_c) {
+    const unsigned int mr = gemm_blocking<T>::mr;
+    const unsigned int nr = gemm_blocking<T>::nr;
+    const tile_kernel<T> kernel = tile_kernels<T>();
+    for (unsigned int jr = 0; jr < n; jr += nr) {
+        unsigned int cols = (n - jr < nr) ? n - jr : nr;
+        for (unsigned int ir = 0; ir < m; ir += mr) {
+            unsigned int rows = (m - ir < mr) ? m - ir : mr;
+            micro_kernel(kernel, k, packed_a + ir * k, packed_b + jr * k, alpha,
+                         c + ir * rs_c + jr * cs_c, rs_c, cs_c, rows, cols);
+        }
+    }
+}
+
+/**
+ * @brief C = beta * C, with beta == 0 overwriting C (so that NaNs do not survive)
+ */
+template <typename T, typename view>
+void scale(const view &c, T beta) {
+    if (beta == T(1))
+        return;
+    for (unsigned int i = 0; i < c.rows; ++i)
+        for (unsigned int j = 0; j < c.cols; ++j)
+            c.at(i, j) = (beta == T(0)) ? T(0) : beta * c.at(i, j);
+}
+
+/**
+ * @brief C[ic:ic+m, jc:jc+n] += alpha * A[ic:ic+m, :] * B[:, jc:jc+n], blocked and packed
+ */
+template <typename T, typename view_a, typename view_b>
+void gemm_tile(T alpha, const view_a &a, const view_b &b, const strided_view<T, false> &c,
+               unsigned int ic, unsigned int m, unsigned int jc, unsigned int n) {
+    typedef gemm_blocking<T> blocking;
+    const unsigned int k = a.cols;
+    unsigned int nc = (n < blocking::nc) ? n : blocking::nc;
+    unsigned int kc = (k < blocking::kc) ? k : blocking::kc;
+    unsigned int mc = (m < blocking::mc) ? m : blocking::mc;
+    // room for the padding of the last sliver
+    std::vector<T> packed_a((mc + blocking::mr) * kc);
+    std::vector<T> packed_b((nc + blocking::nr) * kc);
+    for (unsigned int j = 0; j < n; j += blocking::nc) {
+        unsigned int nb = (n - j < blocking::nc) ? n - j : blocking::nc;
+        for (unsigned int p = 0; p < k; p += blocking::kc) {
+            unsigned int kb = (k - p < blocking::kc) ? k - p : blocking::kc;
+            pack_b(b, p, kb, jc + j, nb, packed_b.data());
+            for (unsigned int i = 0; i < m; i += blocking::mc) {
+                unsigned int mb = (m - i < blocking::mc) ? m - i : blocking::mc;
+                pack_a(a, ic + i, mb, p, kb, packed_a.data());
+                macro_kernel(mb, nb, kb, packed_a.data(), packed_b.data(), alpha,
+                             &c.at(ic + i, jc + j), c.row_stride, c.col_stride);
+            }
+        }
+    }
+}
+
+/**
+ * @brief call f(c, element) for every stored element of row r of a structured
+ * view: at most one if the view is (part of) a diagonal matrix, otherwise the
+ * view is a vector and all its elements are candidates
+ */
+template <typename T, typename function>
+void for_each_stored_in_row(const strided_view<T, true> &v, unsigned int r, function f) {
+    const long lr = r;
+    long first = 0, last = v.cols;
+    if (v.on_diagonal) {
+        first = (lr - v.delta > 0) ? lr - v.delta : 0;
+        last = (lr - v.delta + 1 < last) ? lr - v.delta + 1 : last;
+    }
+    for (long c = first; c < last; ++c) {
+        long p = lr * v.p_row + c * v.p_col + v.p_offset;
+        if (p >= 0 && p < v.length)
+            f(static_cast<unsigned int>(c), v.base[p * v.stride]);
+    }
+}
+
+/**
+ * @brief a view read with rows and columns exchanged (for views that have no transposed())
+ */
+template <typename view>
+struct swapped_view {
+    view v;
+    unsigned int rows;
+    unsigned int cols;
+
+    auto at(unsigned int r, unsigned int c) const -> decltype(v.at(c, r)) {
+        return v.at(c, r);
+    }
+};
+
+/**
+ * @brief C = alpha * A * B + beta * C with a structured A (a diagonal matrix or a part of it):
+ * row i of C combines only the rows of B selected by the stored elements of row i of A,
+ * so a diagonal A scales the rows of B, in O(rows * cols) of C instead of O(rows^2 * cols).
+ * If B is structured too, only its stored elements are visited.
+ */
+template <typename T, typename view_b>
+void structured_gemm(T alpha, const strided_view<T, true> &a, const view_b &b, T beta,
+                     const strided_view<T, false> &c, thread_pool &pool) {
+    const unsigned int tasks = (c.rows < 4 * pool.get_threads()) ? c.rows : 4 * pool.get_threads();
+    const unsigned int block = (tasks == 0) ? 0 : (c.rows + tasks - 1) / tasks;
+    pool.parallel_for(tasks, [&](unsigned int t) {
+        unsigned int first = (t * block < c.rows) ? t * block : c.rows;
+        unsigned int last = (c.rows - first < block) ? c.rows : first + block;
+        for (unsigned int i = first; i < last; ++i) {
+            scale(c.sub(i, i + 1, 0, c.cols), beta);
+            if (alpha == T(0))
+                continue;
+            for_each_stored_in_row(a, i, [&](unsigned int k, const T &x) {
+                const T s = alpha * x;
+                if constexpr (std::is_same<view_b, strided_view<T, true>>::value) {
+                    for_each_stored_in_row(b, k, [&](unsigned int j, const T &y) {
+                        c.at(i, j) += s * y;
+                    });
+                }
+                else {
+                    for (unsigned int j = 0; j < c.cols; ++j)
+                        c.at(i, j) += s * b.at(k, j);
+                }
+            });
+        }
+    });
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief General matrix multiplication: C = alpha * A * B + beta * C
+ * A and B can be any decorated matrix; C can be a basic matrix or any writable
+ * (i.e. not derived from a diagonalmatrix) view of one, but must not overlap A or B.
+ * If A or B is derived from a diagonalmatrix, only its stored elements are
+ * multiplied (e.g. a diagonal A scales the rows of B).
+ * @param alpha scalar multiplying A * B
+ * @param A left operand (m x k)
+ * @param B right operand (k x n)
+ * @param beta scalar multiplying C
+ * @param C result (m x n)
+ * @param pool threads computing the tiles of C
+ */
+template <typename T, typename typeA, typename typeB, typename typeC>
+void gemm(typename matrix_detail::non_deduced<T>::type alpha,
+          const matrix<T, typeA> &A, const matrix<T, typeB> &B,
+          typename matrix_detail::non_deduced<T>::type beta,
+          matrix<T, typeC> &C, thread_pool &pool) {
+    static_assert(!is_structured<typeC>::value, "The result of gemm must be writable!");
+    assert((A.get_cols() == B.get_rows()) && "Incompatible sizes!");
+    assert((A.get_rows() == C.get_rows() && B.get_cols() == C.get_cols()) && "Incompatible sizes!");
+    typedef gemm_blocking<T> blocking;
+    const typename matrix<T, typeA>::view_type a = A.get_view();
+    const typename matrix<T, typeB>::view_type b = B.get_view();
+    const strided_view<T, false> c = C.get_view();
+    if constexpr (is_structured<typeA>::value) {
+        matrix_detail::structured_gemm(T(alpha), a, b, T(beta), c, pool);
+        return;
+    }
+    else if constexpr (is_structured<typeB>::value) {
+        // C^T = B^T * A^T, with the structured operand on the left
+        const matrix_detail::swapped_view<typename matrix<T, typeA>::view_type> at = {a, a.cols, a.rows};
+        matrix_detail::structured_gemm(T(alpha), b.transposed(), at, T(beta), c.transposed(), pool);
+        return;
+    }
+    const bool multiply = A.get_cols() != 0 && alpha != T(0);
+    // aim at a few tiles per thread, so that stealing can balance the load
+    unsigned int tile_m = c.rows, tile_n = c.cols;
+    if (pool.get_threads() > 1 && c.rows > 0 && c.cols > 0) {
+        tile_m = (c.rows < blocking::mc) ? c.rows : blocking::mc;
+        unsigned int row_tiles = (c.rows + tile_m - 1) / tile_m;
+        unsigned int col_tiles = (4 * pool.get_threads() + row_tiles - 1) / row_tiles;
+        tile_n = (c.cols + col_tiles - 1) / col_tiles;
+        tile_n = (tile_n + blocking::nr - 1) / blocking::nr * blocking::nr;
+        if (tile_n < 8 * blocking::nr)
+            tile_n = 8 * blocking::nr;
+    }
+    unsigned int row_tiles = (tile_m == 0) ? 0 : (c.rows + tile_m - 1) / tile_m;
+    unsigned int col_tiles = (tile_n == 0) ? 0 : (c.cols + tile_n - 1) / tile_n;
+    pool.parallel_for(row_tiles * col_tiles, [&](unsigned int t) {
+        unsigned int i = (t / col_tiles) * tile_m;
+        unsigned int j = (t % col_tiles) * tile_n;
+        unsigned int m = (c.rows - i < tile_m) ? c.rows - i : tile_m;
+        unsigned int n = (c.cols - j < tile_n) ? c.cols - j : tile_n;
+        matrix_detail::scale(c.sub(i, i + m, j, j + n), beta);
+        if (multiply)
+            matrix_detail::gemm_tile(alpha, a, b, c, i, m, j, n);
+    });
+}
+
+/**
+ * @brief General matrix multiplication on the default thread pool
+ * (serial unless thread_pool::set_default_threads has been called)
+ */
+template <typename T, typename typeA, typename typeB, typename typeC>
+void gemm(typename matrix_detail::non_deduced<T>::type alpha,
+          const matrix<T, typeA> &A, const matrix<T, typeB> &B,
+          typename matrix_detail::non_deduced<T>::type beta,
+          matrix<T, typeC> &C) {
+    gemm(alpha, A, B, beta, C, thread_pool::get_default());
+}
+
+
+/**
+ * @brief Matrix product
+ * @param A left operand (m x k), any decoration
+ * @param B right operand (k x n), any decoration
+ * @return a new m x n basic matrix containing A * B
+ */
+template <typename T, typename typeA, typename typeB>
+matrix<T> operator*(const matrix<T, typeA> &A, const matrix<T, typeB> &B) {
+    matrix<T> C(A.get_rows(), B.get_cols()); // already filled with zeros
+    gemm(T(1), A, B, T(1), C);
+    return C;
+}
+
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include "matrix.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <locale>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+
+/**
+ * Text output of matrices: one row per line, each element followed by a space
+ * (the format of operator<<, which is implemented here).
+ *
+ * Numbers are formatted with std::to_chars into large buffers, which are written
+ * to the stream in a few big chunks, without flushing it. The format follows the
+ * state of the stream (precision, fixed or scientific, integer base); when the
+ * stream asks for something to_chars cannot reproduce (a width, showpos, a locale,
+ * or elements that are not numbers), every element goes through the stream instead.
+ *
+ * Blocks of rows can be formatted in parallel on a thread_pool; they are written
+ * in order.
+ *
+ * Text input reads the same format, or any text with one row per line and the
+ * elements separated by spaces, tabs, commas or semicolons (e.g. CSV files of
+ * numbers): read_text<T>(path) returns a new basic matrix, with as many rows as
+ * non-blank lines and as many columns as elements in the first of them. The file
+ * is split in chunks of whole lines, parsed with std::from_chars on a thread_pool:
+ * a first pass counts the lines of each chunk, so that the second one can write
+ * the elements of every chunk directly at their place in the matrix.
+ * Malformed input throws std::runtime_error.
+ */
+
+
+namespace matrix_detail {
+
+// bytes of text formatted before writing them to the stream
+const std::size_t text_block_bytes = std::size_t(1) << 20;
+
+/**
+ * @brief How to format the numbers of type T as the stream would
+ */
+template <typename T>
+struct text_format {
+    // elements formatted by to_chars: numbers, except bool and characters (printed as such)
+    static const bool numeric =
+            std::is_floating_point<T>::value ||
+            (std::is_integral<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, char>::value &&
+             !std::is_same<T, signed char>::value && !std::is_same<T, unsigned char>::value &&
+             !std::is_same<T, wchar_t>::value && !std::is_same<T, char16_t>::value &&
+             !std::is_same<T, char32_t>::value);
+
+    bool fast;                    // false: the stream formats every element
+    std::chars_format floating;   // notation of floating point numbers
+    int precision;
+    int base;                     // base of integers
+
+    explicit text_format(const std::ostream &os) :
+            fast(false), floating(std::chars_format::general), precision(int(os.precision())), base(10) {
+        const std::ios_base::fmtflags flags = os.flags();
+        const std::ios_base::fmtflags unsupported = std::ios_base::showpos | std::ios_base::showpoint |
+                                                    std::ios_base::showbase | std::ios_base::uppercase;
+        if (!numeric || os.width() != 0 || (flags & unsupported) || !(os.getloc() == std::locale::classic()))
+            return;
+        const std::ios_base::fmtflags notation = flags & std::ios_base::floatfield;
+        if (notation == std::ios_base::fixed)
+            floating = std::chars_format::fixed;
+        else if (notation == std::ios_base::scientific)
+            floating = std::chars_format::scientific;
+        else if (notation != std::ios_base::fmtflags(0))
+            return; // hexfloat
+        const std::ios_base::fmtflags radix = flags & std::ios_base::basefield;
+        base = (radix == std::ios_base::hex) ? 16 : (radix == std::ios_base::oct) ? 8 : 10;
+        fast = true;
+    }
+
+    std::to_chars_result format(char *first, char *last, const T &value) const {
+        if constexpr (std::is_floating_point<T>::value)
+            return std::to_chars(first, last, value, floating, precision);
+        else if (base != 10) // streams print negative numbers in two's complement
+            return std::to_chars(first, last, static_cast<typename std::make_unsigned<T>::type>(value), base);
+        else
+            return std::to_chars(first, last, value, base);
+    }
+};
+
+/**
+ * @brief append value, as formatted by f, to out
+ */
+template <typename T>
+void append_number(std::vector<char> &out, const T &value, const text_format<T> &f) {
+    char local[128];
+    std::to_chars_result r = f.format(local, local + sizeof(local), value);
+    if (r.ec == std::errc()) {
+        out.insert(out.end(), local, r.ptr);
+        return;
+    }
+    // e.g. a huge number in fixed notation
+    std::vector<char> larger(1024);
+    while ((r = f.format(larger.data(), larger.data() + larger.size(), value)).ec != std::errc())
+        larger.resize(4 * larger.size());
+    out.insert(out.end(), larger.data(), r.ptr);
+}
+
+/**
+ * @brief append the rows [first, last) of m to out
+ */
+template <typename T, typename type>
+void format_rows(std::vector<char> &out, const matrix<T, type> &m, unsigned int first, unsigned int last,
+                 const text_format<T> &f) {
+    for (unsigned int i = first; i < last; ++i) {
+        for (auto e = m.begin(i), ee = m.end(i); e != ee; ++e) {
+            append_number(out, T(*e), f);
+            out.push_back(' ');
+        }
+        out.push_back('\n');
+    }
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Write a matrix as text, one row per line
+ * @param os output stream (not flushed)
+ * @param m matrix to be written, any decoration
+ * @param pool threads formatting blocks of rows
+ * @return reference to output stream
+ */
+template <typename T, typename type>
+std::ostream &write_text(std::ostream &os, const matrix<T, type> &m, thread_pool &pool) {
+    const unsigned int rows = m.get_rows(), cols = m.get_cols();
+    if (cols == 0)
+        return os;
+    const matrix_detail::text_format<T> f(os);
+    if (!f.fast) {
+        for (unsigned int i = 0; i < rows; ++i) {
+            for (auto e = m.begin(i), ee = m.end(i); e != ee; ++e)
+                os << *e << " ";
+            os << '\n';
+        }
+        return os;
+    }
+    // rows per block, guessing about 12 bytes per element
+    const std::size_t row_bytes = std::size_t(cols) * 12;
+    const unsigned int block = static_cast<unsigned int>(
+            std::max<std::size_t>(1, matrix_detail::text_block_bytes / row_bytes));
+    const unsigned int blocks = (rows + block - 1) / block;
+    const unsigned int batch = (pool.get_threads() == 1) ? 1 : 2 * pool.get_threads();
+    std::vector<std::vector<char>> buffers(batch);
+    for (unsigned int b = 0; b < blocks; b += batch) {
+        const unsigned int count = std::min(batch, blocks - b);
+        pool.parallel_for(count, [&](unsigned int t) {
+            unsigned int first = (b + t) * block;
+            unsigned int last = (rows - first < block) ? rows : first + block;
+            buffers[t].clear();
+            matrix_detail::format_rows(buffers[t], m, first, last, f);
+        });
+        for (unsigned int t = 0; t < count; ++t)
+            os.write(buffers[t].data(), std::streamsize(buffers[t].size()));
+    }
+    return os;
+}
+
+/**
+ * @brief Write a matrix as text on the default thread pool
+ */
+template <typename T, typename type>
+std::ostream &write_text(std::ostream &os, const matrix<T, type> &m) {
+    return write_text(os, m, thread_pool::get_default());
+}
+
+
+namespace matrix_detail {
+
+// bytes read from a file at once
+const std::size_t text_read_bytes = std::size_t(1) << 22;
+
+inline bool is_separator(char c) {
+    return c == ' ' || c == '\t' || c == ',' || c == ';' || c == '\r';
+}
+
+/**
+ * @brief call f(first, last) for every line of a file starting in the bytes [begin, end),
+ * i.e. the lines of a chunk: the one starting before begin belongs to the previous chunk
+ * @param path file name
+ * @param begin offset of the first byte of the chunk
+ * @param end offset of the first byte of the next chunk
+ */
+template <typename function>
+void for_each_line(const std::string &path, std::uint64_t begin, std::uint64_t end, function f) {
+    if (begin >= end)
+        return;
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("read_text: cannot open " + path);
+    std::uint64_t data_offset = (begin > 0) ? begin - 1 : 0; // file offset of data[0]
+    in.seekg(std::streamoff(data_offset));
+    std::vector<char> data;
+    std::size_t start = 0;   // first byte of the current line
+    std::size_t scanned = 0; // data[start, scanned) holds no newline
+    bool skip = begin > 0;   // the current line holds byte begin - 1
+    bool eof = false;
+    for (;;) {
+        const char *newline = (scanned < data.size())
+                ? static_cast<const char *>(std::memchr(data.data() + scanned, '\n', data.size() - scanned))
+                : nullptr;
+        if (newline) {
+            std::size_t stop = newline - data.data();
+            if (!skip)
+                f(data.data() + start, data.data() + stop);
+            skip = false;
+            start = scanned = stop + 1;
+            if (data_offset + start >= end)
+                return;
+            continue;
+        }
+        if (eof) {
+            if (!skip && start < data.size())
+                f(data.data() + start, data.data() + data.size());
+            return;
+        }
+        // keep the current line only, and read the next block after it
+        data.erase(data.begin(), data.begin() + start);
+        data_offset += start;
+        start = 0;
+        scanned = data.size();
+        data.resize(scanned + text_read_bytes);
+        in.read(data.data() + scanned, std::streamsize(text_read_bytes));
+        std::size_t got = static_cast<std::size_t>(in.gcount());
+        data.resize(scanned + got);
+        eof = got < text_read_bytes;
+    }
+}
+
+// number of elements of a line
+inline std::size_t count_fields(const char *first, const char *last) {
+    std::size_t n = 0;
+    while (first != last) {
+        while (first != last && is_separator(*first))
+            ++first;
+        if (first == last)
+            break;
+        ++n;
+        while (first != last && !is_separator(*first))
+            ++first;
+    }
+    return n;
+}
+
+/**
+ * @brief parse the elements of a line into out[0, cols)
+ * @return number of elements found, parsed up to cols
+ */
+template <typename T>
+std::size_t parse_fields(const char *first, const char *last, T *out, std::size_t cols, std::uint64_t row) {
+    std::size_t n = 0;
+    for (;;) {
+        while (first != last && is_separator(*first))
+            ++first;
+        if (first == last)
+            return n;
+        if (n == cols)
+            return n + 1;
+        if (*first == '+' && last - first > 1 && *(first + 1) != '-')
+            ++first; // from_chars does not accept the plus sign
+        std::from_chars_result r = std::from_chars(first, last, out[n]);
+        if (r.ec != std::errc() || (r.ptr != last && !is_separator(*r.ptr)))
+            throw std::runtime_error("read_text: invalid number in row " + std::to_string(row));
+        first = r.ptr;
+        ++n;
+    }
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Read a matrix from a text file: one row per (non-blank) line, the
+ * elements separated by spaces, tabs, commas or semicolons
+ * @tparam T the type of the elements
+ * @param path file name
+ * @param pool threads parsing the chunks of the file
+ * @return a new basic matrix
+ */
+template <typename T>
+matrix<T> read_text(const std::string &path, thread_pool &pool) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error("read_text: cannot open " + path);
+    const std::uint64_t size = static_cast<std::uint64_t>(in.tellg());
+    in.close();
+    // a few chunks per thread, not smaller than a read
+    std::uint64_t chunks = std::min<std::uint64_t>(4 * pool.get_threads(),
+                                                   size / matrix_detail::text_read_bytes + 1);
+    if (pool.get_threads() == 1)
+        chunks = 1;
+    const std::uint64_t chunk = (size + chunks - 1) / chunks;
+    auto chunk_begin = [&](unsigned int t) { return std::min(size, t * chunk); };
+    // first pass: rows of every chunk, and columns of the first row of every chunk
+    std::vector<std::uint64_t> rows(chunks + 1, 0);
+    std::vector<std::size_t> first_cols(chunks, 0);
+    pool.parallel_for(static_cast<unsigned int>(chunks), [&](unsigned int t) {
+        matrix_detail::for_each_line(path, chunk_begin(t), chunk_begin(t + 1), [&](const char *first, const char *last) {
+            if (rows[t + 1] == 0) {
+                first_cols[t] = matrix_detail::count_fields(first, last);
+                rows[t + 1] = (first_cols[t] != 0);
+            }
+            else if (std::find_if_not(first, last, matrix_detail::is_separator) != last) {
+                ++rows[t + 1];
+            }
+        });
+    });
+    std::size_t cols = 0;
+    for (unsigned int t = 0; t < chunks; ++t) {
+        if (cols == 0)
+            cols = first_cols[t];
+        rows[t + 1] += rows[t];
+    }
+    if (rows[chunks] > 0xffffffffu || cols > 0xffffffffu)
+        throw std::runtime_error("read_text: matrix too large");
+    matrix<T> result(static_cast<unsigned int>(rows[chunks]), static_cast<unsigned int>(cols));
+    if (rows[chunks] == 0)
+        return result;
+    T *out = result.data();
+    // second pass: parse every chunk into its rows
+    pool.parallel_for(static_cast<unsigned int>(chunks), [&](unsigned int t) {
+        std::uint64_t row = rows[t];
+        matrix_detail::for_each_line(path, chunk_begin(t), chunk_begin(t + 1), [&](const char *first, const char *last) {
+            std::size_t n = matrix_detail::parse_fields(first, last, out + row * cols, cols, row);
+            if (n == 0)
+                return; // blank line
+            if (n != cols)
+                throw std::runtime_error("read_text: row " + std::to_string(row) + " does not have " +
+                                         std::to_string(cols) + " elements");
+            ++row;
+        });
+    });
+    return result;
+}
+
+/**
+ * @brief Read a matrix from a text file on the default thread pool
+ */
+template <typename T>
+matrix<T> read_text(const std::string &path) {
+    return read_text<T>(path, thread_pool::get_default());
+}
+
+
+#endif
@@ -0,0 +1,911 @@
+#ifndef MATRIX_PACKED_H
+#define MATRIX_PACKED_H
+
+#include "matrix.h"
+#include "matrix_gemm.h"
+#include "matrix_sparse.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Square matrices whose structure is known from their type, storing only the
+ * elements that can differ from zero:
+ *
+ *  - matrix<T, upper_triangular_matrix>: the n(n+1)/2 elements on and above the
+ *    diagonal, row after row;
+ *  - matrix<T, lower_triangular_matrix>: the elements on and below the diagonal,
+ *    column after column (i.e. the same array as the upper triangle of its
+ *    transpose, so that get_transpose() shares it);
+ *  - matrix<T, symmetric_matrix>: the upper triangle, which is also the lower
+ *    one; writing (i, j) writes (j, i) too;
+ *  - matrix<T, banded_matrix>: the kl diagonals below the main one, the main one
+ *    and the ku above it, in n rows of kl + ku + 1 elements.
+ *
+ * As for the basic matrix, copies share the elements. operator() reads zero
+ * outside of the stored part; the non-const one returns a packed_reference,
+ * through which writing there fails an assertion (and is ignored with NDEBUG).
+ *
+ * gemm (and operator*) with one of them as left operand only visits the stored
+ * elements; solve() uses substitution for the triangular matrices, a Cholesky
+ * factorization (for positive definite matrices) for the symmetric one and
+ * Gaussian elimination with partial pivoting inside the band for the banded one.
+ */
+
+
+namespace matrix_detail {
+
+// number of elements of a triangle of side n
+inline std::size_t triangle_size(unsigned int n) {
+    return std::size_t(n) * (std::size_t(n) + 1) / 2;
+}
+
+// position of the first element of line i of a packed triangle, whose line i holds n - i elements
+inline std::size_t packed_line(unsigned int n, unsigned int i) {
+    return std::size_t(i) * (2 * std::size_t(n) - i + 1) / 2;
+}
+
+/**
+ * @brief Element of a packed matrix returned by the non-const operator(): reads
+ * as the element, or as zero outside of the stored part, where assigning it
+ * fails an assertion (and does nothing with NDEBUG)
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+class packed_reference {
+    T *element;    // null outside of the stored part
+    const T *zero;
+
+public:
+    packed_reference(T *e, const T *z) : element(e), zero(z) {}
+
+    operator const T &() const {
+        return element ? *element : *zero;
+    }
+
+    packed_reference &operator=(const T &value) {
+        assert(element && "Element not stored!");
+        if (element)
+            *element = value;
+        return *this;
+    }
+
+    packed_reference &operator=(const packed_reference &other) {
+        return *this = static_cast<const T &>(other);
+    }
+
+    packed_reference &operator+=(const T &value) {
+        return *this = static_cast<const T &>(*this) + value;
+    }
+
+    packed_reference &operator-=(const T &value) {
+        return *this = static_cast<const T &>(*this) - value;
+    }
+
+    packed_reference &operator*=(const T &value) {
+        return *this = static_cast<const T &>(*this) * value;
+    }
+
+    packed_reference &operator/=(const T &value) {
+        return *this = static_cast<const T &>(*this) / value;
+    }
+};
+
+/**
+ * @brief Size and elements shared by the packed matrices
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+class packed_base {
+protected:
+    unsigned int n;
+    std::shared_ptr<std::vector<T>> content;
+    T zero; // returned for the elements that are not stored
+
+    packed_base(unsigned int size, std::size_t stored) :
+            n(size), content(std::make_shared<std::vector<T>>(stored, T(0))), zero(0) {}
+
+    packed_base(unsigned int size, const std::shared_ptr<std::vector<T>> &c) : n(size), content(c), zero(0) {}
+
+public:
+    /**
+       @brief Get number of rows
+       @return unsigned int corresponding to number of rows
+    */
+    unsigned int get_rows() const {
+        return n;
+    }
+
+    /**
+       @brief Get number of columns
+       @return unsigned int corresponding to number of columns
+    */
+    unsigned int get_cols() const {
+        return n;
+    }
+
+    /**
+       @brief Get number of stored elements
+       @return std::size_t corresponding to number of stored elements
+    */
+    std::size_t get_stored() const {
+        return content->size();
+    }
+
+    /**
+       @brief Direct access to the packed array
+       @return pointer to the first stored element
+    */
+    T *data() {
+        return content->data();
+    }
+
+    const T *data() const {
+        return content->data();
+    }
+};
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Upper triangular matrix, packed by rows
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+class matrix<T, upper_triangular_matrix> : public matrix_detail::packed_base<T> {
+    friend class matrix<T, lower_triangular_matrix>;
+    typedef matrix_detail::packed_base<T> base;
+
+public:
+    typedef matrix_detail::packed_reference<T> reference;
+    typedef const_iterator_limited<T, upper_triangular_matrix> const_iterator;
+    typedef const_column_iterator<T, upper_triangular_matrix> const_col_iterator;
+
+protected:
+    matrix(unsigned int n, const std::shared_ptr<std::vector<T>> &c) : base(n, c) {}
+
+    std::size_t index(unsigned int r, unsigned int c) const {
+        return matrix_detail::packed_line(this->n, r) + (c - r);
+    }
+
+public:
+    /**
+       @brief Constructor given the size
+       Initialize a n x n matrix of zeros
+    */
+    matrix(unsigned int n = 0) : base(n, matrix_detail::triangle_size(n)) {}
+
+    /**
+       @brief Create a triangular matrix from the elements on and above the diagonal of a square matrix
+       @param other matrix to be copied, any decoration
+    */
+    template <typename type>
+    matrix(const matrix<T, type> &other) : base(other.get_rows(), matrix_detail::triangle_size(other.get_rows())) {
+        assert((other.get_rows() == other.get_cols()) && "The matrix must be square!");
+        for (unsigned int i = 0; i < this->n; ++i)
+            for (unsigned int j = i; j < this->n; ++j)
+                (*this->content)[index(i, j)] = other(i, j);
+    }
+
+    /**
+       @brief Operator() const
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return const T& to the element (zero below the diagonal)
+    */
+    const T &operator()(unsigned int r, unsigned int c) const {
+        assert((r < this->n && c < this->n) && "Out of bounds!");
+        return (c >= r) ? (*this->content)[index(r, c)] : this->zero;
+    }
+
+    /**
+       @brief Operator()
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return packed_reference to the element, reading zero (and not writable)
+       outside of the stored part
+    */
+    reference operator()(unsigned int r, unsigned int c) {
+        assert((r < this->n && c < this->n) && "Out of bounds!");
+        return reference((c >= r) ? &(*this->content)[index(r, c)] : nullptr, &this->zero);
+    }
+
+    /**
+       @brief Columns of row r that are stored
+       @return [first, last) columns
+    */
+    std::pair<unsigned int, unsigned int> stored_columns(unsigned int r) const {
+        return std::make_pair(r, this->n);
+    }
+
+    /**
+       @brief create the transpose of the current matrix: a lower triangular matrix sharing the same elements
+       @return trasposed matrix
+    */
+    matrix<T, lower_triangular_matrix> get_transpose() const {
+        return matrix<T, lower_triangular_matrix>(this->n, this->content);
+    }
+
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(*this, this->n, 0);
+    }
+
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, this->n);
+    }
+};
+
+
+/**
+ * @brief Lower triangular matrix, packed by columns
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+class matrix<T, lower_triangular_matrix> : public matrix_detail::packed_base<T> {
+    friend class matrix<T, upper_triangular_matrix>;
+    typedef matrix_detail::packed_base<T> base;
+
+public:
+    typedef matrix_detail::packed_reference<T> reference;
+    typedef const_iterator_limited<T, lower_triangular_matrix> const_iterator;
+    typedef const_column_iterator<T, lower_triangular_matrix> const_col_iterator;
+
+protected:
+    matrix(unsigned int n, const std::shared_ptr<std::vector<T>> &c) : base(n, c) {}
+
+    std::size_t index(unsigned int r, unsigned int c) const {
+        return matrix_detail::packed_line(this->n, c) + (r - c);
+    }
+
+public:
+    /**
+       @brief Constructor given the size
+       Initialize a n x n matrix of zeros
+    */
+    matrix(unsigned int n = 0) : base(n, matrix_detail::triangle_size(n)) {}
+
+    /**
+       @brief Create a triangular matrix from the elements on and below the diagonal of a square matrix
+       @param other matrix to be copied, any decoration
+    */
+    template <typename type>
+    matrix(const matrix<T, type> &other) : base(other.get_rows(), matrix_detail::triangle_size(other.get_rows())) {
+        assert((other.get_rows() == other.get_cols()) && "The matrix must be square!");
+        for (unsigned int j = 0; j < this->n; ++j)
+            for (unsigned int i = j; i < this->n; ++i)
+                (*this->content)[index(i, j)] = other(i, j);
+    }
+
+    /**
+       @brief Operator() const
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return const T& to the element (zero above the diagonal)
+    */
+    const T &operator()(unsigned int r, unsigned int c) const {
+        assert((r < this->n && c < this->n) && "Out of bounds!");
+        return (r >= c) ? (*this->content)[index(r, c)] : this->zero;
+    }
+
+    /**
+       @brief Operator()
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return packed_reference to the element, reading zero (and not writable)
+       outside of the stored part
+    */
+    reference operator()(unsigned int r, unsigned int c) {
+        assert((r < this->n && c < this->n) && "Out of bounds!");
+        return reference((r >= c) ? &(*this->content)[index(r, c)] : nullptr, &this->zero);
+    }
+
+    /**
+       @brief Columns of row r that are stored
+       @return [first, last) columns
+    */
+    std::pair<unsigned int, unsigned int> stored_columns(unsigned int r) const {
+        return std::make_pair(0u, r + 1);
+    }
+
+    /**
+       @brief create the transpose of the current matrix: an upper triangular matrix sharing the same elements
+       @return trasposed matrix
+    */
+    matrix<T, upper_triangular_matrix> get_transpose() const {
+        return matrix<T, upper_triangular_matrix>(this->n, this->content);
+    }
+
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(*this, this->n, 0);
+    }
+
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, this->n);
+    }
+};
+
+
+/**
+ * @brief Symmetric matrix, storing its upper triangle packed by rows
+ * (i.e. its lower triangle packed by columns)
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+class matrix<T, symmetric_matrix> : public matrix_detail::packed_base<T> {
+    typedef matrix_detail::packed_base<T> base;
+
+public:
+    typedef const_iterator_limited<T, symmetric_matrix> const_iterator;
+    typedef const_column_iterator<T, symmetric_matrix> const_col_iterator;
+
+protected:
+    std::size_t index(unsigned int r, unsigned int c) const {
+        return (r <= c) ? matrix_detail::packed_line(this->n, r) + (c - r)
+                        : matrix_detail::packed_line(this->n, c) + (r - c);
+    }
+
+public:
+    /**
+       @brief Constructor given the size
+       Initialize a n x n matrix of zeros
+    */
+    matrix(unsigned int n = 0) : base(n, matrix_detail::triangle_size(n)) {}
+
+    /**
+       @brief Create a symmetric matrix from the elements on and above the diagonal of a square matrix
+       @param other matrix to be copied, any decoration
+    */
+    template <typename type>
+    matrix(const matrix<T, type> &other) : base(other.get_rows(), matrix_detail::triangle_size(other.get_rows())) {
+        assert((other.get_rows() == other.get_cols()) && "The matrix must be square!");
+        for (unsigned int i = 0; i < this->n; ++i)
+            for (unsigned int j = i; j < this->n; ++j)
+                (*this->content)[index(i, j)] = other(i, j);
+    }
+
+    /**
+       @brief Operator() const
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return const T& to the element, the same as (c, r)
+    */
+    const T &operator()(unsigned int r, unsigned int c) const {
+        assert((r < this->n && c < this->n) && "Out of bounds!");
+        return (*this->content)[index(r, c)];
+    }
+
+    /**
+       @brief Operator()
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return T& to the element, the same as (c, r)
+    */
+    T &operator()(unsigned int r, unsigned int c) {
+        assert((r < this->n && c < this->n) && "Out of bounds!");
+        return (*this->content)[index(r, c)];
+    }
+
+    /**
+       @brief Columns of row r that are stored (all of them)
+       @return [first, last) columns
+    */
+    std::pair<unsigned int, unsigned int> stored_columns(unsigned int) const {
+        return std::make_pair(0u, this->n);
+    }
+
+    /**
+       @brief the transpose of a symmetric matrix is the matrix itself
+       @return a copy sharing the same elements
+    */
+    matrix get_transpose() const {
+        return *this;
+    }
+
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(*this, this->n, 0);
+    }
+
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, this->n);
+    }
+};
+
+
+/**
+ * @brief Banded matrix: element (r, c) is stored iff -kl <= c - r <= ku,
+ * in rows of kl + ku + 1 elements
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+class matrix<T, banded_matrix> : public matrix_detail::packed_base<T> {
+    typedef matrix_detail::packed_base<T> base;
+
+public:
+    typedef matrix_detail::packed_reference<T> reference;
+    typedef const_iterator_limited<T, banded_matrix> const_iterator;
+    typedef const_column_iterator<T, banded_matrix> const_col_iterator;
+
+protected:
+    unsigned int kl;  // diagonals below the main one, as stored
+    unsigned int ku;  // diagonals above the main one, as stored
+    bool transposed;  // rows and columns of the storage are swapped
+
+    bool stored(unsigned int r, unsigned int c) const {
+        long d = long(c) - long(r);
+        return d >= -long(get_lower_bandwidth()) && d <= long(get_upper_bandwidth());
+    }
+
+    std::size_t index(unsigned int r, unsigned int c) const {
+        if (transposed)
+            std::swap(r, c);
+        return std::size_t(r) * (kl + ku + 1) + (c + kl - r);
+    }
+
+public:
+    /**
+       @brief Constructor given the size and the bandwidths
+       Initialize a n x n matrix of zeros
+       @param n number of rows and columns
+       @param lower number of diagonals below the main one
+       @param upper number of diagonals above the main one
+    */
+    matrix(unsigned int n = 0, unsigned int lower = 0, unsigned int upper = 0) :
+            base(n, std::size_t(n) * (lower + upper + 1)), kl(lower), ku(upper), transposed(false) {}
+
+    /**
+       @brief Create a banded matrix from the elements of the band of a square matrix
+       @param other matrix to be copied, any decoration
+       @param lower number of diagonals below the main one
+       @param upper number of diagonals above the main one
+    */
+    template <typename type>
+    matrix(const matrix<T, type> &other, unsigned int lower, unsigned int upper) :
+            base(other.get_rows(), std::size_t(other.get_rows()) * (lower + upper + 1)),
+            kl(lower), ku(upper), transposed(false) {
+        assert((other.get_rows() == other.get_cols()) && "The matrix must be square!");
+        for (unsigned int i = 0; i < this->n; ++i) {
+            std::pair<unsigned int, unsigned int> columns = stored_columns(i);
+            for (unsigned int j = columns.first; j < columns.second; ++j)
+                (*this->content)[index(i, j)] = other(i, j);
+        }
+    }
+
+    /**
+       @brief Get number of diagonals below the main one
+    */
+    unsigned int get_lower_bandwidth() const {
+        return transposed ? ku : kl;
+    }
+
+    /**
+       @brief Get number of diagonals above the main one
+    */
+    unsigned int get_upper_bandwidth() const {
+        return transposed ? kl : ku;
+    }
+
+    /**
+       @brief Operator() const
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return const T& to the element (zero outside of the band)
+    */
+    const T &operator()(unsigned int r, unsigned int c) const {
+        assert((r < this->n && c < this->n) && "Out of bounds!");
+        return stored(r, c) ? (*this->content)[index(r, c)] : this->zero;
+    }
+
+    /**
+       @brief Operator()
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return packed_reference to the element, reading zero (and not writable)
+       outside of the stored part
+    */
+    reference operator()(unsigned int r, unsigned int c) {
+        assert((r < this->n && c < this->n) && "Out of bounds!");
+        return reference(stored(r, c) ? &(*this->content)[index(r, c)] : nullptr, &this->zero);
+    }
+
+    /**
+       @brief Columns of row r that are inside the band
+       @return [first, last) columns
+    */
+    std::pair<unsigned int, unsigned int> stored_columns(unsigned int r) const {
+        unsigned int lower = get_lower_bandwidth(), upper = get_upper_bandwidth();
+        unsigned int first = (r > lower) ? r - lower : 0;
+        unsigned int last = (this->n - r > upper) ? r + upper + 1 : this->n;
+        return std::make_pair(first, last);
+    }
+
+    /**
+       @brief create the transpose of the current matrix, sharing the same elements
+       @return trasposed matrix
+    */
+    matrix get_transpose() const {
+        matrix t = *this;
+        t.transposed = !transposed;
+        return t;
+    }
+
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(*this, this->n, 0);
+    }
+
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, this->n);
+    }
+};
+
+
+namespace matrix_detail {
+
+// zeros, then the stored elements of a packed matrix
+template <typename T, typename packed>
+void copy_packed(const packed &source, const strided_view<T, false> &destination) {
+    fill_zero(destination);
+    for (unsigned int i = 0; i < source.get_rows(); ++i) {
+        std::pair<unsigned int, unsigned int> columns = source.stored_columns(i);
+        for (unsigned int j = columns.first; j < columns.second; ++j)
+            destination.at(i, j) = source(i, j);
+    }
+}
+
+/**
+ * @brief C = alpha * A * B + beta * C with a packed A: row i of C only combines
+ * the rows of B selected by the stored columns of row i of A; rows of C are split
+ * among the threads
+ */
+template <typename T, typename packed, typename view_b>
+void packed_gemm(T alpha, const packed &A, const view_b &b, T beta,
+                 const strided_view<T, false> &c, thread_pool &pool) {
+    const unsigned int tasks = (c.rows < 4 * pool.get_threads()) ? c.rows : 4 * pool.get_threads();
+    const unsigned int block = (tasks == 0) ? 0 : (c.rows + tasks - 1) / tasks;
+    pool.parallel_for(tasks, [&](unsigned int t) {
+        unsigned int first = std::min(t * block, c.rows);
+        unsigned int last = std::min(first + block, c.rows);
+        for (unsigned int i = first; i < last; ++i) {
+            scale(c.sub(i, i + 1, 0, c.cols), beta);
+            if (alpha == T(0))
+                continue;
+            std::pair<unsigned int, unsigned int> columns = A.stored_columns(i);
+            for (unsigned int k = columns.first; k < columns.second; ++k) {
+                const T s = alpha * A(i, k);
+                for (unsigned int j = 0; j < c.cols; ++j)
+                    c.at(i, j) += s * b.at(k, j);
+            }
+        }
+    });
+}
+
+/**
+ * @brief X = A^-1 * X for a triangular A, by substitution; the columns of X
+ * (independent right-hand sides) are split among the threads
+ */
+template <typename T, typename triangular>
+void triangular_solve(const triangular &A, const strided_view<T, false> &x, bool upper, thread_pool &pool) {
+    const unsigned int n = A.get_rows();
+    const unsigned int tasks = (x.cols < 4 * pool.get_threads()) ? x.cols : 4 * pool.get_threads();
+    const unsigned int block = (tasks == 0) ? 0 : (x.cols + tasks - 1) / tasks;
+    pool.parallel_for(tasks, [&](unsigned int t) {
+        unsigned int first = std::min(t * block, x.cols);
+        unsigned int last = std::min(first + block, x.cols);
+        if (upper) {
+            // backward: row i of A is contiguous
+            for (unsigned int i = n; i-- > 0;) {
+                for (unsigned int k = i + 1; k < n; ++k) {
+                    const T a = A(i, k);
+                    for (unsigned int j = first; j < last; ++j)
+                        x.at(i, j) -= a * x.at(k, j);
+                }
+                assert((A(i, i) != T(0)) && "Singular matrix!");
+                for (unsigned int j = first; j < last; ++j)
+                    x.at(i, j) /= A(i, i);
+            }
+        }
+        else {
+            // forward: column k of A is contiguous
+            for (unsigned int k = 0; k < n; ++k) {
+                assert((A(k, k) != T(0)) && "Singular matrix!");
+                for (unsigned int j = first; j < last; ++j)
+                    x.at(k, j) /= A(k, k);
+                for (unsigned int i = k + 1; i < n; ++i) {
+                    const T a = A(i, k);
+                    for (unsigned int j = first; j < last; ++j)
+                        x.at(i, j) -= a * x.at(k, j);
+                }
+            }
+        }
+    });
+}
+
+// a new basic matrix holding a copy of B, which solve() overwrites with the solution
+template <typename T, typename type>
+matrix<T> right_hand_side(const matrix<T, type> &B, unsigned int n) {
+    assert((B.get_rows() == n) && "Incompatible sizes!");
+    matrix<T> X(B.get_rows(), B.get_cols());
+    copy_elements(B, X.get_view());
+    return X;
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * Conversion of packed matrices into basic matrices
+ */
+template <typename T>
+void copy_elements(const matrix<T, upper_triangular_matrix> &source, const strided_view<T, false> &destination) {
+    matrix_detail::copy_packed(source, destination);
+}
+
+template <typename T>
+void copy_elements(const matrix<T, lower_triangular_matrix> &source, const strided_view<T, false> &destination) {
+    matrix_detail::copy_packed(source, destination);
+}
+
+template <typename T>
+void copy_elements(const matrix<T, symmetric_matrix> &source, const strided_view<T, false> &destination) {
+    matrix_detail::copy_packed(source, destination);
+}
+
+template <typename T>
+void copy_elements(const matrix<T, banded_matrix> &source, const strided_view<T, false> &destination) {
+    matrix_detail::copy_packed(source, destination);
+}
+
+
+/**
+ * Packed times dense: C = alpha * A * B + beta * C, visiting the stored elements of A only
+ */
+template <typename T, typename typeB, typename typeC>
+void gemm(typename matrix_detail::non_deduced<T>::type alpha,
+          const matrix<T, upper_triangular_matrix> &A, const matrix<T, typeB> &B,
+          typename matrix_detail::non_deduced<T>::type beta,
+          matrix<T, typeC> &C, thread_pool &pool) {
+    static_assert(!is_structured<typeC>::value, "The result of gemm must be writable!");
+    assert((A.get_cols() == B.get_rows()) && "Incompatible sizes!");
+    assert((A.get_rows() == C.get_rows() && B.get_cols() == C.get_cols()) && "Incompatible sizes!");
+    matrix_detail::packed_gemm(T(alpha), A, B.get_view(), T(beta), C.get_view(), pool);
+}
+
+template <typename T, typename typeB, typename typeC>
+void gemm(typename matrix_detail::non_deduced<T>::type alpha,
+          const matrix<T, lower_triangular_matrix> &A, const matrix<T, typeB> &B,
+          typename matrix_detail::non_deduced<T>::type beta,
+          matrix<T, typeC> &C, thread_pool &pool) {
+    static_assert(!is_structured<typeC>::value, "The result of gemm must be writable!");
+    assert((A.get_cols() == B.get_rows()) && "Incompatible sizes!");
+    assert((A.get_rows() == C.get_rows() && B.get_cols() == C.get_cols()) && "Incompatible sizes!");
+    matrix_detail::packed_gemm(T(alpha), A, B.get_view(), T(beta), C.get_view(), pool);
+}
+
+template <typename T, typename typeB, typename typeC>
+void gemm(typename matrix_detail::non_deduced<T>::type alpha,
+          const matrix<T, symmetric_matrix> &A, const matrix<T, typeB> &B,
+          typename matrix_detail::non_deduced<T>::type beta,
+          matrix<T, typeC> &C, thread_pool &pool) {
+    static_assert(!is_structured<typeC>::value, "The result of gemm must be writable!");
+    assert((A.get_cols() == B.get_rows()) && "Incompatible sizes!");
+    assert((A.get_rows() == C.get_rows() && B.get_cols() == C.get_cols()) && "Incompatible sizes!");
+    matrix_detail::packed_gemm(T(alpha), A, B.get_view(), T(beta), C.get_view(), pool);
+}
+
+template <typename T, typename typeB, typename typeC>
+void gemm(typename matrix_detail::non_deduced<T>::type alpha,
+          const matrix<T, banded_matrix> &A, const matrix<T, typeB> &B,
+          typename matrix_detail::non_deduced<T>::type beta,
+          matrix<T, typeC> &C, thread_pool &pool) {
+    static_assert(!is_structured<typeC>::value, "The result of gemm must be writable!");
+    assert((A.get_cols() == B.get_rows()) && "Incompatible sizes!");
+    assert((A.get_rows() == C.get_rows() && B.get_cols() == C.get_cols()) && "Incompatible sizes!");
+    matrix_detail::packed_gemm(T(alpha), A, B.get_view(), T(beta), C.get_view(), pool);
+}
+
+
+/**
+ * @brief Cholesky factorization of a symmetric positive definite matrix: A = L * L^T
+ * L has the same packed layout as A, so its columns are updated in place,
+ * right-looking, each one being contiguous
+ * @param A symmetric positive definite matrix
+ * @return the lower triangular factor L
+ */
+template <typename T>
+matrix<T, lower_triangular_matrix> cholesky(const matrix<T, symmetric_matrix> &A) {
+    const unsigned int n = A.get_rows();
+    matrix<T, lower_triangular_matrix> L(n);
+    T *l = L.data();
+    std::copy(A.data(), A.data() + A.get_stored(), l);
+    for (unsigned int j = 0; j < n; ++j) {
+        T *column = l + matrix_detail::packed_line(n, j); // column[i - j] == L(i, j)
+        assert((column[0] > T(0)) && "The matrix is not positive definite!");
+        const T d = std::sqrt(column[0]);
+        column[0] = d;
+        for (unsigned int i = 1; i < n - j; ++i)
+            column[i] /= d;
+        for (unsigned int k = j + 1; k < n; ++k) {
+            T *trailing = l + matrix_detail::packed_line(n, k);
+            const T f = column[k - j];
+            for (unsigned int i = k; i < n; ++i)
+                trailing[i - k] -= column[i - j] * f;
+        }
+    }
+    return L;
+}
+
+
+/**
+ * @brief Solve A * X = B for an upper triangular A (backward substitution)
+ * @param A upper triangular matrix, without zeros on the diagonal
+ * @param B right-hand sides, any matrix with as many rows as A
+ * @param pool threads solving the columns of B
+ * @return a new basic matrix containing X
+ */
+template <typename T, typename typeB>
+matrix<T> solve(const matrix<T, upper_triangular_matrix> &A, const matrix<T, typeB> &B, thread_pool &pool) {
+    matrix<T> X = matrix_detail::right_hand_side(B, A.get_rows());
+    matrix_detail::triangular_solve(A, X.get_view(), true, pool);
+    return X;
+}
+
+/**
+ * @brief Solve A * X = B for a lower triangular A (forward substitution)
+ */
+template <typename T, typename typeB>
+matrix<T> solve(const matrix<T, lower_triangular_matrix> &A, const matrix<T, typeB> &B, thread_pool &pool) {
+    matrix<T> X = matrix_detail::right_hand_side(B, A.get_rows());
+    matrix_detail::triangular_solve(A, X.get_view(), false, pool);
+    return X;
+}
+
+/**
+ * @brief Solve A * X = B for a symmetric positive definite A: A = L * L^T
+ * (see cholesky), then two triangular solves
+ */
+template <typename T, typename typeB>
+matrix<T> solve(const matrix<T, symmetric_matrix> &A, const matrix<T, typeB> &B, thread_pool &pool) {
+    matrix<T, lower_triangular_matrix> L = cholesky(A);
+    matrix<T> X = matrix_detail::right_hand_side(B, A.get_rows());
+    matrix_detail::triangular_solve(L, X.get_view(), false, pool);
+    matrix_detail::triangular_solve(L.get_transpose(), X.get_view(), true, pool);
+    return X;
+}
+
+/**
+ * @brief Solve A * X = B for a banded A: Gaussian elimination with partial
+ * pivoting, which only widens the upper band (by kl), then backward substitution;
+ * O(n * kl * (kl + ku)) plus O(n * (kl + ku)) per right-hand side
+ */
+template <typename T, typename typeB>
+matrix<T> solve(const matrix<T, banded_matrix> &A, const matrix<T, typeB> &B, thread_pool &) {
+    const unsigned int n = A.get_rows();
+    const unsigned int kl = A.get_lower_bandwidth(), ku = A.get_upper_bandwidth() + kl;
+    const std::size_t width = std::size_t(kl) + ku + 1;
+    // the band widened by pivoting: W(i, j) with -kl <= j - i <= ku
+    std::vector<T> w(std::size_t(n) * width, T(0));
+    auto at = [&](unsigned int i, unsigned int j) -> T & {
+        return w[std::size_t(i) * width + (j + kl - i)];
+    };
+    for (unsigned int i = 0; i < n; ++i) {
+        std::pair<unsigned int, unsigned int> columns = A.stored_columns(i);
+        for (unsigned int j = columns.first; j < columns.second; ++j)
+            at(i, j) = A(i, j);
+    }
+    matrix<T> X = matrix_detail::right_hand_side(B, n);
+    const unsigned int m = X.get_cols();
+    for (unsigned int k = 0; k < n; ++k) {
+        const unsigned int last_row = (n - k > kl) ? k + kl + 1 : n;
+        const unsigned int last_col = (n - k > ku) ? k + ku + 1 : n;
+        unsigned int p = k;
+        for (unsigned int i = k + 1; i < last_row; ++i)
+            if (std::abs(at(i, k)) > std::abs(at(p, k)))
+                p = i;
+        assert((at(p, k) != T(0)) && "Singular matrix!");
+        if (p != k) {
+            for (unsigned int j = k; j < last_col; ++j)
+                std::swap(at(k, j), at(p, j));
+            for (unsigned int j = 0; j < m; ++j)
+                std::swap(X(k, j), X(p, j));
+        }
+        for (unsigned int i = k + 1; i < last_row; ++i) {
+            const T f = at(i, k) / at(k, k);
+            if (f == T(0))
+                continue;
+            for (unsigned int j = k + 1; j < last_col; ++j)
+                at(i, j) -= f * at(k, j);
+            for (unsigned int j = 0; j < m; ++j)
+                X(i, j) -= f * X(k, j);
+        }
+    }
+    for (unsigned int i = n; i-- > 0;) {
+        const unsigned int last_col = (n - i > ku) ? i + ku + 1 : n;
+        for (unsigned int k = i + 1; k < last_col; ++k)
+            for (unsigned int j = 0; j < m; ++j)
+                X(i, j) -= at(i, k) * X(k, j);
+        for (unsigned int j = 0; j < m; ++j)
+            X(i, j) /= at(i, i);
+    }
+    return X;
+}
+
+/**
+ * @brief Solve A * X = B on the default thread pool
+ */
+template <typename T, typename typeA, typename typeB>
+matrix<T> solve(const matrix<T, typeA> &A, const matrix<T, typeB> &B) {
+    return solve(A, B, thread_pool::get_default());
+}
+
+
+#endif
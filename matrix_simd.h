@@ -0,0 +1,576 @@
+#ifndef MATRIX_SIMD_H
+#define MATRIX_SIMD_H
+
+#include "matrix.h"
+#include "matrix_expression.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+
+/**
+ * Vectorized element-wise kernels (add, subtract, scale, fma, min, max) for
+ * float, double and int32_t.
+ *
+ * Each kernel is written once, on GCC vector types of a given width, and compiled
+ * three times: for SSE2 (16 bytes), AVX2 (32 bytes) and AVX-512 (64 bytes), each
+ * version carrying its own `target` attribute. The widest version supported by
+ * the CPU is chosen the first time the kernels of a type are needed, so a single
+ * binary built for the baseline x86-64 still uses the whole width of the machine
+ * it runs on. Other architectures and compilers get the scalar loops only.
+ *
+ * The kernels work on contiguous rows: they are used whenever every operand has
+ * unit column stride (basic matrices, submatrices and transposes of transposes),
+ * the other views fall back to a scalar loop over their descriptors.
+ */
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_SIMD_X86 1
+#else
+#define MATRIX_SIMD_X86 0
+#endif
+
+
+namespace matrix_simd {
+
+/**
+ * @brief Instruction sets the kernels are compiled for
+ */
+enum simd_level {
+    level_scalar = 0,
+    level_sse2 = 1,
+    level_avx2 = 2,
+    level_avx512 = 3
+};
+
+/**
+ * @brief Tells whether vectorized kernels exist for T
+ */
+template <typename T>
+struct simd_supported {
+    static const bool value = false;
+};
+
+template <>
+struct simd_supported<float> {
+    static const bool value = true;
+};
+
+template <>
+struct simd_supported<double> {
+    static const bool value = true;
+};
+
+template <>
+struct simd_supported<std::int32_t> {
+    static const bool value = true;
+};
+
+
+/**
+ * Operations, applied either to single elements or to GCC vectors of elements
+ */
+struct add_kernel {
+    template <typename V>
+    static void apply(V &out, const V &a, const V &b) {
+        out = a + b;
+    }
+};
+
+struct subtract_kernel {
+    template <typename V>
+    static void apply(V &out, const V &a, const V &b) {
+        out = a - b;
+    }
+};
+
+struct min_kernel {
+    template <typename V>
+    static void apply(V &out, const V &a, const V &b) {
+        out = (b < a) ? b : a;
+    }
+};
+
+struct max_kernel {
+    template <typename V>
+    static void apply(V &out, const V &a, const V &b) {
+        out = (a < b) ? b : a;
+    }
+};
+
+
+/**
+ * @brief GCC vector of `bytes / sizeof(T)` elements of type T
+ */
+template <typename T, unsigned int bytes>
+struct pack {
+    typedef T type __attribute__((vector_size(bytes)));
+};
+
+// the loops are always inlined into the entry points below, which set the instruction set
+
+template <unsigned int bytes, typename operation, typename T>
+inline __attribute__((always_inline))
+void binary_loop(const T *a, const T *b, T *out, std::size_t n) {
+    typedef typename pack<T, bytes>::type V;
+    const std::size_t width = bytes / sizeof(T);
+    std::size_t i = 0;
+    for (; i + width <= n; i += width) {
+        V x, y, z;
+        std::memcpy(&x, a + i, bytes);
+        std::memcpy(&y, b + i, bytes);
+        operation::apply(z, x, y);
+        std::memcpy(out + i, &z, bytes);
+    }
+    for (; i < n; ++i)
+        operation::apply(out[i], a[i], b[i]);
+}
+
+template <unsigned int bytes, typename T>
+inline __attribute__((always_inline))
+void scale_loop(const T *a, T s, T *out, std::size_t n) {
+    typedef typename pack<T, bytes>::type V;
+    const std::size_t width = bytes / sizeof(T);
+    V factor = V() + s;
+    std::size_t i = 0;
+    for (; i + width <= n; i += width) {
+        V x;
+        std::memcpy(&x, a + i, bytes);
+        x *= factor;
+        std::memcpy(out + i, &x, bytes);
+    }
+    for (; i < n; ++i)
+        out[i] = a[i] * s;
+}
+
+template <unsigned int bytes, typename T>
+inline __attribute__((always_inline))
+void fma_loop(const T *a, const T *b, const T *c, T *out, std::size_t n) {
+    typedef typename pack<T, bytes>::type V;
+    const std::size_t width = bytes / sizeof(T);
+    std::size_t i = 0;
+    for (; i + width <= n; i += width) {
+        V x, y, z;
+        std::memcpy(&x, a + i, bytes);
+        std::memcpy(&y, b + i, bytes);
+        std::memcpy(&z, c + i, bytes);
+        z += x * y;
+        std::memcpy(out + i, &z, bytes);
+    }
+    for (; i < n; ++i)
+        out[i] = a[i] * b[i] + c[i];
+}
+
+
+/**
+ * @brief Scalar kernels, used where no vector version is available
+ */
+template <typename operation, typename T>
+void binary_scalar(const T *a, const T *b, T *out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+        operation::apply(out[i], a[i], b[i]);
+}
+
+template <typename T>
+void scale_scalar(const T *a, T s, T *out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] = a[i] * s;
+}
+
+template <typename T>
+void fma_scalar(const T *a, const T *b, const T *c, T *out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] = a[i] * b[i] + c[i];
+}
+
+#if MATRIX_SIMD_X86
+
+template <typename operation, typename T>
+void binary_sse2(const T *a, const T *b, T *out, std::size_t n) {
+    binary_loop<16, operation>(a, b, out, n);
+}
+
+template <typename T>
+void scale_sse2(const T *a, T s, T *out, std::size_t n) {
+    scale_loop<16>(a, s, out, n);
+}
+
+template <typename T>
+void fma_sse2(const T *a, const T *b, const T *c, T *out, std::size_t n) {
+    fma_loop<16>(a, b, c, out, n);
+}
+
+template <typename operation, typename T>
+__attribute__((target("avx2")))
+void binary_avx2(const T *a, const T *b, T *out, std::size_t n) {
+    binary_loop<32, operation>(a, b, out, n);
+}
+
+template <typename T>
+__attribute__((target("avx2")))
+void scale_avx2(const T *a, T s, T *out, std::size_t n) {
+    scale_loop<32>(a, s, out, n);
+}
+
+template <typename T>
+__attribute__((target("avx2,fma")))
+void fma_avx2(const T *a, const T *b, const T *c, T *out, std::size_t n) {
+    fma_loop<32>(a, b, c, out, n);
+}
+
+template <typename operation, typename T>
+__attribute__((target("avx512f")))
+void binary_avx512(const T *a, const T *b, T *out, std::size_t n) {
+    binary_loop<64, operation>(a, b, out, n);
+}
+
+template <typename T>
+__attribute__((target("avx512f")))
+void scale_avx512(const T *a, T s, T *out, std::size_t n) {
+    scale_loop<64>(a, s, out, n);
+}
+
+template <typename T>
+__attribute__((target("avx512f")))
+void fma_avx512(const T *a, const T *b, const T *c, T *out, std::size_t n) {
+    fma_loop<64>(a, b, c, out, n);
+}
+
+#endif
+
+
+/**
+ * @brief Entry points of the kernels of a given instruction set.
+ * All of them work on n contiguous elements; out may coincide with an input,
+ * but must not partially overlap it.
+ */
+template <typename T>
+struct kernel_table {
+    simd_level level;
+    void (*add)(const T *, const T *, T *, std::size_t);
+    void (*subtract)(const T *, const T *, T *, std::size_t);
+    void (*min)(const T *, const T *, T *, std::size_t);
+    void (*max)(const T *, const T *, T *, std::size_t);
+    void (*scale)(const T *, T, T *, std::size_t);
+    void (*fma)(const T *, const T *, const T *, T *, std::size_t);
+};
+
+/**
+ * @brief Widest instruction set supported by the running CPU
+ */
+inline simd_level detect_level() {
+#if MATRIX_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return level_avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return level_avx2;
+    return level_sse2;
+#else
+    return level_scalar;
+#endif
+}
+
+/**
+ * @brief Kernels for a given instruction set, which must be supported by the CPU
+ * @param level instruction set (see detect_level)
+ * @return table of entry points
+ */
+template <typename T>
+kernel_table<T> kernels_for(simd_level level) {
+    static_assert(simd_supported<T>::value, "No vectorized kernels for this type!");
+    assert((level <= detect_level()) && "Instruction set not supported by this CPU!");
+#if MATRIX_SIMD_X86
+    if (level == level_avx512) {
+        kernel_table<T> table = {level,
+                                 &binary_avx512<add_kernel, T>, &binary_avx512<subtract_kernel, T>,
+                                 &binary_avx512<min_kernel, T>, &binary_avx512<max_kernel, T>,
+                                 &scale_avx512<T>, &fma_avx512<T>};
+        return table;
+    }
+    if (level == level_avx2) {
+        kernel_table<T> table = {level,
+                                 &binary_avx2<add_kernel, T>, &binary_avx2<subtract_kernel, T>,
+                                 &binary_avx2<min_kernel, T>, &binary_avx2<max_kernel, T>,
+                                 &scale_avx2<T>, &fma_avx2<T>};
+        return table;
+    }
+    if (level == level_sse2) {
+        kernel_table<T> table = {level,
+                                 &binary_sse2<add_kernel, T>, &binary_sse2<subtract_kernel, T>,
+                                 &binary_sse2<min_kernel, T>, &binary_sse2<max_kernel, T>,
+                                 &scale_sse2<T>, &fma_sse2<T>};
+        return table;
+    }
+#endif
+    kernel_table<T> table = {level_scalar,
+                             &binary_scalar<add_kernel, T>, &binary_scalar<subtract_kernel, T>,
+                             &binary_scalar<min_kernel, T>, &binary_scalar<max_kernel, T>,
+                             &scale_scalar<T>, &fma_scalar<T>};
+    return table;
+}
+
+/**
+ * @brief Kernels for the widest instruction set of the CPU, selected once
+ * @return table of entry points
+ */
+template <typename T>
+const kernel_table<T> &kernels() {
+    static const kernel_table<T> table = kernels_for<T>(detect_level());
+    return table;
+}
+
+} // namespace matrix_simd
+
+
+namespace matrix_detail {
+
+// the kernels of T, or nullptr if T has none
+template <typename T, bool supported = matrix_simd::simd_supported<T>::value>
+struct simd_table {
+    static const matrix_simd::kernel_table<T> *get() {
+        return nullptr;
+    }
+};
+
+template <typename T>
+struct simd_table<T, true> {
+    static const matrix_simd::kernel_table<T> *get() {
+        return &matrix_simd::kernels<T>();
+    }
+};
+
+// address of row r if the view stores it contiguously, nullptr otherwise
+template <typename T>
+T *contiguous_row(const strided_view<T, false> &v, unsigned int r) {
+    return (v.col_stride == 1 || v.cols <= 1) ? v.base + r * v.row_stride : nullptr;
+}
+
+template <typename view>
+std::nullptr_t contiguous_row(const view &, unsigned int) {
+    return nullptr;
+}
+
+// true iff the rows of the view follow each other without gaps
+template <typename T>
+bool contiguous(const strided_view<T, false> &v) {
+    return (v.col_stride == 1 || v.cols <= 1) && (v.row_stride == std::ptrdiff_t(v.cols) || v.rows <= 1);
+}
+
+template <typename view>
+bool contiguous(const view &) {
+    return false;
+}
+
+// true iff the columns of the view follow each other without gaps (e.g. column-major)
+template <typename T>
+bool column_contiguous(const strided_view<T, false> &v) {
+    return contiguous(v.transposed());
+}
+
+template <typename view>
+bool column_contiguous(const view &) {
+    return false;
+}
+
+// address of element (0, 0) of a dense view, nullptr for the other views
+template <typename T>
+T *first_element(const strided_view<T, false> &v) {
+    return v.base;
+}
+
+template <typename view>
+std::nullptr_t first_element(const view &) {
+    return nullptr;
+}
+
+/**
+ * @brief out = a (operation) b, row by row: vectorized where every row is contiguous,
+ * or in a single pass when the three matrices are stored densely in the same order
+ */
+template <typename T, typename operation, typename view_a, typename view_b>
+void binary_rows(const view_a &a, const view_b &b, const strided_view<T, false> &out,
+                 void (*kernel)(const T *, const T *, T *, std::size_t)) {
+    if (kernel && ((contiguous(a) && contiguous(b) && contiguous(out)) ||
+                   (column_contiguous(a) && column_contiguous(b) && column_contiguous(out)))) {
+        kernel(first_element(a), first_element(b), out.base, std::size_t(out.rows) * out.cols);
+        return;
+    }
+    for (unsigned int r = 0; r < out.rows; ++r) {
+        const T *ra = contiguous_row(a, r), *rb = contiguous_row(b, r);
+        T *ro = contiguous_row(out, r);
+        if (kernel && ra && rb && ro) {
+            kernel(ra, rb, ro, out.cols);
+            continue;
+        }
+        for (unsigned int c = 0; c < out.cols; ++c) {
+            T x = a.at(r, c), y = b.at(r, c);
+            operation::apply(out.at(r, c), x, y);
+        }
+    }
+}
+
+/**
+ * @brief out = a * s, row by row: vectorized where every row is contiguous,
+ * or in a single pass when both matrices are stored densely in the same order
+ */
+template <typename T, typename view_a>
+void scale_rows(const view_a &a, T s, const strided_view<T, false> &out,
+                void (*kernel)(const T *, T, T *, std::size_t)) {
+    if (kernel && ((contiguous(a) && contiguous(out)) || (column_contiguous(a) && column_contiguous(out)))) {
+        kernel(first_element(a), s, out.base, std::size_t(out.rows) * out.cols);
+        return;
+    }
+    for (unsigned int r = 0; r < out.rows; ++r) {
+        const T *ra = contiguous_row(a, r);
+        T *ro = contiguous_row(out, r);
+        if (kernel && ra && ro) {
+            kernel(ra, s, ro, out.cols);
+            continue;
+        }
+        for (unsigned int c = 0; c < out.cols; ++c)
+            out.at(r, c) = a.at(r, c) * s;
+    }
+}
+
+/**
+ * @brief out = a * b + c, row by row: vectorized where every row is contiguous
+ */
+template <typename T, typename view_a, typename view_b, typename view_c>
+void fma_rows(const view_a &a, const view_b &b, const view_c &c, const strided_view<T, false> &out,
+              void (*kernel)(const T *, const T *, const T *, T *, std::size_t)) {
+    for (unsigned int r = 0; r < out.rows; ++r) {
+        const T *ra = contiguous_row(a, r), *rb = contiguous_row(b, r), *rc = contiguous_row(c, r);
+        T *ro = contiguous_row(out, r);
+        if (kernel && ra && rb && rc && ro) {
+            kernel(ra, rb, rc, ro, out.cols);
+            continue;
+        }
+        for (unsigned int j = 0; j < out.cols; ++j)
+            out.at(r, j) = a.at(r, j) * b.at(r, j) + c.at(r, j);
+    }
+}
+
+template <typename T>
+const matrix_simd::kernel_table<T> *simd_kernels() {
+    return simd_table<T>::get();
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Element-wise sum: out = a + b
+ * @param a left operand, any decoration
+ * @param b right operand, any decoration
+ * @param out result: a basic matrix or a writable view of one, same size as the operands
+ */
+template <typename T, typename typeA, typename typeB, typename typeOut>
+void add(const matrix<T, typeA> &a, const matrix<T, typeB> &b, matrix<T, typeOut> &out) {
+    static_assert(!is_structured<typeOut>::value, "The result must be writable!");
+    assert((a.get_rows() == out.get_rows() && a.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    assert((b.get_rows() == out.get_rows() && b.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    const matrix_simd::kernel_table<T> *k = matrix_detail::simd_kernels<T>();
+    matrix_detail::binary_rows<T, matrix_simd::add_kernel>(a.get_view(), b.get_view(), out.get_view(),
+                                                           k ? k->add : nullptr);
+}
+
+/**
+ * @brief Element-wise difference: out = a - b
+ */
+template <typename T, typename typeA, typename typeB, typename typeOut>
+void subtract(const matrix<T, typeA> &a, const matrix<T, typeB> &b, matrix<T, typeOut> &out) {
+    static_assert(!is_structured<typeOut>::value, "The result must be writable!");
+    assert((a.get_rows() == out.get_rows() && a.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    assert((b.get_rows() == out.get_rows() && b.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    const matrix_simd::kernel_table<T> *k = matrix_detail::simd_kernels<T>();
+    matrix_detail::binary_rows<T, matrix_simd::subtract_kernel>(a.get_view(), b.get_view(), out.get_view(),
+                                                                k ? k->subtract : nullptr);
+}
+
+/**
+ * @brief Element-wise minimum: out = min(a, b)
+ */
+template <typename T, typename typeA, typename typeB, typename typeOut>
+void min(const matrix<T, typeA> &a, const matrix<T, typeB> &b, matrix<T, typeOut> &out) {
+    static_assert(!is_structured<typeOut>::value, "The result must be writable!");
+    assert((a.get_rows() == out.get_rows() && a.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    assert((b.get_rows() == out.get_rows() && b.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    const matrix_simd::kernel_table<T> *k = matrix_detail::simd_kernels<T>();
+    matrix_detail::binary_rows<T, matrix_simd::min_kernel>(a.get_view(), b.get_view(), out.get_view(),
+                                                           k ? k->min : nullptr);
+}
+
+/**
+ * @brief Element-wise maximum: out = max(a, b)
+ */
+template <typename T, typename typeA, typename typeB, typename typeOut>
+void max(const matrix<T, typeA> &a, const matrix<T, typeB> &b, matrix<T, typeOut> &out) {
+    static_assert(!is_structured<typeOut>::value, "The result must be writable!");
+    assert((a.get_rows() == out.get_rows() && a.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    assert((b.get_rows() == out.get_rows() && b.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    const matrix_simd::kernel_table<T> *k = matrix_detail::simd_kernels<T>();
+    matrix_detail::binary_rows<T, matrix_simd::max_kernel>(a.get_view(), b.get_view(), out.get_view(),
+                                                           k ? k->max : nullptr);
+}
+
+/**
+ * @brief Product by a scalar: out = a * s
+ */
+template <typename T, typename typeA, typename typeOut>
+void scale(const matrix<T, typeA> &a, typename matrix_detail::non_deduced<T>::type s, matrix<T, typeOut> &out) {
+    static_assert(!is_structured<typeOut>::value, "The result must be writable!");
+    assert((a.get_rows() == out.get_rows() && a.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    const matrix_simd::kernel_table<T> *k = matrix_detail::simd_kernels<T>();
+    matrix_detail::scale_rows(a.get_view(), s, out.get_view(), k ? k->scale : nullptr);
+}
+
+/**
+ * @brief Element-wise multiply-add: out = a * b + c, where * is the element-wise product
+ */
+template <typename T, typename typeA, typename typeB, typename typeC, typename typeOut>
+void fma(const matrix<T, typeA> &a, const matrix<T, typeB> &b, const matrix<T, typeC> &c, matrix<T, typeOut> &out) {
+    static_assert(!is_structured<typeOut>::value, "The result must be writable!");
+    assert((a.get_rows() == out.get_rows() && a.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    assert((b.get_rows() == out.get_rows() && b.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    assert((c.get_rows() == out.get_rows() && c.get_cols() == out.get_cols()) && "Incompatible sizes!");
+    const matrix_simd::kernel_table<T> *k = matrix_detail::simd_kernels<T>();
+    matrix_detail::fma_rows(a.get_view(), b.get_view(), c.get_view(), out.get_view(), k ? k->fma : nullptr);
+}
+
+
+/**
+ * Evaluation of the simplest expressions (a + b, a - b, a * s) into a basic matrix
+ * goes through the kernels above; deeper trees are evaluated element by element.
+ */
+template <typename T, typename typeL, typename typeR>
+void copy_elements(const matrix<T, binary_expression<add_op, typeL, typeR>> &source,
+                   const strided_view<T, false> &destination) {
+    const matrix_simd::kernel_table<T> *k = matrix_detail::simd_kernels<T>();
+    matrix_detail::binary_rows<T, matrix_simd::add_kernel>(source.get_left().get_view(),
+                                                           source.get_right().get_view(),
+                                                           destination, k ? k->add : nullptr);
+}
+
+template <typename T, typename typeL, typename typeR>
+void copy_elements(const matrix<T, binary_expression<subtract_op, typeL, typeR>> &source,
+                   const strided_view<T, false> &destination) {
+    const matrix_simd::kernel_table<T> *k = matrix_detail::simd_kernels<T>();
+    matrix_detail::binary_rows<T, matrix_simd::subtract_kernel>(source.get_left().get_view(),
+                                                                source.get_right().get_view(),
+                                                                destination, k ? k->subtract : nullptr);
+}
+
+template <typename T, typename type>
+void copy_elements(const matrix<T, unary_expression<scale_op<T>, type>> &source,
+                   const strided_view<T, false> &destination) {
+    const matrix_simd::kernel_table<T> *k = matrix_detail::simd_kernels<T>();
+    matrix_detail::scale_rows(source.get_operand().get_view(), source.get_operation().factor,
+                              destination, k ? k->scale : nullptr);
+}
+
+
+#endif
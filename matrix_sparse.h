@@ -0,0 +1,892 @@
+#ifndef MATRIX_SPARSE_H
+#define MATRIX_SPARSE_H
+
+#include "matrix.h"
+#include "matrix_gemm.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+
+/**
+ * Sparse matrices store only their non-zero elements:
+ *
+ *  - matrix<T, csr_matrix> (compressed sparse rows): for each row, the columns
+ *    and the values of its elements; fast products and row access;
+ *  - matrix<T, csc_matrix> (compressed sparse columns): the same, by column;
+ *  - matrix<T, coo_matrix> (coordinate list): (row, column, value) triplets in
+ *    any order, meant to build a matrix one element at a time and then convert it.
+ *
+ * The CSR arrays of A are the CSC arrays of A^T, so get_transpose() of a CSR
+ * matrix is a CSC matrix sharing the same arrays, and vice versa. As for the
+ * basic matrix, copies share the arrays too. Sparse matrices are read-only
+ * through operator(); converting them to a basic matrix (or building them from
+ * any matrix) copies the elements.
+ *
+ * gemm (and operator*) with a CSR or CSC left operand and a dense right operand
+ * multiplies on a thread_pool; a right operand with one column is a sparse
+ * matrix-vector product.
+ */
+
+
+namespace matrix_detail {
+
+/**
+ * @brief Arrays of a CSR (or CSC) matrix: "lines" are its rows (or columns)
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+struct compressed_storage {
+    std::vector<std::size_t> offsets;  // the elements of line i are [offsets[i], offsets[i + 1])
+    std::vector<unsigned int> indices; // column (or row) of each element, increasing along a line
+    std::vector<T> values;             // value of each element
+};
+
+/**
+ * @brief The triplets of a COO matrix
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+struct coordinate_storage {
+    std::vector<unsigned int> rows;
+    std::vector<unsigned int> cols;
+    std::vector<T> values;
+};
+
+/**
+ * @brief group the elements of compressed storage by their other index
+ * (i.e. CSR <-> CSC of the same matrix) with a counting sort, which keeps the
+ * indices along each new line increasing
+ * @param s compressed storage
+ * @param n_lines number of lines of the result
+ * @return new compressed storage
+ */
+template <typename T>
+std::shared_ptr<compressed_storage<T>> recompress(const compressed_storage<T> &s, unsigned int n_lines) {
+    std::shared_ptr<compressed_storage<T>> r = std::make_shared<compressed_storage<T>>();
+    const std::size_t nnz = s.values.size();
+    r->offsets.assign(std::size_t(n_lines) + 1, 0);
+    r->indices.resize(nnz);
+    r->values.resize(nnz);
+    for (std::size_t k = 0; k < nnz; ++k)
+        ++r->offsets[s.indices[k] + 1];
+    for (unsigned int i = 0; i < n_lines; ++i)
+        r->offsets[i + 1] += r->offsets[i];
+    std::vector<std::size_t> next(r->offsets.begin(), r->offsets.end() - 1);
+    const unsigned int old_lines = static_cast<unsigned int>(s.offsets.size() - 1);
+    for (unsigned int line = 0; line < old_lines; ++line)
+        for (std::size_t k = s.offsets[line]; k < s.offsets[line + 1]; ++k) {
+            std::size_t d = next[s.indices[k]]++;
+            r->indices[d] = line;
+            r->values[d] = s.values[k];
+        }
+    return r;
+}
+
+/**
+ * @brief compressed storage from (line, index, value) triplets in any order;
+ * the values of repeated positions are summed
+ * @param n_lines number of lines
+ * @param n_indices range of the indices
+ */
+template <typename T>
+std::shared_ptr<compressed_storage<T>> compress(unsigned int n_lines, unsigned int n_indices,
+                                                const std::vector<unsigned int> &lines,
+                                                const std::vector<unsigned int> &indices,
+                                                const std::vector<T> &values) {
+    // group by index first: grouping the result by line then sorts each line
+    compressed_storage<T> by_index;
+    by_index.offsets.assign(std::size_t(n_indices) + 1, 0);
+    by_index.indices.resize(values.size());
+    by_index.values.resize(values.size());
+    for (std::size_t k = 0; k < values.size(); ++k)
+        ++by_index.offsets[indices[k] + 1];
+    for (unsigned int i = 0; i < n_indices; ++i)
+        by_index.offsets[i + 1] += by_index.offsets[i];
+    std::vector<std::size_t> next(by_index.offsets.begin(), by_index.offsets.end() - 1);
+    for (std::size_t k = 0; k < values.size(); ++k) {
+        std::size_t d = next[indices[k]]++;
+        by_index.indices[d] = lines[k];
+        by_index.values[d] = values[k];
+    }
+    std::shared_ptr<compressed_storage<T>> r = recompress(by_index, n_lines);
+    // sum the duplicates, which are now next to each other
+    std::size_t w = 0, begin = 0;
+    for (unsigned int line = 0; line < n_lines; ++line) {
+        std::size_t first = w, end = r->offsets[line + 1];
+        for (std::size_t k = begin; k < end; ++k) {
+            if (w > first && r->indices[w - 1] == r->indices[k]) {
+                r->values[w - 1] += r->values[k];
+            }
+            else {
+                r->indices[w] = r->indices[k];
+                r->values[w] = r->values[k];
+                ++w;
+            }
+        }
+        r->offsets[line] = first;
+        begin = end;
+    }
+    r->offsets[n_lines] = w;
+    r->indices.resize(w);
+    r->values.resize(w);
+    return r;
+}
+
+/**
+ * @brief split the lines of compressed storage in `parts` chunks holding
+ * about the same number of elements
+ * @return boundaries b: chunk t holds the lines [b[t], b[t + 1])
+ */
+inline std::vector<unsigned int> balanced_chunks(const std::vector<std::size_t> &offsets, unsigned int parts) {
+    const unsigned int n = static_cast<unsigned int>(offsets.size() - 1);
+    std::vector<unsigned int> bounds(1, 0);
+    for (unsigned int t = 1; t < parts; ++t) {
+        std::size_t target = offsets.back() / parts * t;
+        unsigned int line = static_cast<unsigned int>(
+                std::upper_bound(offsets.begin(), offsets.end(), target) - offsets.begin() - 1);
+        if (line > bounds.back() && line < n)
+            bounds.push_back(line);
+    }
+    bounds.push_back(n);
+    return bounds;
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Sparse matrix in compressed sparse row format
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+class matrix<T, csr_matrix> {
+    friend class matrix<T, csc_matrix>;
+
+public:
+    typedef matrix_detail::compressed_storage<T> storage_type;
+    typedef const_iterator_limited<T, csr_matrix> const_iterator;
+    typedef const_column_iterator<T, csr_matrix> const_col_iterator;
+
+protected:
+    unsigned int n_rows;
+    unsigned int n_cols;
+    std::shared_ptr<storage_type> content;
+    T zero; // returned for the elements that are not stored
+
+    matrix(unsigned int rows, unsigned int cols, const std::shared_ptr<storage_type> &c) :
+            n_rows(rows), n_cols(cols), content(c), zero(0) {}
+
+public:
+    /**
+       @brief Constructor given the numbers of rows and columns
+       Initialize a matrix of zeros, i.e. with no stored elements
+    */
+    matrix(unsigned int rows = 0, unsigned int cols = 0) :
+            n_rows(rows), n_cols(cols), content(std::make_shared<storage_type>()), zero(0) {
+        content->offsets.assign(std::size_t(rows) + 1, 0);
+    }
+
+    /**
+       @brief Constructor given the CSR arrays, which are moved into the matrix
+       @param rows number of rows
+       @param cols number of columns
+       @param offsets rows + 1 offsets: the elements of row i are [offsets[i], offsets[i + 1])
+       @param indices column of each element, increasing along each row
+       @param values value of each element
+    */
+    matrix(unsigned int rows, unsigned int cols, std::vector<std::size_t> offsets,
+           std::vector<unsigned int> indices, std::vector<T> values) :
+            n_rows(rows), n_cols(cols), content(std::make_shared<storage_type>()), zero(0) {
+        assert((offsets.size() == std::size_t(rows) + 1 && indices.size() == values.size() &&
+                offsets.back() == values.size()) && "Invalid CSR arrays!");
+        content->offsets = std::move(offsets);
+        content->indices = std::move(indices);
+        content->values = std::move(values);
+    }
+
+    /**
+       @brief Create a CSR matrix from the non-zero elements of any matrix
+       @param dense matrix to be copied, any decoration
+    */
+    template <typename type>
+    matrix(const matrix<T, type> &dense) :
+            n_rows(dense.get_rows()), n_cols(dense.get_cols()),
+            content(std::make_shared<storage_type>()), zero(0) {
+        content->offsets.reserve(std::size_t(n_rows) + 1);
+        content->offsets.push_back(0);
+        for (unsigned int i = 0; i < n_rows; ++i) {
+            unsigned int j = 0;
+            for (auto e = dense.begin(i), ee = dense.end(i); e != ee; ++e, ++j) {
+                if (*e != T(0)) {
+                    content->indices.push_back(j);
+                    content->values.push_back(*e);
+                }
+            }
+            content->offsets.push_back(content->values.size());
+        }
+    }
+
+    /**
+       @brief Convert a CSC matrix (a counting sort of its elements)
+       @param other matrix to be converted
+    */
+    matrix(const matrix<T, csc_matrix> &other) :
+            n_rows(other.get_rows()), n_cols(other.get_cols()),
+            content(matrix_detail::recompress(other.get_storage(), other.get_rows())), zero(0) {}
+
+    /**
+       @brief Convert a COO matrix, summing repeated positions
+       @param other matrix to be converted
+    */
+    matrix(const matrix<T, coo_matrix> &other) :
+            n_rows(other.get_rows()), n_cols(other.get_cols()),
+            content(matrix_detail::compress(other.get_rows(), other.get_cols(), other.get_row_indices(),
+                                            other.get_column_indices(), other.get_values())),
+            zero(0) {}
+
+    /**
+       @brief Operator() const
+       Binary search of column c among the elements of row r
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return const T& to the element (zero if it is not stored)
+    */
+    const T &operator()(unsigned int r, unsigned int c) const {
+        assert((r < n_rows && c < n_cols) && "Out of bounds!");
+        auto first = content->indices.begin() + content->offsets[r];
+        auto last = content->indices.begin() + content->offsets[r + 1];
+        auto found = std::lower_bound(first, last, c);
+        if (found == last || *found != c)
+            return zero;
+        return content->values[found - content->indices.begin()];
+    }
+
+    /**
+       @brief Get number of rows
+       @return unsigned int corresponding to number of rows
+    */
+    unsigned int get_rows() const {
+        return n_rows;
+    }
+
+    /**
+       @brief Get number of columns
+       @return unsigned int corresponding to number of columns
+    */
+    unsigned int get_cols() const {
+        return n_cols;
+    }
+
+    /**
+       @brief Get number of stored elements
+       @return std::size_t corresponding to number of stored elements
+    */
+    std::size_t get_nonzeros() const {
+        return content->values.size();
+    }
+
+    /**
+       @brief Get the CSR arrays
+       @return const reference to the arrays (offsets, column indices, values)
+    */
+    const storage_type &get_storage() const {
+        return *content;
+    }
+
+    /**
+       @brief create the transpose of the current matrix: a CSC matrix sharing the same arrays
+       @return trasposed matrix
+    */
+    matrix<T, csc_matrix> get_transpose() const {
+        return matrix<T, csc_matrix>(n_cols, n_rows, content);
+    }
+
+    /**
+       @brief Begin const_iterator for traversing the matrix by row
+       @return const_iterator starting from the first element of row i
+    */
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of the matrix
+    */
+    const_iterator end() const {
+        return const_iterator(*this, n_rows, 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of row i
+    */
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    /**
+       @brief Begin const_col_iterator for traversing the matrix by column
+       @return const_col_iterator starting from (0, i)
+    */
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to (0, i + 1) "end of column"
+    */
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to "end of matrix"
+    */
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, n_cols);
+    }
+};
+
+
+/**
+ * @brief Sparse matrix in compressed sparse column format
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+class matrix<T, csc_matrix> {
+    friend class matrix<T, csr_matrix>;
+
+public:
+    typedef matrix_detail::compressed_storage<T> storage_type;
+    typedef const_iterator_limited<T, csc_matrix> const_iterator;
+    typedef const_column_iterator<T, csc_matrix> const_col_iterator;
+
+protected:
+    unsigned int n_rows;
+    unsigned int n_cols;
+    std::shared_ptr<storage_type> content;
+    T zero; // returned for the elements that are not stored
+
+    matrix(unsigned int rows, unsigned int cols, const std::shared_ptr<storage_type> &c) :
+            n_rows(rows), n_cols(cols), content(c), zero(0) {}
+
+public:
+    /**
+       @brief Constructor given the numbers of rows and columns
+       Initialize a matrix of zeros, i.e. with no stored elements
+    */
+    matrix(unsigned int rows = 0, unsigned int cols = 0) :
+            n_rows(rows), n_cols(cols), content(std::make_shared<storage_type>()), zero(0) {
+        content->offsets.assign(std::size_t(cols) + 1, 0);
+    }
+
+    /**
+       @brief Constructor given the CSC arrays, which are moved into the matrix
+       @param rows number of rows
+       @param cols number of columns
+       @param offsets cols + 1 offsets: the elements of column j are [offsets[j], offsets[j + 1])
+       @param indices row of each element, increasing along each column
+       @param values value of each element
+    */
+    matrix(unsigned int rows, unsigned int cols, std::vector<std::size_t> offsets,
+           std::vector<unsigned int> indices, std::vector<T> values) :
+            n_rows(rows), n_cols(cols), content(std::make_shared<storage_type>()), zero(0) {
+        assert((offsets.size() == std::size_t(cols) + 1 && indices.size() == values.size() &&
+                offsets.back() == values.size()) && "Invalid CSC arrays!");
+        content->offsets = std::move(offsets);
+        content->indices = std::move(indices);
+        content->values = std::move(values);
+    }
+
+    /**
+       @brief Create a CSC matrix from the non-zero elements of any matrix
+       @param dense matrix to be copied, any decoration
+    */
+    template <typename type>
+    matrix(const matrix<T, type> &dense) :
+            n_rows(dense.get_rows()), n_cols(dense.get_cols()),
+            content(std::make_shared<storage_type>()), zero(0) {
+        content->offsets.reserve(std::size_t(n_cols) + 1);
+        content->offsets.push_back(0);
+        for (unsigned int j = 0; j < n_cols; ++j) {
+            unsigned int i = 0;
+            for (auto e = dense.column_begin(j), ee = dense.column_end(j); e != ee; ++e, ++i) {
+                if (*e != T(0)) {
+                    content->indices.push_back(i);
+                    content->values.push_back(*e);
+                }
+            }
+            content->offsets.push_back(content->values.size());
+        }
+    }
+
+    /**
+       @brief Convert a CSR matrix (a counting sort of its elements)
+       @param other matrix to be converted
+    */
+    matrix(const matrix<T, csr_matrix> &other) :
+            n_rows(other.get_rows()), n_cols(other.get_cols()),
+            content(matrix_detail::recompress(other.get_storage(), other.get_cols())), zero(0) {}
+
+    /**
+       @brief Convert a COO matrix, summing repeated positions
+       @param other matrix to be converted
+    */
+    matrix(const matrix<T, coo_matrix> &other) :
+            n_rows(other.get_rows()), n_cols(other.get_cols()),
+            content(matrix_detail::compress(other.get_cols(), other.get_rows(), other.get_column_indices(),
+                                            other.get_row_indices(), other.get_values())),
+            zero(0) {}
+
+    /**
+       @brief Operator() const
+       Binary search of row r among the elements of column c
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return const T& to the element (zero if it is not stored)
+    */
+    const T &operator()(unsigned int r, unsigned int c) const {
+        assert((r < n_rows && c < n_cols) && "Out of bounds!");
+        auto first = content->indices.begin() + content->offsets[c];
+        auto last = content->indices.begin() + content->offsets[c + 1];
+        auto found = std::lower_bound(first, last, r);
+        if (found == last || *found != r)
+            return zero;
+        return content->values[found - content->indices.begin()];
+    }
+
+    /**
+       @brief Get number of rows
+       @return unsigned int corresponding to number of rows
+    */
+    unsigned int get_rows() const {
+        return n_rows;
+    }
+
+    /**
+       @brief Get number of columns
+       @return unsigned int corresponding to number of columns
+    */
+    unsigned int get_cols() const {
+        return n_cols;
+    }
+
+    /**
+       @brief Get number of stored elements
+       @return std::size_t corresponding to number of stored elements
+    */
+    std::size_t get_nonzeros() const {
+        return content->values.size();
+    }
+
+    /**
+       @brief Get the CSC arrays
+       @return const reference to the arrays (offsets, row indices, values)
+    */
+    const storage_type &get_storage() const {
+        return *content;
+    }
+
+    /**
+       @brief create the transpose of the current matrix: a CSR matrix sharing the same arrays
+       @return trasposed matrix
+    */
+    matrix<T, csr_matrix> get_transpose() const {
+        return matrix<T, csr_matrix>(n_cols, n_rows, content);
+    }
+
+    /**
+       @brief Begin const_iterator for traversing the matrix by row
+       @return const_iterator starting from the first element of row i
+    */
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of the matrix
+    */
+    const_iterator end() const {
+        return const_iterator(*this, n_rows, 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of row i
+    */
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    /**
+       @brief Begin const_col_iterator for traversing the matrix by column
+       @return const_col_iterator starting from (0, i)
+    */
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to (0, i + 1) "end of column"
+    */
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to "end of matrix"
+    */
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, n_cols);
+    }
+};
+
+
+/**
+ * @brief Sparse matrix stored as a list of (row, column, value) triplets, in any
+ * order; repeated positions add up. Meant to be filled with insert() and then
+ * converted to CSR or CSC: operator() scans every triplet.
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+class matrix<T, coo_matrix> {
+public:
+    typedef matrix_detail::coordinate_storage<T> storage_type;
+    typedef const_iterator_limited<T, coo_matrix> const_iterator;
+    typedef const_column_iterator<T, coo_matrix> const_col_iterator;
+
+protected:
+    unsigned int n_rows;
+    unsigned int n_cols;
+    std::shared_ptr<storage_type> content;
+    bool transposed; // rows and columns of the triplets are swapped
+
+public:
+    /**
+       @brief Constructor given the numbers of rows and columns
+       Initialize a matrix of zeros, i.e. with no triplets
+    */
+    matrix(unsigned int rows = 0, unsigned int cols = 0) :
+            n_rows(rows), n_cols(cols), content(std::make_shared<storage_type>()), transposed(false) {}
+
+    /**
+       @brief Create a COO matrix from the non-zero elements of any matrix
+       @param dense matrix to be copied, any decoration
+    */
+    template <typename type>
+    matrix(const matrix<T, type> &dense) :
+            n_rows(dense.get_rows()), n_cols(dense.get_cols()),
+            content(std::make_shared<storage_type>()), transposed(false) {
+        for (unsigned int i = 0; i < n_rows; ++i) {
+            unsigned int j = 0;
+            for (auto e = dense.begin(i), ee = dense.end(i); e != ee; ++e, ++j)
+                if (*e != T(0))
+                    insert(i, j, *e);
+        }
+    }
+
+    /**
+       @brief Add a triplet: value is added to the element (r, c)
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @param value value to be added
+    */
+    void insert(unsigned int r, unsigned int c, const T &value) {
+        assert((r < n_rows && c < n_cols) && "Out of bounds!");
+        content->rows.push_back(transposed ? c : r);
+        content->cols.push_back(transposed ? r : c);
+        content->values.push_back(value);
+    }
+
+    /**
+       @brief Operator() const
+       Sum of the triplets in position (r, c)
+       @param r number of row (0-based)
+       @param c number of column (0-based)
+       @return T value of the element
+    */
+    T operator()(unsigned int r, unsigned int c) const {
+        assert((r < n_rows && c < n_cols) && "Out of bounds!");
+        const std::vector<unsigned int> &rs = get_row_indices(), &cs = get_column_indices();
+        T sum = T(0);
+        for (std::size_t k = 0; k < content->values.size(); ++k)
+            if (rs[k] == r && cs[k] == c)
+                sum += content->values[k];
+        return sum;
+    }
+
+    /**
+       @brief Get number of rows
+       @return unsigned int corresponding to number of rows
+    */
+    unsigned int get_rows() const {
+        return n_rows;
+    }
+
+    /**
+       @brief Get number of columns
+       @return unsigned int corresponding to number of columns
+    */
+    unsigned int get_cols() const {
+        return n_cols;
+    }
+
+    /**
+       @brief Get number of triplets (repeated positions included)
+       @return std::size_t corresponding to number of triplets
+    */
+    std::size_t get_nonzeros() const {
+        return content->values.size();
+    }
+
+    /**
+       @brief Get the row of every triplet
+       @return const reference to the row indices
+    */
+    const std::vector<unsigned int> &get_row_indices() const {
+        return transposed ? content->cols : content->rows;
+    }
+
+    /**
+       @brief Get the column of every triplet
+       @return const reference to the column indices
+    */
+    const std::vector<unsigned int> &get_column_indices() const {
+        return transposed ? content->rows : content->cols;
+    }
+
+    /**
+       @brief Get the value of every triplet
+       @return const reference to the values
+    */
+    const std::vector<T> &get_values() const {
+        return content->values;
+    }
+
+    /**
+       @brief create the transpose of the current matrix, sharing the same triplets
+       @return trasposed matrix
+    */
+    matrix get_transpose() const {
+        matrix t = *this;
+        std::swap(t.n_rows, t.n_cols);
+        t.transposed = !transposed;
+        return t;
+    }
+
+    /**
+       @brief Begin const_iterator for traversing the matrix by row
+       @return const_iterator starting from the first element of row i
+    */
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of the matrix
+    */
+    const_iterator end() const {
+        return const_iterator(*this, n_rows, 0);
+    }
+
+    /**
+       @brief End const_iterator for traversing the matrix by row
+       @return const_iterator pointing to the end of row i
+    */
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    /**
+       @brief Begin const_col_iterator for traversing the matrix by column
+       @return const_col_iterator starting from (0, i)
+    */
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to (0, i + 1) "end of column"
+    */
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    /**
+       @brief End const_col_iterator for traversing the matrix by column
+       @return const_col_iterator that points to "end of matrix"
+    */
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, n_cols);
+    }
+};
+
+
+namespace matrix_detail {
+
+// set every element of a dense view to zero
+template <typename T>
+void fill_zero(const strided_view<T, false> &v) {
+    for (unsigned int i = 0; i < v.rows; ++i)
+        for (unsigned int j = 0; j < v.cols; ++j)
+            v.at(i, j) = T(0);
+}
+
+} // namespace matrix_detail
+
+
+/**
+ * Conversion of sparse matrices into basic matrices: zeros, then the stored elements
+ */
+template <typename T>
+void copy_elements(const matrix<T, csr_matrix> &source, const strided_view<T, false> &destination) {
+    const matrix_detail::compressed_storage<T> &s = source.get_storage();
+    matrix_detail::fill_zero(destination);
+    for (unsigned int i = 0; i < source.get_rows(); ++i)
+        for (std::size_t k = s.offsets[i]; k < s.offsets[i + 1]; ++k)
+            destination.at(i, s.indices[k]) = s.values[k];
+}
+
+template <typename T>
+void copy_elements(const matrix<T, csc_matrix> &source, const strided_view<T, false> &destination) {
+    copy_elements(source.get_transpose(), destination.transposed());
+}
+
+template <typename T>
+void copy_elements(const matrix<T, coo_matrix> &source, const strided_view<T, false> &destination) {
+    const std::vector<unsigned int> &rows = source.get_row_indices(), &cols = source.get_column_indices();
+    const std::vector<T> &values = source.get_values();
+    matrix_detail::fill_zero(destination);
+    for (std::size_t k = 0; k < values.size(); ++k)
+        destination.at(rows[k], cols[k]) += values[k];
+}
+
+
+/**
+ * @brief Sparse times dense: C = alpha * A * B + beta * C, with A in CSR format
+ * The rows of C are split in chunks holding about the same number of elements of A,
+ * computed in parallel; if B (hence C) has a single column, each row is a dot product.
+ * @param alpha scalar multiplying A * B
+ * @param A left operand (m x k), CSR
+ * @param B right operand (k x n), any dense matrix or decoration
+ * @param beta scalar multiplying C
+ * @param C result (m x n), a basic matrix or a writable view of one
+ * @param pool threads computing the chunks of C
+ */
+template <typename T, typename typeB, typename typeC>
+void gemm(typename matrix_detail::non_deduced<T>::type alpha,
+          const matrix<T, csr_matrix> &A, const matrix<T, typeB> &B,
+          typename matrix_detail::non_deduced<T>::type beta,
+          matrix<T, typeC> &C, thread_pool &pool) {
+    static_assert(!is_structured<typeC>::value, "The result of gemm must be writable!");
+    assert((A.get_cols() == B.get_rows()) && "Incompatible sizes!");
+    assert((A.get_rows() == C.get_rows() && B.get_cols() == C.get_cols()) && "Incompatible sizes!");
+    const matrix_detail::compressed_storage<T> &s = A.get_storage();
+    const typename matrix<T, typeB>::view_type b = B.get_view();
+    const strided_view<T, false> c = C.get_view();
+    std::vector<unsigned int> chunks = matrix_detail::balanced_chunks(s.offsets, 4 * pool.get_threads());
+    pool.parallel_for(static_cast<unsigned int>(chunks.size() - 1), [&](unsigned int t) {
+        for (unsigned int i = chunks[t]; i < chunks[t + 1]; ++i) {
+            if (c.cols == 1) {
+                T sum = T(0);
+                for (std::size_t k = s.offsets[i]; k < s.offsets[i + 1]; ++k)
+                    sum += s.values[k] * b.at(s.indices[k], 0);
+                c.at(i, 0) = (beta == T(0)) ? alpha * sum : beta * c.at(i, 0) + alpha * sum;
+                continue;
+            }
+            matrix_detail::scale(c.sub(i, i + 1, 0, c.cols), beta);
+            for (std::size_t k = s.offsets[i]; k < s.offsets[i + 1]; ++k) {
+                T v = alpha * s.values[k];
+                unsigned int r = s.indices[k];
+                for (unsigned int j = 0; j < c.cols; ++j)
+                    c.at(i, j) += v * b.at(r, j);
+            }
+        }
+    });
+}
+
+/**
+ * @brief Sparse times dense: C = alpha * A * B + beta * C, with A in CSC format
+ * Each column of A is scattered into C. The columns of C are split among the
+ * threads; when C has fewer columns than tasks (e.g. a vector), each task
+ * scatters a chunk of the columns of A into its own buffer, and the buffers
+ * are summed at the end. Those buffers take tasks times the size of C, so they
+ * are only used while they are no larger than A: otherwise (e.g. a tall A times
+ * a vector) A is converted to CSR, whose rows are computed without any buffer.
+ */
+template <typename T, typename typeB, typename typeC>
+void gemm(typename matrix_detail::non_deduced<T>::type alpha,
+          const matrix<T, csc_matrix> &A, const matrix<T, typeB> &B,
+          typename matrix_detail::non_deduced<T>::type beta,
+          matrix<T, typeC> &C, thread_pool &pool) {
+    static_assert(!is_structured<typeC>::value, "The result of gemm must be writable!");
+    assert((A.get_cols() == B.get_rows()) && "Incompatible sizes!");
+    assert((A.get_rows() == C.get_rows() && B.get_cols() == C.get_cols()) && "Incompatible sizes!");
+    const matrix_detail::compressed_storage<T> &s = A.get_storage();
+    const typename matrix<T, typeB>::view_type b = B.get_view();
+    const strided_view<T, false> c = C.get_view();
+    const unsigned int tasks = (pool.get_threads() == 1) ? 1 : 4 * pool.get_threads();
+    if (tasks == 1 || c.cols >= tasks) {
+        const unsigned int width = (c.cols + tasks - 1) / tasks;
+        pool.parallel_for(tasks, [&](unsigned int t) {
+            unsigned int first = std::min(t * width, c.cols);
+            unsigned int last = std::min(first + width, c.cols);
+            if (first >= last)
+                return;
+            matrix_detail::scale(c.sub(0, c.rows, first, last), beta);
+            for (unsigned int col = 0; col < A.get_cols(); ++col)
+                for (std::size_t k = s.offsets[col]; k < s.offsets[col + 1]; ++k) {
+                    T v = alpha * s.values[k];
+                    unsigned int r = s.indices[k];
+                    for (unsigned int j = first; j < last; ++j)
+                        c.at(r, j) += v * b.at(col, j);
+                }
+        });
+        return;
+    }
+    const std::size_t size = std::size_t(c.rows) * c.cols;
+    if (size * tasks > s.values.size()) {
+        // the scratch memory is bounded by the size of A, not by the number of threads
+        gemm(T(alpha), matrix<T, csr_matrix>(A), B, T(beta), C, pool);
+        return;
+    }
+    std::vector<unsigned int> chunks = matrix_detail::balanced_chunks(s.offsets, tasks);
+    const unsigned int n_chunks = static_cast<unsigned int>(chunks.size() - 1);
+    std::vector<T> partial(size * n_chunks, T(0));
+    pool.parallel_for(n_chunks, [&](unsigned int t) {
+        T *mine = partial.data() + t * size;
+        for (unsigned int col = chunks[t]; col < chunks[t + 1]; ++col)
+            for (std::size_t k = s.offsets[col]; k < s.offsets[col + 1]; ++k) {
+                T v = alpha * s.values[k];
+                for (unsigned int j = 0; j < c.cols; ++j)
+                    mine[std::size_t(s.indices[k]) * c.cols + j] += v * b.at(col, j);
+            }
+    });
+    const unsigned int row_block = (c.rows + tasks - 1) / tasks;
+    pool.parallel_for(tasks, [&](unsigned int t) {
+        unsigned int first = std::min(t * row_block, c.rows);
+        unsigned int last = std::min(first + row_block, c.rows);
+        for (unsigned int i = first; i < last; ++i)
+            for (unsigned int j = 0; j < c.cols; ++j) {
+                T sum = T(0);
+                for (unsigned int p = 0; p < n_chunks; ++p)
+                    sum += partial[p * size + std::size_t(i) * c.cols + j];
+                c.at(i, j) = (beta == T(0)) ? sum : beta * c.at(i, j) + sum;
+            }
+    });
+}
+
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef MATRIX_STATS_H
+#define MATRIX_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+
+/**
+ * Optional instrumentation of basic matrices, compiled only when MATRIX_INSTRUMENTATION
+ * is defined (e.g. g++ -DMATRIX_INSTRUMENTATION); otherwise every hook is empty
+ * and the shared elements are a plain std::shared_ptr.
+ *
+ * Events counted (and, for the first two, timed):
+ *  - allocations: buffers of elements allocated, e.g. by matrix(rows, cols), with their bytes;
+ *  - deep_copies: elements copied by the converting copy constructor (hence by the
+ *    assignment of a different matrix) and by copy on write, with their number;
+ *  - views: views created by get_transpose, get_submatrix, get_diagonal and get_diagonalmatrix;
+ *  - shares: copies of the shared pointer to the elements (plain copies and
+ *    assignments of basic matrices, views taking a reference to them).
+ *
+ * Counters are global, atomic, and can be printed as JSON or in the text format
+ * of Prometheus.
+ */
+
+
+namespace matrix_stats {
+
+#ifdef MATRIX_INSTRUMENTATION
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+enum event { allocations, deep_copies, views, shares, events };
+
+inline const char *event_name(event e) {
+    static const char *const names[events] = {"allocations", "deep_copies", "views", "shares"};
+    return names[e];
+}
+
+// unit of the amount of each event
+inline const char *amount_name(event e) {
+    static const char *const names[events] = {"bytes", "elements", "", ""};
+    return names[e];
+}
+
+struct counter {
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> amount{0};       // bytes, elements (see amount_name)
+    std::atomic<std::uint64_t> nanoseconds{0};
+};
+
+inline counter counters[events];
+
+/**
+ * @brief count an event
+ * @param amount e.g. bytes allocated
+ */
+inline void record(event e, std::uint64_t amount = 0, std::uint64_t nanoseconds = 0) {
+    if constexpr (enabled) {
+        counters[e].count.fetch_add(1, std::memory_order_relaxed);
+        counters[e].amount.fetch_add(amount, std::memory_order_relaxed);
+        counters[e].nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+    else {
+        (void)e;
+        (void)amount;
+        (void)nanoseconds;
+    }
+}
+
+/**
+ * @brief count an event and time it until the end of the scope
+ */
+class scope {
+    typedef std::chrono::steady_clock clock;
+    event e;
+    std::uint64_t amount;
+    clock::time_point start;
+
+public:
+    scope(event ev, std::uint64_t a = 0) : e(ev), amount(a) {
+        if constexpr (enabled)
+            start = clock::now();
+    }
+
+    ~scope() {
+        if constexpr (enabled)
+            record(e, amount, std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    clock::now() - start).count()));
+    }
+
+    scope(const scope &) = delete;
+    scope &operator=(const scope &) = delete;
+};
+
+/**
+ * @brief std::shared_ptr counting its copies as shares
+ */
+template <typename T>
+class counted_ptr : public std::shared_ptr<T> {
+public:
+    counted_ptr() noexcept = default;
+
+    counted_ptr(std::shared_ptr<T> &&p) noexcept : std::shared_ptr<T>(std::move(p)) {}
+
+    counted_ptr(const counted_ptr &p) noexcept : std::shared_ptr<T>(p) {
+        if (p)
+            record(shares);
+    }
+
+    counted_ptr(counted_ptr &&p) noexcept = default;
+
+    counted_ptr &operator=(const counted_ptr &p) noexcept {
+        if (p)
+            record(shares);
+        std::shared_ptr<T>::operator=(p);
+        return *this;
+    }
+
+    counted_ptr &operator=(counted_ptr &&p) noexcept = default;
+
+    counted_ptr &operator=(std::shared_ptr<T> &&p) noexcept {
+        std::shared_ptr<T>::operator=(std::move(p));
+        return *this;
+    }
+};
+
+// pointer to the elements of a basic matrix
+template <typename T>
+using shared = typename std::conditional<enabled, counted_ptr<T>, std::shared_ptr<T>>::type;
+
+/**
+ * @brief set every counter to zero
+ */
+inline void reset() {
+    for (counter &c : counters) {
+        c.count = 0;
+        c.amount = 0;
+        c.nanoseconds = 0;
+    }
+}
+
+/**
+ * @brief write the counters as a JSON object, e.g.
+ * {"allocations": {"count": 2, "bytes": 800, "nanoseconds": 1200}, ...}
+ */
+inline std::ostream &write_json(std::ostream &os) {
+    os << "{";
+    for (int e = 0; e < events; ++e) {
+        const counter &c = counters[e];
+        os << (e ? ", " : "") << "\"" << event_name(event(e)) << "\": {\"count\": " << c.count;
+        if (*amount_name(event(e)))
+            os << ", \"" << amount_name(event(e)) << "\": " << c.amount << ", \"nanoseconds\": " << c.nanoseconds;
+        os << "}";
+    }
+    return os << "}\n";
+}
+
+/**
+ * @brief write the counters in the text format of Prometheus, e.g.
+ * matrix_allocations_total 2
+ * matrix_allocations_bytes_total 800
+ * matrix_allocations_seconds_total 1.2e-06
+ */
+inline std::ostream &write_prometheus(std::ostream &os) {
+    for (int e = 0; e < events; ++e) {
+        const counter &c = counters[e];
+        const std::string name = std::string("matrix_") + event_name(event(e));
+        os << "# TYPE " << name << "_total counter\n" << name << "_total " << c.count << "\n";
+        if (*amount_name(event(e))) {
+            os << "# TYPE " << name << "_" << amount_name(event(e)) << "_total counter\n"
+               << name << "_" << amount_name(event(e)) << "_total " << c.amount << "\n";
+            os << "# TYPE " << name << "_seconds_total counter\n"
+               << name << "_seconds_total " << double(c.nanoseconds) / 1e9 << "\n";
+        }
+    }
+    return os;
+}
+
+} // namespace matrix_stats
+
+
+#endif
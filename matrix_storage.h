@@ -0,0 +1,174 @@
+#ifndef MATRIX_STORAGE_H
+#define MATRIX_STORAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+
+/**
+ * The elements of a basic matrix live in a std::vector created through an
+ * allocator, which is chosen by the type of the matrix:
+ *
+ *  - matrix<T> (i.e. matrix<T, basic_matrix>) uses std::allocator;
+ *  - matrix<T, aligned_matrix> aligns the elements to 64 bytes (a cache line,
+ *    and the width of an AVX-512 register);
+ *  - matrix<T, pmr_matrix> takes its memory from a std::pmr::memory_resource,
+ *    e.g. a monotonic arena released all at once;
+ *  - matrix<T, basic_storage<A>> uses any other allocator A.
+ *
+ * The second parameter of basic_storage is the order of the elements: row_major
+ * (the default) or column_major, e.g. matrix<T, column_major_matrix>.
+ *
+ * The allocator given as parameter is rebound to T (and to the control block of
+ * the shared_ptr, which is allocated with it), so its own value type does not matter.
+ *
+ * An allocator whose allocate() returns elements that already exist (e.g. the
+ * mapping of a file, see mapped_allocator in matrix_binary.h) declares
+ * `typedef std::true_type adopts_elements;`: the matrix then keeps its
+ * elements in a matrix_detail::adopted_elements instead of a std::vector,
+ * which never constructs them one by one.
+ */
+
+
+/**
+ * @brief Allocator returning memory aligned to `alignment` bytes
+ * @tparam T type of the allocated elements
+ * @tparam alignment required alignment (a power of 2)
+ */
+template <typename T, std::size_t alignment = 64>
+class aligned_allocator {
+    static_assert((alignment & (alignment - 1)) == 0, "The alignment must be a power of 2!");
+
+public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef aligned_allocator<U, alignment> other;
+    };
+
+    aligned_allocator() noexcept {}
+
+    template <typename U>
+    aligned_allocator(const aligned_allocator<U, alignment> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(actual_alignment())));
+    }
+
+    void deallocate(T *p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t(actual_alignment()));
+    }
+
+    template <typename U>
+    bool operator==(const aligned_allocator<U, alignment> &) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const aligned_allocator<U, alignment> &) const noexcept {
+        return false;
+    }
+
+private:
+    static constexpr std::size_t actual_alignment() {
+        return alignment < alignof(T) ? alignof(T) : alignment;
+    }
+};
+
+
+// basic matrix whose elements are aligned to a cache line
+typedef basic_storage<aligned_allocator<void, 64>> aligned_matrix;
+
+// basic matrix whose elements come from a std::pmr::memory_resource
+typedef basic_storage<std::pmr::polymorphic_allocator<std::byte>> pmr_matrix;
+
+// basic matrix storing its elements column after column (as Fortran and LAPACK do)
+typedef basic_storage<std::allocator<void>, column_major> column_major_matrix;
+
+
+namespace matrix_detail {
+
+/**
+ * @brief Array of trivially copyable elements taken as they are from an allocator
+ * (see adopts_elements above): creating it calls allocate() once and constructs
+ * nothing, so its cost does not depend on the number of elements. Provides the
+ * part of the interface of std::vector used by a basic matrix.
+ * @tparam T type of the elements
+ * @tparam A allocator of the elements, rebound to T
+ */
+template <typename T, typename A>
+class adopted_elements {
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable elements can be adopted!");
+
+public:
+    typedef T value_type;
+    typedef A allocator_type;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+
+    adopted_elements(std::size_t size, const A &alloc) : allocator(alloc), first(nullptr), count(size) {
+        first = std::allocator_traits<A>::allocate(allocator, count);
+    }
+
+    adopted_elements(const adopted_elements &other, const A &alloc) : adopted_elements(other.count, alloc) {
+        if (count != 0)
+            std::memcpy(first, other.first, count * sizeof(T));
+    }
+
+    adopted_elements(adopted_elements &&other) noexcept :
+            allocator(other.allocator), first(other.first), count(other.count) {
+        other.first = nullptr;
+        other.count = 0;
+    }
+
+    ~adopted_elements() {
+        if (first)
+            std::allocator_traits<A>::deallocate(allocator, first, count);
+    }
+
+    adopted_elements(const adopted_elements &) = delete;
+    adopted_elements &operator=(const adopted_elements &) = delete;
+
+    T *data() noexcept { return first; }
+    const T *data() const noexcept { return first; }
+    std::size_t size() const noexcept { return count; }
+    A get_allocator() const { return allocator; }
+
+    T &operator[](std::size_t i) { return first[i]; }
+    const T &operator[](std::size_t i) const { return first[i]; }
+
+    iterator begin() noexcept { return first; }
+    const_iterator begin() const noexcept { return first; }
+    const_iterator cbegin() const noexcept { return first; }
+    iterator end() noexcept { return first + count; }
+    const_iterator end() const noexcept { return first + count; }
+    const_iterator cend() const noexcept { return first + count; }
+
+private:
+    A allocator;
+    T *first;
+    std::size_t count;
+};
+
+// container of the elements of a basic matrix: std::vector, unless the allocator adopts them
+template <typename T, typename A, typename = void>
+struct elements_of {
+    typedef std::vector<T, A> type;
+};
+
+template <typename T, typename A>
+struct elements_of<T, A, std::enable_if_t<A::adopts_elements::value>> {
+    typedef adopted_elements<T, A> type;
+};
+
+} // namespace matrix_detail
+
+
+#endif
@@ -0,0 +1,681 @@
+#ifndef MATRIX_TILED_H
+#define MATRIX_TILED_H
+
+#include "matrix.h"
+#include "matrix_binary.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * Out-of-core matrices: matrix<T, tiled_matrix> keeps its elements in a file,
+ * cut in tiles of tile_rows x tile_cols elements (stored by rows, one after the
+ * other, the tiles on the edges padded to the full size), after the header of
+ * the binary files (see matrix_binary.h, layout 2).
+ *
+ * Tiles are read when needed into a cache, which keeps the most recently used
+ * ones within a memory budget: when it is full, the least recently used tile
+ * that nobody is working on is dropped, and written back to the file if it was
+ * changed. Tiles in use are never dropped, so the budget can be exceeded while
+ * a loop holds more tiles than it allows.
+ *
+ * get_submatrix() and get_transpose() return views sharing the file and the
+ * cache, as for a basic matrix. Elements can be read and written one at a time,
+ * but the efficient access is a block at a time: for_each_tile() visits the
+ * tiles in place, read()/write() copy any block to or from memory. Both go
+ * through the tiles in order and read the next one on a background thread
+ * while the current one is processed; so do gemm() and transform_tiles(),
+ * which stream tiles of their operands through in-memory kernels.
+ * Errors reading or writing the file throw std::runtime_error.
+ */
+
+
+namespace matrix_detail {
+
+// memory of the tile cache, unless given
+const std::size_t tile_cache_bytes = std::size_t(1) << 28;
+// sides of a tile, unless given
+const unsigned int tile_side = 512;
+
+/**
+ * @brief A block of a tiled matrix lying within a single tile, in the
+ * coordinates of the matrix (or view) it was taken from
+ */
+struct tile_block {
+    unsigned int row;
+    unsigned int col;
+    unsigned int rows;
+    unsigned int cols;
+};
+
+/**
+ * @brief The file and the tile cache shared by a tiled matrix and its views
+ */
+template <typename T>
+class tile_store {
+public:
+    struct tile {
+        std::vector<T> elements;  // tile_rows x tile_cols, by rows
+        std::size_t index;        // position in the file
+        std::atomic<bool> dirty;  // changed since it was read
+        std::once_flag loaded;
+
+        explicit tile(std::size_t i) : index(i), dirty(false) {}
+    };
+
+    const unsigned int rows;
+    const unsigned int cols;
+    const unsigned int tile_rows;
+    const unsigned int tile_cols;
+    const unsigned int tiles_across; // tiles in a row of tiles
+
+private:
+    typedef std::list<std::shared_ptr<tile>> tile_list;
+
+    std::string path;
+    std::fstream file;
+    std::uint64_t offset;      // first byte of the first tile
+    std::mutex file_mutex;     // serializes reads and writes
+    std::mutex cache_mutex;    // protects lru and cached
+    tile_list lru;             // most recently used first
+    std::unordered_map<std::size_t, typename tile_list::iterator> cached;
+    std::size_t capacity;      // tiles kept in the cache
+
+    std::size_t tile_elements() const {
+        return std::size_t(tile_rows) * tile_cols;
+    }
+
+    std::streamoff position(std::size_t index) const {
+        return std::streamoff(offset + index * tile_elements() * sizeof(T));
+    }
+
+    void read_tile(tile &t) {
+        std::vector<T> elements(tile_elements());
+        std::lock_guard<std::mutex> lock(file_mutex);
+        file.clear();
+        file.seekg(position(t.index));
+        if (!file.read(reinterpret_cast<char *>(elements.data()), std::streamsize(elements.size() * sizeof(T))))
+            throw std::runtime_error("tiled matrix: cannot read " + path);
+        t.elements = std::move(elements);
+    }
+
+    void write_tile(tile &t) {
+        std::lock_guard<std::mutex> lock(file_mutex);
+        file.clear();
+        file.seekp(position(t.index));
+        if (!file.write(reinterpret_cast<const char *>(t.elements.data()),
+                        std::streamsize(t.elements.size() * sizeof(T))))
+            throw std::runtime_error("tiled matrix: cannot write " + path);
+        t.dirty = false;
+    }
+
+    // drop the least recently used tiles that are not in use; cache_mutex held
+    void evict() {
+        for (auto e = lru.end(); cached.size() > capacity && e != lru.begin();) {
+            --e;
+            if (e->use_count() > 1)
+                continue; // in use (or being read)
+            if ((*e)->dirty)
+                write_tile(**e);
+            cached.erase((*e)->index);
+            e = lru.erase(e);
+        }
+    }
+
+public:
+    /**
+     * @brief Open the tiles of a file
+     * @param p file name
+     * @param h header of the file, already checked
+     * @param budget bytes of tiles kept in memory (at least one tile)
+     */
+    tile_store(const std::string &p, const binary_header &h, std::size_t budget) :
+            rows(static_cast<unsigned int>(h.rows)), cols(static_cast<unsigned int>(h.cols)),
+            tile_rows(h.tile_rows), tile_cols(h.tile_cols),
+            tiles_across((static_cast<unsigned int>(h.cols) + h.tile_cols - 1) / h.tile_cols),
+            path(p), file(p, std::ios::in | std::ios::out | std::ios::binary), offset(h.offset),
+            capacity(std::max<std::size_t>(1, budget / (tile_elements() * sizeof(T)))) {
+        if (!file)
+            throw std::runtime_error("tiled matrix: cannot open " + path);
+    }
+
+    ~tile_store() {
+        try {
+            flush();
+        }
+        catch (...) {
+            // nothing to do in a destructor: call flush() to know
+        }
+    }
+
+    tile_store(const tile_store &) = delete;
+    tile_store &operator=(const tile_store &) = delete;
+
+    /**
+     * @brief the tile in position index of the file, read if not cached; it
+     * stays in memory as long as the returned pointer is held
+     */
+    std::shared_ptr<tile> fetch(std::size_t index) {
+        std::shared_ptr<tile> t;
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            auto found = cached.find(index);
+            if (found != cached.end()) {
+                lru.splice(lru.begin(), lru, found->second);
+                t = *found->second;
+            }
+            else {
+                t = std::make_shared<tile>(index);
+                lru.push_front(t);
+                cached[index] = lru.begin();
+                evict();
+            }
+        }
+        // other threads asking for the same tile wait here
+        std::call_once(t->loaded, [&] { read_tile(*t); });
+        return t;
+    }
+
+    /**
+     * @brief write the changed tiles to the file
+     */
+    void flush() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        for (const std::shared_ptr<tile> &t : lru)
+            if (t->dirty)
+                write_tile(*t);
+        std::lock_guard<std::mutex> file_lock(file_mutex);
+        if (!file.flush())
+            throw std::runtime_error("tiled matrix: cannot write " + path);
+    }
+
+    /**
+     * @brief create a file of rows x cols zeros in tiles, returning its header
+     */
+    static binary_header create(const std::string &path, unsigned int rows, unsigned int cols,
+                                unsigned int tile_rows, unsigned int tile_cols) {
+        assert((tile_rows > 0 && tile_cols > 0) && "Empty tiles!");
+        binary_header h;
+        h.dtype = binary_dtype<T>();
+        h.layout = 2;
+        h.rows = rows;
+        h.cols = cols;
+        h.alignment = std::max<std::size_t>(64, alignof(T));
+        h.offset = binary_header_size;
+        h.tile_rows = tile_rows;
+        h.tile_cols = tile_cols;
+        const std::uint64_t tiles = std::uint64_t((rows + tile_rows - 1) / tile_rows) *
+                                    ((cols + tile_cols - 1) / tile_cols);
+        const std::uint64_t size = h.offset + tiles * tile_rows * tile_cols * sizeof(T);
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        h.write(out);
+        // the tiles are a hole in the file, read as zeros
+        if (size > h.offset) {
+            out.seekp(std::streamoff(size - 1));
+            out.put('\0');
+        }
+        if (!out)
+            throw std::runtime_error("tiled matrix: cannot create " + path);
+        return h;
+    }
+};
+
+} // namespace matrix_detail
+
+
+/**
+ * @brief Matrix stored in tiles in a file, larger than the memory if needed
+ * (see the top of this file)
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+class matrix<T, tiled_matrix> {
+public:
+    typedef matrix_detail::tile_store<T> storage_type;
+    typedef matrix_detail::tile_block tile_block;
+    typedef const_iterator_limited<T, tiled_matrix> const_iterator;
+    typedef const_column_iterator<T, tiled_matrix> const_col_iterator;
+
+protected:
+    std::shared_ptr<storage_type> store;
+    unsigned int first_row;  // element (0, 0) of the view in the store
+    unsigned int first_col;
+    unsigned int n_rows;     // sizes of the view
+    unsigned int n_cols;
+    bool transposed;         // rows of the view are columns of the store
+
+    matrix(const std::shared_ptr<storage_type> &s, unsigned int fr, unsigned int fc,
+           unsigned int rows, unsigned int cols, bool t) :
+            store(s), first_row(fr), first_col(fc), n_rows(rows), n_cols(cols), transposed(t) {}
+
+    // index of the tile holding element (r, c) of the store
+    std::size_t tile_index(unsigned int r, unsigned int c) const {
+        return std::size_t(r / store->tile_rows) * store->tiles_across + c / store->tile_cols;
+    }
+
+    // descriptor of the elements of block b in tile t
+    strided_view<T, false> block_view(const tile_block &b, typename storage_type::tile &t) const {
+        unsigned int r = transposed ? first_row + b.col : first_row + b.row;
+        unsigned int c = transposed ? first_col + b.row : first_col + b.col;
+        strided_view<T, false> v = {t.elements.data() + std::size_t(r % store->tile_rows) * store->tile_cols +
+                                    c % store->tile_cols,
+                                    std::ptrdiff_t(store->tile_cols), 1,
+                                    transposed ? b.cols : b.rows, transposed ? b.rows : b.cols};
+        return transposed ? v.transposed() : v;
+    }
+
+    std::size_t tile_of(const tile_block &b) const {
+        return transposed ? tile_index(first_row + b.col, first_col + b.row)
+                          : tile_index(first_row + b.row, first_col + b.col);
+    }
+
+public:
+    /**
+     * @brief Create a file of rows x cols zeros in tiles
+     * @param path file name, overwritten
+     * @param tile_rows rows of a tile
+     * @param tile_cols columns of a tile
+     * @param cache_bytes memory of the tile cache
+     */
+    matrix(const std::string &path, unsigned int rows, unsigned int cols,
+           unsigned int tile_rows = matrix_detail::tile_side, unsigned int tile_cols = matrix_detail::tile_side,
+           std::size_t cache_bytes = matrix_detail::tile_cache_bytes) :
+            store(std::make_shared<storage_type>(
+                    path, storage_type::create(path, rows, cols, tile_rows, tile_cols), cache_bytes)),
+            first_row(0), first_col(0), n_rows(rows), n_cols(cols), transposed(false) {}
+
+    /**
+     * @brief Create a file in tiles holding a copy of a matrix
+     * @param path file name, overwritten
+     * @param m matrix to be copied, any decoration
+     */
+    template <typename type>
+    matrix(const std::string &path, const matrix<T, type> &m,
+           unsigned int tile_rows = matrix_detail::tile_side, unsigned int tile_cols = matrix_detail::tile_side,
+           std::size_t cache_bytes = matrix_detail::tile_cache_bytes) :
+            matrix(path, m.get_rows(), m.get_cols(), tile_rows, tile_cols, cache_bytes) {
+        for_each_tile([&m](unsigned int row, unsigned int col, const strided_view<T, false> &block) {
+            for (unsigned int i = 0; i < block.rows; ++i)
+                for (unsigned int j = 0; j < block.cols; ++j)
+                    block.at(i, j) = m(row + i, col + j);
+        });
+    }
+
+    /**
+     * @brief Open a file in tiles (see open_tiled)
+     */
+    matrix(const std::shared_ptr<storage_type> &s) :
+            matrix(s, 0, 0, s->rows, s->cols, false) {}
+
+    unsigned int get_rows() const {
+        return n_rows;
+    }
+
+    unsigned int get_cols() const {
+        return n_cols;
+    }
+
+    /**
+     * @brief rows of a tile, as seen by this view
+     */
+    unsigned int get_tile_rows() const {
+        return transposed ? store->tile_cols : store->tile_rows;
+    }
+
+    /**
+     * @brief columns of a tile, as seen by this view
+     */
+    unsigned int get_tile_cols() const {
+        return transposed ? store->tile_rows : store->tile_cols;
+    }
+
+    const std::shared_ptr<storage_type> &get_storage() const {
+        return store;
+    }
+
+    /**
+     * @brief read an element, through the tile cache
+     */
+    T operator()(unsigned int r, unsigned int c) const {
+        assert((r < n_rows && c < n_cols) && "Out of bounds!");
+        tile_block b = {r, c, 1, 1};
+        std::shared_ptr<typename storage_type::tile> t = store->fetch(tile_of(b));
+        return block_view(b, *t).at(0, 0);
+    }
+
+    /**
+     * @brief write an element, through the tile cache
+     */
+    void set(unsigned int r, unsigned int c, const T &value) {
+        assert((r < n_rows && c < n_cols) && "Out of bounds!");
+        tile_block b = {r, c, 1, 1};
+        std::shared_ptr<typename storage_type::tile> t = store->fetch(tile_of(b));
+        block_view(b, *t).at(0, 0) = value;
+        t->dirty = true;
+    }
+
+    /**
+     * @brief the blocks of this view lying within single tiles, by rows
+     */
+    std::vector<tile_block> get_tile_blocks() const {
+        // cut [first, first + n) at the multiples of side
+        auto cut = [](unsigned int first, unsigned int n, unsigned int side) {
+            std::vector<std::pair<unsigned int, unsigned int>> pieces;
+            for (unsigned int p = 0; p < n;) {
+                unsigned int q = std::min(n, p + side - (first + p) % side);
+                pieces.emplace_back(p, q - p);
+                p = q;
+            }
+            return pieces;
+        };
+        const auto by_rows = transposed ? cut(first_col, n_rows, store->tile_cols)
+                                        : cut(first_row, n_rows, store->tile_rows);
+        const auto by_cols = transposed ? cut(first_row, n_cols, store->tile_rows)
+                                        : cut(first_col, n_cols, store->tile_cols);
+        std::vector<tile_block> blocks;
+        blocks.reserve(by_rows.size() * by_cols.size());
+        for (const auto &r : by_rows)
+            for (const auto &c : by_cols)
+                blocks.push_back(tile_block{r.first, c.first, r.second, c.second});
+        return blocks;
+    }
+
+    /**
+     * @brief read the tiles of the block [begin_row, end_row) x [begin_column, end_column)
+     * into the cache on a background thread
+     * @return future to wait for, if needed
+     */
+    std::future<void> prefetch(unsigned int begin_row, unsigned int end_row,
+                               unsigned int begin_column, unsigned int end_column) const {
+        std::vector<std::size_t> tiles;
+        const matrix block = get_submatrix(begin_row, end_row, begin_column, end_column);
+        for (const tile_block &b : block.get_tile_blocks())
+            tiles.push_back(block.tile_of(b));
+        return std::async(std::launch::async, [s = store, tiles] {
+            try {
+                for (std::size_t t : tiles)
+                    s->fetch(t);
+            }
+            catch (...) {
+                // the tile is read (and the error thrown) again when needed
+            }
+        });
+    }
+
+    /**
+     * @brief call f(row, col, block) for every tile_block of this view, in order,
+     * block being the descriptor of its elements in the cache, which f may change
+     */
+    template <typename function>
+    void for_each_tile(function f) {
+        visit_tiles(f, true);
+    }
+
+    /**
+     * @brief call f(row, col, block) for every tile_block of this view, in order,
+     * block being the descriptor of its elements in the cache, which f must not change
+     */
+    template <typename function>
+    void for_each_tile(function f) const {
+        visit_tiles(f, false);
+    }
+
+    /**
+     * @brief copy the block of this view starting at (row, col) into destination
+     * @param destination descriptor of the memory to fill, e.g. the view of a basic matrix
+     */
+    void read(unsigned int row, unsigned int col, const strided_view<T, false> &destination) const {
+        get_submatrix(row, row + destination.rows, col, col + destination.cols).visit_tiles(
+                [&](unsigned int r, unsigned int c, const strided_view<T, false> &block) {
+                    matrix_detail::copy_view(block, destination.sub(r, r + block.rows, c, c + block.cols));
+                }, false);
+    }
+
+    /**
+     * @brief copy source into the block of this view starting at (row, col)
+     */
+    void write(unsigned int row, unsigned int col, const strided_view<T, false> &source) {
+        get_submatrix(row, row + source.rows, col, col + source.cols).visit_tiles(
+                [&](unsigned int r, unsigned int c, const strided_view<T, false> &block) {
+                    matrix_detail::copy_view(source.sub(r, r + block.rows, c, c + block.cols), block);
+                }, true);
+    }
+
+    /**
+     * @brief write the changed tiles to the file
+     */
+    void flush() {
+        store->flush();
+    }
+
+    /**
+     * @brief Get the transpose of this matrix: a view of the same tiles
+     */
+    matrix get_transpose() const {
+        return matrix(store, first_row, first_col, n_cols, n_rows, !transposed);
+    }
+
+    /**
+     * @brief Get a submatrix of this matrix: a view of the same tiles
+     * @param begin_row row to begin from
+     * @param end_row row to end to (EXCLUDED)
+     * @param begin_column column to begin from
+     * @param end_column column to end to (EXCLUDED)
+     */
+    matrix get_submatrix(unsigned int begin_row, unsigned int end_row,
+                         unsigned int begin_column, unsigned int end_column) const {
+        assert((begin_row <= end_row && end_row <= n_rows && begin_column <= end_column && end_column <= n_cols) &&
+               "Wrong submatrix!");
+        return transposed ? matrix(store, first_row + begin_column, first_col + begin_row,
+                                   end_row - begin_row, end_column - begin_column, true)
+                          : matrix(store, first_row + begin_row, first_col + begin_column,
+                                   end_row - begin_row, end_column - begin_column, false);
+    }
+
+    const_iterator begin(unsigned int i = 0) const {
+        return const_iterator(*this, i, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(*this, n_rows, 0);
+    }
+
+    const_iterator end(unsigned int i) const {
+        return const_iterator(*this, i + 1, 0);
+    }
+
+    const_col_iterator column_begin(unsigned int i = 0) const {
+        return const_col_iterator(*this, 0, i);
+    }
+
+    const_col_iterator column_end(unsigned int i) const {
+        return const_col_iterator(*this, 0, i + 1);
+    }
+
+    const_col_iterator column_end() const {
+        return const_col_iterator(*this, 0, n_cols);
+    }
+
+protected:
+    template <typename function>
+    void visit_tiles(function &&f, bool changing) const {
+        const std::vector<tile_block> blocks = get_tile_blocks();
+        std::future<void> next;
+        for (std::size_t k = 0; k < blocks.size(); ++k) {
+            const tile_block &b = blocks[k];
+            if (k + 1 < blocks.size()) {
+                const tile_block &n = blocks[k + 1];
+                next = prefetch(n.row, n.row + n.rows, n.col, n.col + n.cols);
+            }
+            std::shared_ptr<typename storage_type::tile> t = store->fetch(tile_of(b));
+            f(b.row, b.col, block_view(b, *t));
+            if (changing)
+                t->dirty = true;
+        }
+    }
+};
+
+
+/**
+ * @brief Open a file in tiles
+ * @tparam T type of the elements, which must be the one of the file
+ * @param path file name
+ * @param cache_bytes memory of the tile cache
+ */
+template <typename T>
+matrix<T, tiled_matrix> open_tiled(const std::string &path,
+                                   std::size_t cache_bytes = matrix_detail::tile_cache_bytes) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("tiled matrix: cannot open " + path);
+    const matrix_detail::binary_header h = matrix_detail::binary_header::read(in, path);
+    in.close();
+    h.check<T>(2, matrix_detail::file_size(path), path);
+    return matrix<T, tiled_matrix>(std::make_shared<matrix_detail::tile_store<T>>(path, h, cache_bytes));
+}
+
+
+/**
+ * Conversion of a tiled matrix (e.g. a block of it) into a basic matrix
+ */
+template <typename T>
+void copy_elements(const matrix<T, tiled_matrix> &source, const strided_view<T, false> &destination) {
+    source.read(0, 0, destination);
+}
+
+
+/**
+ * @brief Product of tiled matrices, C = alpha * A * B + beta * C, out of core:
+ * for every tile of C, the blocks of a row of A and a column of B are read into
+ * memory (the next ones on a background thread) and multiplied by the in-memory gemm
+ * @param pool threads computing the products of the blocks
+ */
+template <typename T>
+void gemm(typename matrix_detail::non_deduced<T>::type alpha,
+          const matrix<T, tiled_matrix> &A, const matrix<T, tiled_matrix> &B,
+          typename matrix_detail::non_deduced<T>::type beta,
+          matrix<T, tiled_matrix> &C, thread_pool &pool) {
+    assert((A.get_cols() == B.get_rows() && C.get_rows() == A.get_rows() && C.get_cols() == B.get_cols()) &&
+           "Incompatible sizes!");
+    const unsigned int depth = A.get_cols();
+    const unsigned int step = A.get_tile_cols();
+    const std::vector<matrix_detail::tile_block> blocks = C.get_tile_blocks();
+    std::future<void> next_a, next_b;
+    for (const matrix_detail::tile_block &c : blocks) {
+        matrix<T> product(c.rows, c.cols);
+        if (beta != T(0)) {
+            C.read(c.row, c.col, product.get_view());
+            T *p = product.data();
+            for (std::size_t i = 0, n = std::size_t(c.rows) * c.cols; i < n; ++i)
+                p[i] *= beta;
+        }
+        for (unsigned int k = 0; k < depth; k += step) {
+            const unsigned int end = std::min(depth, k + step);
+            if (end < depth) {
+                const unsigned int after = std::min(depth, end + step);
+                next_a = A.prefetch(c.row, c.row + c.rows, end, after);
+                next_b = B.prefetch(end, after, c.col, c.col + c.cols);
+            }
+            matrix<T> a(c.rows, end - k), b(end - k, c.cols);
+            A.read(c.row, k, a.get_view());
+            B.read(k, c.col, b.get_view());
+            gemm(alpha, a, b, T(1), product, pool);
+        }
+        C.write(c.row, c.col, product.get_view());
+    }
+}
+
+
+/**
+ * @brief out = f(a), element by element, a tile of out at a time
+ * @param out tiled matrix (or view) to write
+ * @param a tiled matrix of the same sizes (may be out)
+ * @param f function of an element
+ * @param pool threads computing the rows of a tile
+ */
+template <typename T, typename function>
+void transform_tiles(matrix<T, tiled_matrix> &out, const matrix<T, tiled_matrix> &a, function f, thread_pool &pool) {
+    assert((out.get_rows() == a.get_rows() && out.get_cols() == a.get_cols()) && "Incompatible sizes!");
+    const std::vector<matrix_detail::tile_block> blocks = out.get_tile_blocks();
+    std::future<void> next_a, next_out;
+    for (std::size_t k = 0; k < blocks.size(); ++k) {
+        const matrix_detail::tile_block &b = blocks[k];
+        if (k + 1 < blocks.size()) {
+            const matrix_detail::tile_block &n = blocks[k + 1];
+            next_a = a.prefetch(n.row, n.row + n.rows, n.col, n.col + n.cols);
+            next_out = out.prefetch(n.row, n.row + n.rows, n.col, n.col + n.cols);
+        }
+        matrix<T> x(b.rows, b.cols);
+        a.read(b.row, b.col, x.get_view());
+        pool.parallel_for(b.rows, [&](unsigned int i) {
+            for (unsigned int j = 0; j < b.cols; ++j)
+                x(i, j) = f(x(i, j));
+        });
+        out.write(b.row, b.col, x.get_view());
+    }
+}
+
+/**
+ * @brief out = f(a, b), element by element, a tile of out at a time
+ * @param out tiled matrix (or view) to write
+ * @param a tiled matrix of the same sizes (may be out)
+ * @param b tiled matrix of the same sizes (may be out)
+ * @param f function of two elements
+ * @param pool threads computing the rows of a tile
+ */
+template <typename T, typename function>
+void transform_tiles(matrix<T, tiled_matrix> &out, const matrix<T, tiled_matrix> &a,
+                     const matrix<T, tiled_matrix> &b, function f, thread_pool &pool) {
+    assert((out.get_rows() == a.get_rows() && out.get_cols() == a.get_cols() &&
+            a.get_rows() == b.get_rows() && a.get_cols() == b.get_cols()) && "Incompatible sizes!");
+    const std::vector<matrix_detail::tile_block> blocks = out.get_tile_blocks();
+    std::future<void> next_a, next_b, next_out;
+    for (std::size_t k = 0; k < blocks.size(); ++k) {
+        const matrix_detail::tile_block &t = blocks[k];
+        if (k + 1 < blocks.size()) {
+            const matrix_detail::tile_block &n = blocks[k + 1];
+            next_a = a.prefetch(n.row, n.row + n.rows, n.col, n.col + n.cols);
+            next_b = b.prefetch(n.row, n.row + n.rows, n.col, n.col + n.cols);
+            next_out = out.prefetch(n.row, n.row + n.rows, n.col, n.col + n.cols);
+        }
+        matrix<T> x(t.rows, t.cols), y(t.rows, t.cols);
+        a.read(t.row, t.col, x.get_view());
+        b.read(t.row, t.col, y.get_view());
+        pool.parallel_for(t.rows, [&](unsigned int i) {
+            for (unsigned int j = 0; j < t.cols; ++j)
+                x(i, j) = f(x(i, j), y(i, j));
+        });
+        out.write(t.row, t.col, x.get_view());
+    }
+}
+
+/**
+ * @brief transform_tiles on the default thread pool
+ */
+template <typename T, typename function>
+void transform_tiles(matrix<T, tiled_matrix> &out, const matrix<T, tiled_matrix> &a, function f) {
+    transform_tiles(out, a, f, thread_pool::get_default());
+}
+
+template <typename T, typename function>
+void transform_tiles(matrix<T, tiled_matrix> &out, const matrix<T, tiled_matrix> &a,
+                     const matrix<T, tiled_matrix> &b, function f) {
+    transform_tiles(out, a, b, f, thread_pool::get_default());
+}
+
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef MATRIX_UTILS_H
 #define MATRIX_UTILS_H
 #include <iostream>
+#include <memory>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
 
 
 /** 
@@ -21,8 +25,37 @@
  */ 
 
 
+// orders in which a basic matrix can store its elements
+struct row_major;
+struct column_major;
+
+// matrix storing its elements in a std::vector, created with (a rebind of) allocator
+template <typename allocator, typename layout = row_major>
+struct basic_storage;
+
 // useful to avoid specifying anything when we don't want to decorate a matrix
-struct basic_matrix;
+typedef basic_storage<std::allocator<void>> basic_matrix;
+
+// matrix storing its R x C elements inline (no heap allocation), see matrix_fixed.h
+template <unsigned int R, unsigned int C>
+struct fixed;
+
+// matrix referring to elements owned by another matrix, without owning them
+struct borrowed_matrix;
+
+// sparse matrices: compressed sparse rows, compressed sparse columns, coordinate list (see matrix_sparse.h)
+struct csr_matrix;
+struct csc_matrix;
+struct coo_matrix;
+
+// square matrices in packed storage: triangular, symmetric, banded (see matrix_packed.h)
+struct upper_triangular_matrix;
+struct lower_triangular_matrix;
+struct symmetric_matrix;
+struct banded_matrix;
+
+// matrix stored in tiles in a file, read through a cache (see matrix_tiled.h)
+struct tiled_matrix;
 
 // decoration that takes a submatrix of a matrix
 template <typename decorator_matrix> 
@@ -40,6 +73,22 @@ class diagonalmatrix;
 template <typename decorator_matrix> 
 class transpose_matrix;
 
+// decoration that reorders the rows of a matrix, e.g. the permutation of an LU factorization
+template <typename decorator_matrix>
+class permuted_rows;
+
+// lazy element-wise operation between two matrices (e.g. A + B)
+template <typename operation, typename left_matrix, typename right_matrix>
+class binary_expression;
+
+// lazy element-wise operation on a single matrix (e.g. -A, 2 * A)
+template <typename operation, typename decorator_matrix>
+class unary_expression;
+
+// requests a copy-on-write copy of a basic matrix, e.g. matrix<T> b(a, copy_on_write);
+struct copy_on_write_t {};
+inline constexpr copy_on_write_t copy_on_write{};
+
 // matrix base class, will be decorated for the rest of things
 template <typename T, typename type = basic_matrix>
 class matrix;
@@ -57,10 +106,72 @@ template <typename T, typename type>
 class const_iterator_limited;
 
 
+/**
+ * Type returned by the const operator() of matrix<T, type>: a reference for the
+ * matrices that store their elements somewhere, a value for the expressions,
+ * which compute them on the fly
+ */
+template <typename T, typename decoration>
+struct const_reference_of {
+    typedef const T &type;
+};
+
+template <typename T, typename operation, typename left_matrix, typename right_matrix>
+struct const_reference_of<T, binary_expression<operation, left_matrix, right_matrix>> {
+    typedef T type;
+};
+
+template <typename T, typename operation, typename decorator_matrix>
+struct const_reference_of<T, unary_expression<operation, decorator_matrix>> {
+    typedef T type;
+};
+
+template <typename T>
+struct const_reference_of<T, coo_matrix> {
+    typedef T type;
+};
+
+template <typename T>
+struct const_reference_of<T, tiled_matrix> {
+    typedef T type;
+};
+
+template <typename T, typename decorator_matrix>
+struct const_reference_of<T, permuted_rows<decorator_matrix>> {
+    typedef typename const_reference_of<T, decorator_matrix>::type type;
+};
+
+
+namespace matrix_detail {
+
+// decoration of a matrix type, e.g. the type returned by a get_transpose()
+template <typename M>
+struct decoration_of;
+
+template <typename T, typename decoration>
+struct decoration_of<matrix<T, decoration>> {
+    typedef decoration type;
+};
+
+// used to stop an argument (e.g. a scalar) from taking part in template argument deduction
+template <typename T>
+struct non_deduced {
+    typedef T type;
+};
+
+} // namespace matrix_detail
+
+
+// fast text output, used by operator<< (see matrix_io.h)
+template <typename T, typename type>
+std::ostream &write_text(std::ostream &os, const matrix<T, type> &m);
+
+
 /**
     @brief Output stream operator
 
-    Easily print a matrix on stdout (by rows)
+    Easily print a matrix on stdout (by rows), formatting the elements in large
+    buffers instead of one at a time (see write_text)
 
     @param os output stream
     @param m matrix we want to print
@@ -69,64 +180,124 @@ class const_iterator_limited;
 **/
 template <typename T, typename type>
 std::ostream& operator<<(std::ostream &os, const matrix<T, type> &m) {
-    unsigned int columns = m.get_cols();
-    for (unsigned int j = 0; j < m.get_rows(); j++) {
-        auto i = m.begin(j);
-        auto ie = m.end(j);
-        unsigned int k = 0;
-        for (; i != ie; ++i) {
-            ++k;
-            os << *i << " ";
-            if (columns == k) {
-                os << std::endl;
-                k = 0;
-            }
-        }
-    }
-    return os;
+    return write_text(os, m);
 }
 
 
+namespace matrix_detail {
+
+// iterator category of the iterators of matrix<T, type>: random access, unless
+// dereferencing yields a value instead of a reference (e.g. expressions)
+template <typename reference>
+struct iterator_category_of {
+    typedef typename std::conditional<std::is_reference<reference>::value,
+                                      std::random_access_iterator_tag,
+                                      std::input_iterator_tag>::type type;
+};
+
+} // namespace matrix_detail
+
+
+/**
+ * The iterators below walk a matrix element by element through its operator(),
+ * by column (column_iterator) or by row (iterator_limited). They keep both the
+ * (row, column) position, used to access the element, and the number of elements
+ * before it in the traversal, so that jumps, distances and comparisons are O(1).
+ */
 template <typename T, typename type>
 class column_iterator {
     friend class matrix<T, type>;
     friend class const_column_iterator<T, type>;
-    matrix<T, type> &m;
+    matrix<T, type> *m;
     unsigned int current_row;
     unsigned int current_column;
 
+    std::ptrdiff_t position() const {
+        return std::ptrdiff_t(current_column) * m->get_rows() + current_row;
+    }
+
+    void move_to(std::ptrdiff_t p) {
+        current_row = static_cast<unsigned int>(p % m->get_rows());
+        current_column = static_cast<unsigned int>(p / m->get_rows());
+    }
+
 public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T *pointer;
+    typedef T &reference;
+
+    column_iterator() :
+            m(nullptr), current_row(0), current_column(0) {}
+
     column_iterator(matrix<T, type> &mm, unsigned int r, unsigned int c) :
-            m(mm), current_row(r), current_column(c) {}
+            m(&mm), current_row(r), current_column(c) {}
 
     column_iterator &operator++() {
-        if (current_row == m.get_rows() - 1) {
-            current_column++;
-            current_row = 0;
-        }
-        else {
-            current_row++;
-        }
+        bool wrap = current_row + 1 == m->get_rows();
+        current_column += wrap;
+        current_row = wrap ? 0 : current_row + 1;
+        return *this;
+    }
+
+    column_iterator operator++(int) {
+        column_iterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    column_iterator &operator--() {
+        bool wrap = current_row == 0;
+        current_column -= wrap;
+        current_row = wrap ? m->get_rows() - 1 : current_row - 1;
         return *this;
     }
 
-    column_iterator &operator++(int) {
-        if (current_row == m.get_rows() - 1) {
-            current_column++;
-            current_row = 0;
-        }
-        else {
-            current_row++;
-        }
+    column_iterator operator--(int) {
+        column_iterator old = *this;
+        --*this;
+        return old;
+    }
+
+    column_iterator &operator+=(std::ptrdiff_t n) {
+        move_to(position() + n);
         return *this;
     }
 
-    T &operator*() {
-        return m(current_row, current_column);
+    column_iterator &operator-=(std::ptrdiff_t n) {
+        move_to(position() - n);
+        return *this;
+    }
+
+    column_iterator operator+(std::ptrdiff_t n) const {
+        column_iterator i = *this;
+        return i += n;
+    }
+
+    friend column_iterator operator+(std::ptrdiff_t n, const column_iterator &i) {
+        return i + n;
+    }
+
+    column_iterator operator-(std::ptrdiff_t n) const {
+        column_iterator i = *this;
+        return i -= n;
+    }
+
+    std::ptrdiff_t operator-(const column_iterator &other) const {
+        return position() - other.position();
+    }
+
+    T &operator*() const {
+        return (*m)(current_row, current_column);
+    }
+
+    T *operator->() const {
+        return &**this;
     }
 
-    const T &operator*() const {
-        return m(current_row, current_column);
+    T &operator[](std::ptrdiff_t n) const {
+        return *(*this + n);
     }
 
     bool operator==(const column_iterator &other) const {
@@ -138,6 +309,22 @@ public:
         return !(*this == other);
     }
 
+    bool operator<(const column_iterator &other) const {
+        return position() < other.position();
+    }
+
+    bool operator>(const column_iterator &other) const {
+        return other < *this;
+    }
+
+    bool operator<=(const column_iterator &other) const {
+        return !(other < *this);
+    }
+
+    bool operator>=(const column_iterator &other) const {
+        return !(*this < other);
+    }
+
     bool operator==(const const_column_iterator<T, type> &other) const {
         return (this->current_row == other.current_row &&
                 this->current_column == other.current_column);
@@ -152,38 +339,95 @@ template <typename T, typename type>
 class const_column_iterator {
     friend class matrix<T, type>;
     friend class column_iterator<T, type>;
-    const matrix<T, type> &m;
+    const matrix<T, type> *m;
     unsigned int current_row;
     unsigned int current_column;
 
+    std::ptrdiff_t position() const {
+        return std::ptrdiff_t(current_column) * m->get_rows() + current_row;
+    }
+
+    void move_to(std::ptrdiff_t p) {
+        current_row = static_cast<unsigned int>(p % m->get_rows());
+        current_column = static_cast<unsigned int>(p / m->get_rows());
+    }
+
 public:
+    typedef typename const_reference_of<T, type>::type reference;
+    typedef typename matrix_detail::iterator_category_of<reference>::type iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const T *pointer;
+
+    const_column_iterator() :
+            m(nullptr), current_row(0), current_column(0) {}
+
     const_column_iterator(const matrix<T, type> &mm, unsigned int r, unsigned int c) :
-            m(mm), current_row(r), current_column(c) {}
+            m(&mm), current_row(r), current_column(c) {}
+
+    const_column_iterator(const column_iterator<T, type> &i) :
+            m(i.m), current_row(i.current_row), current_column(i.current_column) {}
 
     const_column_iterator& operator++() {
-        if (current_row == m.get_rows() - 1) {
-            current_column++;
-            current_row = 0;
-        }
-        else {
-            current_row++;
-        }
+        bool wrap = current_row + 1 == m->get_rows();
+        current_column += wrap;
+        current_row = wrap ? 0 : current_row + 1;
         return *this;
     }
 
-    const_column_iterator& operator++(int) {
-        if (current_row == m.get_rows() - 1) {
-            current_column++;
-            current_row = 0;
-        }
-        else {
-            current_row++;
-        }
+    const_column_iterator operator++(int) {
+        const_column_iterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    const_column_iterator &operator--() {
+        bool wrap = current_row == 0;
+        current_column -= wrap;
+        current_row = wrap ? m->get_rows() - 1 : current_row - 1;
         return *this;
     }
 
-    const T &operator*() const {
-        return m(current_row, current_column);
+    const_column_iterator operator--(int) {
+        const_column_iterator old = *this;
+        --*this;
+        return old;
+    }
+
+    const_column_iterator &operator+=(std::ptrdiff_t n) {
+        move_to(position() + n);
+        return *this;
+    }
+
+    const_column_iterator &operator-=(std::ptrdiff_t n) {
+        move_to(position() - n);
+        return *this;
+    }
+
+    const_column_iterator operator+(std::ptrdiff_t n) const {
+        const_column_iterator i = *this;
+        return i += n;
+    }
+
+    friend const_column_iterator operator+(std::ptrdiff_t n, const const_column_iterator &i) {
+        return i + n;
+    }
+
+    const_column_iterator operator-(std::ptrdiff_t n) const {
+        const_column_iterator i = *this;
+        return i -= n;
+    }
+
+    std::ptrdiff_t operator-(const const_column_iterator &other) const {
+        return position() - other.position();
+    }
+
+    reference operator*() const {
+        return (*m)(current_row, current_column);
+    }
+
+    reference operator[](std::ptrdiff_t n) const {
+        return *(*this + n);
     }
 
     bool operator==(const const_column_iterator &other) const {
@@ -194,6 +438,22 @@ public:
         return !(*this == other);
     }
 
+    bool operator<(const const_column_iterator &other) const {
+        return position() < other.position();
+    }
+
+    bool operator>(const const_column_iterator &other) const {
+        return other < *this;
+    }
+
+    bool operator<=(const const_column_iterator &other) const {
+        return !(other < *this);
+    }
+
+    bool operator>=(const const_column_iterator &other) const {
+        return !(*this < other);
+    }
+
     bool operator==(const column_iterator<T, type> &other) const {
         return (this->current_row == other.current_row && this->current_column == other.current_column);
     }
@@ -206,35 +466,96 @@ public:
 
 template <typename T, typename type>
 class iterator_limited {
-    matrix<T, type> &m;
+    matrix<T, type> *m;
     unsigned int row;
     unsigned int column;
 
+    std::ptrdiff_t position() const {
+        return std::ptrdiff_t(row) * m->get_cols() + column;
+    }
+
+    void move_to(std::ptrdiff_t p) {
+        row = static_cast<unsigned int>(p / m->get_cols());
+        column = static_cast<unsigned int>(p % m->get_cols());
+    }
+
 public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef T *pointer;
+    typedef T &reference;
+
+    iterator_limited() :
+            m(nullptr), row(0), column(0) {}
+
     iterator_limited(matrix<T, type> &mm, unsigned int r, unsigned int c) :
-            m(mm), row(r), column(c) {}
+            m(&mm), row(r), column(c) {}
 
     iterator_limited &operator++() {
-        ++column;
-        if (column == m.get_cols()) {
-            column = 0;
-            row++;
-        }
+        bool wrap = column + 1 == m->get_cols();
+        row += wrap;
+        column = wrap ? 0 : column + 1;
+        return *this;
+    }
+
+    iterator_limited operator++(int) {
+        iterator_limited old = *this;
+        ++*this;
+        return old;
+    }
+
+    iterator_limited &operator--() {
+        bool wrap = column == 0;
+        row -= wrap;
+        column = wrap ? m->get_cols() - 1 : column - 1;
         return *this;
     }
 
-    iterator_limited &operator++(int) {
-        ++column;
-        if (column == m.get_cols()) {
-            column = 0;
-            row++;
-        }
+    iterator_limited operator--(int) {
+        iterator_limited old = *this;
+        --*this;
+        return old;
+    }
+
+    iterator_limited &operator+=(std::ptrdiff_t n) {
+        move_to(position() + n);
         return *this;
     }
 
+    iterator_limited &operator-=(std::ptrdiff_t n) {
+        move_to(position() - n);
+        return *this;
+    }
+
+    iterator_limited operator+(std::ptrdiff_t n) const {
+        iterator_limited i = *this;
+        return i += n;
+    }
+
+    friend iterator_limited operator+(std::ptrdiff_t n, const iterator_limited &i) {
+        return i + n;
+    }
+
+    iterator_limited operator-(std::ptrdiff_t n) const {
+        iterator_limited i = *this;
+        return i -= n;
+    }
+
+    std::ptrdiff_t operator-(const iterator_limited &other) const {
+        return position() - other.position();
+    }
+
+    T& operator*() const {
+        return (*m)(row, column);
+    }
 
-    T& operator*() {
-        return m(row, column);
+    T *operator->() const {
+        return &**this;
+    }
+
+    T &operator[](std::ptrdiff_t n) const {
+        return *(*this + n);
     }
 
     friend class const_iterator_limited<T, type>;
@@ -254,44 +575,121 @@ public:
     bool operator!=(const const_iterator_limited<T, type> &i) const {
         return (row != i.row) || (column != i.column);
     }
+
+    bool operator<(const iterator_limited &i) const {
+        return position() < i.position();
+    }
+
+    bool operator>(const iterator_limited &i) const {
+        return i < *this;
+    }
+
+    bool operator<=(const iterator_limited &i) const {
+        return !(i < *this);
+    }
+
+    bool operator>=(const iterator_limited &i) const {
+        return !(*this < i);
+    }
 };
 
 
 template <typename T, typename type>
 class const_iterator_limited {
-    const matrix<T, type> &m;
+    const matrix<T, type> *m;
     unsigned int row;
     unsigned int column;
 
+    std::ptrdiff_t position() const {
+        return std::ptrdiff_t(row) * m->get_cols() + column;
+    }
+
+    void move_to(std::ptrdiff_t p) {
+        row = static_cast<unsigned int>(p / m->get_cols());
+        column = static_cast<unsigned int>(p % m->get_cols());
+    }
+
 public:
+    typedef typename const_reference_of<T, type>::type reference;
+    typedef typename matrix_detail::iterator_category_of<reference>::type iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const T *pointer;
+
+    const_iterator_limited() :
+            m(nullptr), row(0), column(0) {}
+
     const_iterator_limited(const matrix<T, type> &mm, unsigned int r, unsigned int c) :
-            m(mm), row(r), column(c) {}
+            m(&mm), row(r), column(c) {}
+
+    const_iterator_limited(const iterator_limited<T, type> &i) :
+            m(i.m), row(i.row), column(i.column) {}
 
     const_iterator_limited &operator++() {
-        ++column;
-        if (column == m.get_cols()) {
-            column = 0;
-            row++;
-        }
+        bool wrap = column + 1 == m->get_cols();
+        row += wrap;
+        column = wrap ? 0 : column + 1;
         return *this;
     }
 
-    const_iterator_limited &operator++(int) {
-        ++column;
-        if (column == m.get_cols()) {
-            column = 0;
-            row++;
-        }
+    const_iterator_limited operator++(int) {
+        const_iterator_limited old = *this;
+        ++*this;
+        return old;
+    }
+
+    const_iterator_limited &operator--() {
+        bool wrap = column == 0;
+        row -= wrap;
+        column = wrap ? m->get_cols() - 1 : column - 1;
         return *this;
     }
 
-    const T& operator*() const {
-        return m(row, column);
+    const_iterator_limited operator--(int) {
+        const_iterator_limited old = *this;
+        --*this;
+        return old;
+    }
+
+    const_iterator_limited &operator+=(std::ptrdiff_t n) {
+        move_to(position() + n);
+        return *this;
+    }
+
+    const_iterator_limited &operator-=(std::ptrdiff_t n) {
+        move_to(position() - n);
+        return *this;
+    }
+
+    const_iterator_limited operator+(std::ptrdiff_t n) const {
+        const_iterator_limited i = *this;
+        return i += n;
+    }
+
+    friend const_iterator_limited operator+(std::ptrdiff_t n, const const_iterator_limited &i) {
+        return i + n;
+    }
+
+    const_iterator_limited operator-(std::ptrdiff_t n) const {
+        const_iterator_limited i = *this;
+        return i -= n;
+    }
+
+    std::ptrdiff_t operator-(const const_iterator_limited &other) const {
+        return position() - other.position();
+    }
+
+    reference operator*() const {
+        return (*m)(row, column);
+    }
+
+    reference operator[](std::ptrdiff_t n) const {
+        return *(*this + n);
     }
 
     friend class iterator_limited<T, type>;
 
-    bool operator==(const_iterator_limited &i) const {
+    bool operator==(const const_iterator_limited &i) const {
         return (row == i.row) && (column == i.column);
     }
 
@@ -299,13 +697,29 @@ public:
         return (row == i.row) && (column == i.column);
     }
 
-    bool operator!=(const_iterator_limited &i) const {
+    bool operator!=(const const_iterator_limited &i) const {
         return (row != i.row) || (column != i.column);
     }
 
     bool operator!=(const iterator_limited<T, type> &i) const {
         return (row != i.row) || (column != i.column);
     }
+
+    bool operator<(const const_iterator_limited &i) const {
+        return position() < i.position();
+    }
+
+    bool operator>(const const_iterator_limited &i) const {
+        return i < *this;
+    }
+
+    bool operator<=(const const_iterator_limited &i) const {
+        return !(i < *this);
+    }
+
+    bool operator>=(const const_iterator_limited &i) const {
+        return !(*this < i);
+    }
 };
 
 
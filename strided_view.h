@@ -0,0 +1,312 @@
+#ifndef STRIDED_VIEW_H
+#define STRIDED_VIEW_H
+
+// the decoration flags
+#include "matrix_utils.h"
+
+#include <cstddef>
+
+
+/**
+ * Every decoration built on top of a basic matrix (transpose, submatrix, diagonal)
+ * is an affine map from the (r, c) coordinates of the view to a position in the
+ * storage of the basic matrix:
+ *
+ *     address(r, c) = base + r * row_stride + c * col_stride
+ *
+ * Instead of walking the decoration chain at every access (one offset, swap or
+ * min per level), each view computes this map once, when it is built, starting
+ * from the map of the matrix it decorates. Accessing an element then costs one
+ * multiply-add, whatever the nesting depth.
+ *
+ * A diagonalmatrix breaks the affine structure (most of its elements are the
+ * "null element", not stored anywhere), so chains containing it use a second
+ * kind of descriptor, selected at compile time through `is_structured`.
+ */
+
+
+/**
+ * @brief Tells whether a decoration chain contains a diagonalmatrix
+ * @tparam type the decoration type (e.g. submatrix<transpose_matrix<basic_matrix>>)
+ */
+template <typename type>
+struct is_structured {
+    static const bool value = false;
+};
+
+template <typename decorator_matrix>
+struct is_structured<diagonalmatrix<decorator_matrix>> {
+    static const bool value = true;
+};
+
+template <typename decorator_matrix>
+struct is_structured<transpose_matrix<decorator_matrix>> {
+    static const bool value = is_structured<decorator_matrix>::value;
+};
+
+template <typename decorator_matrix>
+struct is_structured<submatrix<decorator_matrix>> {
+    static const bool value = is_structured<decorator_matrix>::value;
+};
+
+template <typename decorator_matrix>
+struct is_structured<diagonal<decorator_matrix>> {
+    static const bool value = is_structured<decorator_matrix>::value;
+};
+
+
+template <typename T, bool structured>
+struct strided_view;
+
+
+/**
+ * @brief The elements of a view as `count` runs of `length` elements each,
+ * e.g. one run for a basic matrix, one run per row for a submatrix, one run per
+ * column for the transpose of a submatrix. Run i starts at base + i * stride;
+ * inside a run the elements are `step` apart, i.e. contiguous (step == 1) for
+ * every view built on a basic matrix.
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+struct strided_segments {
+    T *base;               // first element of the first run
+    std::size_t length;    // elements of each run
+    std::size_t count;     // number of runs
+    std::ptrdiff_t stride; // distance between the first elements of two consecutive runs
+    std::ptrdiff_t step;   // distance between two consecutive elements of a run
+    bool by_column;        // true iff the runs follow the columns of the view
+
+    /**
+     * @brief address of the first element of run i
+     */
+    T *run(std::size_t i) const {
+        return base + std::ptrdiff_t(i) * stride;
+    }
+
+    /**
+     * @brief total number of elements
+     */
+    std::size_t size() const {
+        return length * count;
+    }
+};
+
+
+/**
+ * @brief Descriptor of a dense view: base pointer, strides and extents
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+struct strided_view<T, false> {
+    T *base;                    // address of element (0, 0)
+    std::ptrdiff_t row_stride;  // distance between (r, c) and (r + 1, c)
+    std::ptrdiff_t col_stride;  // distance between (r, c) and (r, c + 1)
+    unsigned int rows;
+    unsigned int cols;
+
+    /**
+     * @brief access the element in position (r, c) of the view
+     * @param r row (0-based)
+     * @param c column (0-based)
+     * @return reference to the element
+     */
+    T &at(unsigned int r, unsigned int c) const {
+        return base[r * row_stride + c * col_stride];
+    }
+
+    /**
+     * @brief descriptor of the transpose of this view
+     * @return rows and columns (and their strides) swapped
+     */
+    strided_view transposed() const {
+        strided_view t = {base, col_stride, row_stride, cols, rows};
+        return t;
+    }
+
+    /**
+     * @brief descriptor of the submatrix [fr, lr) x [fc, lc) of this view
+     * @return descriptor sharing the strides, starting from (fr, fc)
+     */
+    strided_view sub(unsigned int fr, unsigned int lr, unsigned int fc, unsigned int lc) const {
+        strided_view s = {base + fr * row_stride + fc * col_stride,
+                          row_stride, col_stride, lr - fr, lc - fc};
+        return s;
+    }
+
+    /**
+     * @brief descriptor of the diagonal of this view, as a min(rows, cols) x 1 vector
+     * @return descriptor moving by one row and one column at every step
+     */
+    strided_view diag() const {
+        strided_view d = {base, row_stride + col_stride, 0, rows < cols ? rows : cols, 1};
+        return d;
+    }
+
+    /**
+     * @brief descriptor of the diagonal matrix built from this view (iff it is a vector)
+     * @return structured descriptor whose diagonal is this vector
+     */
+    strided_view<T, true> diagmatrix() const;
+
+    /**
+     * @brief the elements of this view as contiguous runs, as long as possible:
+     * a single run if the view is dense, otherwise one run per row (or per column,
+     * whichever is contiguous), in the order of the storage
+     * @return runs covering every element of the view
+     */
+    strided_segments<T> segments() const {
+        const std::size_t r = rows, c = cols;
+        if ((c <= 1 || col_stride == 1) && (r <= 1 || row_stride == std::ptrdiff_t(c))) {
+            strided_segments<T> s = {base, r * c, (r * c == 0) ? 0u : 1u, std::ptrdiff_t(r * c), 1, false};
+            return s;
+        }
+        if ((r <= 1 || row_stride == 1) && (c <= 1 || col_stride == std::ptrdiff_t(r))) {
+            strided_segments<T> s = {base, r * c, 1, std::ptrdiff_t(r * c), 1, true};
+            return s;
+        }
+        if (col_stride == 1 || c == 1) {
+            strided_segments<T> s = {base, c, r, row_stride, 1, false};
+            return s;
+        }
+        if (row_stride == 1 || r == 1) {
+            strided_segments<T> s = {base, r, c, col_stride, 1, true};
+            return s;
+        }
+        // neither direction is contiguous (only for borrowed views with unusual strides)
+        strided_segments<T> s = {base, c, r, row_stride, col_stride, false};
+        return s;
+    }
+};
+
+
+/**
+ * @brief Descriptor of a view whose chain contains a diagonalmatrix.
+ *
+ * The stored elements all come from a dense vector u (u(p) = base[p * stride],
+ * 0 <= p < length). Element (r, c) of the view is u(p(r, c)), where
+ * p(r, c) = r * p_row + c * p_col + p_offset, provided that p(r, c) is in range
+ * and, if `on_diagonal` holds, that r - c == delta. Otherwise it is the null element.
+ * These rules are closed under transpose, submatrix, diagonal and diagonalmatrix.
+ *
+ * @tparam T the type of data contained in the matrix
+ */
+template <typename T>
+struct strided_view<T, true> {
+    T *base;
+    std::ptrdiff_t stride;
+    long length;
+    long p_row, p_col, p_offset;
+    bool on_diagonal;
+    long delta;
+    unsigned int rows;
+    unsigned int cols;
+    T null_element;
+
+    /**
+     * @brief access the element in position (r, c) of the view
+     * @param r row (0-based)
+     * @param c column (0-based)
+     * @return const reference to the element (the null element if not stored)
+     */
+    const T &at(unsigned int r, unsigned int c) const {
+        long lr = r, lc = c;
+        if (on_diagonal && lr - lc != delta)
+            return null_element;
+        long p = lr * p_row + lc * p_col + p_offset;
+        if (p < 0 || p >= length)
+            return null_element;
+        return base[p * stride];
+    }
+
+    strided_view transposed() const {
+        strided_view t = *this;
+        t.p_row = p_col;
+        t.p_col = p_row;
+        t.delta = -delta;
+        t.rows = cols;
+        t.cols = rows;
+        return t;
+    }
+
+    strided_view sub(unsigned int fr, unsigned int lr, unsigned int fc, unsigned int lc) const {
+        strided_view s = *this;
+        s.p_offset += p_row * long(fr) + p_col * long(fc);
+        s.delta += long(fc) - long(fr);
+        s.rows = lr - fr;
+        s.cols = lc - fc;
+        return s;
+    }
+
+    strided_view diag() const {
+        strided_view d = *this;
+        if (on_diagonal && delta != 0)
+            d.length = 0; // the diagonal misses every stored element
+        d.p_row = p_row + p_col;
+        d.p_col = 0;
+        d.on_diagonal = false;
+        d.delta = 0;
+        d.rows = rows < cols ? rows : cols;
+        d.cols = 1;
+        return d;
+    }
+
+    /**
+     * @brief the stored elements of this view (the null element is not stored),
+     * in the order of their positions: along the line r - c == delta if
+     * `on_diagonal`, along the vector otherwise. Consecutive positions are
+     * consecutive elements of u, hence a single run if u is contiguous.
+     * @return runs covering the stored elements only
+     */
+    strided_segments<T> segments() const {
+        // along the positions, p grows by one at every step (see diag() and diagmatrix())
+        long first, last, p0;
+        if (on_diagonal) {
+            p0 = p_offset - delta * p_col;
+            first = (delta > 0) ? delta : 0;
+            last = (long(rows) < long(cols) + delta) ? long(rows) : long(cols) + delta;
+        }
+        else {
+            p0 = p_offset;
+            first = 0;
+            last = (cols == 1) ? long(rows) : long(cols);
+        }
+        first = (first > -p0) ? first : -p0;
+        last = (last < length - p0) ? last : length - p0;
+        std::size_t n = (last > first) ? std::size_t(last - first) : 0;
+        T *start = base + (first + p0) * stride;
+        if (stride == 1) {
+            strided_segments<T> s = {start, n, n ? 1u : 0u, std::ptrdiff_t(n), 1, false};
+            return s;
+        }
+        strided_segments<T> s = {start, 1, n, stride, 1, false};
+        return s;
+    }
+
+    strided_view diagmatrix() const {
+        strided_view m = *this;
+        if (on_diagonal) {
+            // only row `delta` of this vector may be stored: keep that single element
+            long p = p_row * delta + p_offset;
+            bool stored = delta >= 0 && delta < long(rows) && p >= 0 && p < length;
+            m.base = base + (stored ? p * stride : 0);
+            m.length = stored ? 1 : 0;
+            m.p_row = 1;
+            m.p_offset = -delta;
+        }
+        m.p_col = 0;
+        m.on_diagonal = true;
+        m.delta = 0;
+        m.cols = rows;
+        return m;
+    }
+};
+
+
+template <typename T>
+strided_view<T, true> strided_view<T, false>::diagmatrix() const {
+    strided_view<T, true> m = {base, row_stride, long(rows), 1, 0, 0, true, 0, rows, rows, T(0)};
+    return m;
+}
+
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @brief Work-stealing thread pool used by the parallel kernels of the library.
+ *
+ * A pool of n threads spawns n - 1 workers: the thread calling `parallel_for`
+ * is the n-th one, and runs tasks while waiting for its loop to complete.
+ * Every worker owns a queue: it pops tasks from the back of its own queue and,
+ * when that is empty, steals from the front of the others'. Hence a pool of
+ * 1 thread never spawns anything and runs everything serially.
+ */
+class thread_pool {
+    typedef std::function<void()> task;
+
+    struct task_queue {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+
+    // tasks of a single parallel_for call
+    struct task_group {
+        std::atomic<unsigned int> remaining;
+        std::mutex lock;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+
+    std::vector<std::unique_ptr<task_queue>> queues; // queue 0 is filled by external threads
+    std::vector<std::thread> workers;
+    std::atomic<unsigned int> queued;
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    bool stopping;
+
+    // index of the queue owned by the current thread (0 outside of this pool)
+    unsigned int own_queue() const {
+        return current_pool() == this ? current_index() : 0;
+    }
+
+    static const thread_pool *&current_pool() {
+        static thread_local const thread_pool *pool = nullptr;
+        return pool;
+    }
+
+    static unsigned int &current_index() {
+        static thread_local unsigned int index = 0;
+        return index;
+    }
+
+    void push(unsigned int q, task t) {
+        {
+            std::lock_guard<std::mutex> guard(queues[q]->lock);
+            queues[q]->tasks.push_back(std::move(t));
+        }
+        ++queued;
+    }
+
+    /**
+     * @brief run one queued task, if any: first from the back of queue `q`,
+     * then stealing from the front of the other queues
+     * @return true iff a task has been run
+     */
+    bool run_one(unsigned int q) {
+        task t;
+        {
+            std::lock_guard<std::mutex> guard(queues[q]->lock);
+            if (!queues[q]->tasks.empty()) {
+                t = std::move(queues[q]->tasks.back());
+                queues[q]->tasks.pop_back();
+            }
+        }
+        for (unsigned int i = 1; !t && i < queues.size(); ++i) {
+            task_queue &victim = *queues[(q + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                t = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+        if (!t)
+            return false;
+        --queued;
+        t();
+        return true;
+    }
+
+    void work(unsigned int index) {
+        current_pool() = this;
+        current_index() = index;
+        while (true) {
+            if (run_one(index))
+                continue;
+            std::unique_lock<std::mutex> guard(sleep_lock);
+            wake.wait(guard, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0)
+                return;
+        }
+    }
+
+public:
+    /**
+     * @brief Constructor given the number of threads
+     * @param n_threads threads working on a parallel_for, the calling one included
+     */
+    explicit thread_pool(unsigned int n_threads) :
+            queued(0), stopping(false) {
+        if (n_threads == 0)
+            n_threads = 1;
+        for (unsigned int i = 0; i < n_threads; ++i)
+            queues.emplace_back(new task_queue);
+        for (unsigned int i = 1; i < n_threads; ++i)
+            workers.emplace_back(&thread_pool::work, this, i);
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    /**
+     * @brief Destructor: runs the tasks still queued, then joins the workers
+     */
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    /**
+     * @brief Get number of threads
+     * @return unsigned int corresponding to the threads of the pool, the caller included
+     */
+    unsigned int get_threads() const {
+        return static_cast<unsigned int>(queues.size());
+    }
+
+    /**
+     * @brief run f(0), ..., f(n - 1) on the pool and wait for all of them.
+     * Can be called from inside a task: the calling thread keeps running tasks while waiting.
+     * If some f(i) throws, the first exception is rethrown here once every task is over.
+     * @param n number of tasks
+     * @param f callable taking the index of the task
+     */
+    template <typename F>
+    void parallel_for(unsigned int n, const F &f) {
+        if (n == 0)
+            return;
+        if (workers.empty()) {
+            for (unsigned int i = 0; i < n; ++i)
+                f(i);
+            return;
+        }
+        std::shared_ptr<task_group> group = std::make_shared<task_group>();
+        group->remaining = n;
+        unsigned int q = own_queue();
+        for (unsigned int i = 0; i < n; ++i) {
+            push((q + i) % queues.size(), [group, &f, i] {
+                try {
+                    f(i);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> guard(group->lock);
+                    if (!group->error)
+                        group->error = std::current_exception();
+                }
+                if (--group->remaining == 0) {
+                    std::lock_guard<std::mutex> guard(group->lock);
+                    group->done.notify_all();
+                }
+            });
+        }
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+        }
+        wake.notify_all();
+        // help until our tasks are all taken, then wait for the ones still running
+        while (group->remaining > 0 && run_one(q)) {}
+        std::unique_lock<std::mutex> guard(group->lock);
+        group->done.wait(guard, [&group] { return group->remaining == 0; });
+        if (group->error)
+            std::rethrow_exception(group->error);
+    }
+
+    /**
+     * @brief Pool used by the library when none is given explicitly.
+     * Starts with a single thread (i.e. serial), see `set_default_threads`.
+     * @return reference to the default pool
+     */
+    static thread_pool &get_default() {
+        return *default_pool();
+    }
+
+    /**
+     * @brief Replace the default pool with one of n_threads threads.
+     * Must not be called while the default pool is in use.
+     * @param n_threads threads of the new default pool, the calling one included
+     */
+    static void set_default_threads(unsigned int n_threads) {
+        default_pool().reset(new thread_pool(n_threads));
+    }
+
+private:
+    static std::unique_ptr<thread_pool> &default_pool() {
+        static std::unique_ptr<thread_pool> pool(new thread_pool(1));
+        return pool;
+    }
+};
+
+
+#endif